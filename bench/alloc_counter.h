@@ -0,0 +1,7 @@
+// Counts the heap allocations of a benchmark. Linking alloc_counter.cpp into
+// a benchmark replaces the global operator new with one that counts.
+#pragma once
+#include <cstddef>
+
+// Number of calls to operator new so far, in the whole process.
+size_t allocation_count();
@@ -0,0 +1,285 @@
+// The pointer AST of ast.h against the flat layout of flat_ast.h on a 4 MB
+// script: parse time, a full tree walk, a linear pass over one kind of node
+// and the bytes each layout takes.
+#include "flat_ast.h"
+#include "parser.h"
+#include "scanner.h"
+#include <benchmark/benchmark.h>
+
+static std::string make_script(size_t size) {
+  const std::string chunk = R"(fun area(w, h) {
+  var a = w * h + (w - 1) * (h - 1) / 2;
+  if (a > 100 and w != h) { a = a - w * 0.5; } else { a = -a + 1; }
+  return a;
+}
+var total = 0;
+for (var i = 0; i < 10; i = i + 1) { total = total + area(i, i + 2) * 3; }
+print(total, "done");
+)";
+  std::string source;
+  while (source.size() < size)
+    source += chunk;
+  return source;
+}
+
+// Visits every node once, counting them and summing the number literals.
+struct Walker {
+  size_t nodes = 0;
+  double sum = 0;
+  void walk(const Expr *e) {
+    if (e != nullptr) {
+      nodes++;
+      dispatch<void>(this, e);
+    }
+  }
+  void walk(const Stmt *s) {
+    if (s != nullptr) {
+      nodes++;
+      dispatch<void>(this, s);
+    }
+  }
+  void visit_assign(const Assign *n) { walk(n->value); }
+  void visit_binary(const Binary *n) {
+    walk(n->left);
+    walk(n->right);
+  }
+  void visit_grouping(const Grouping *n) { walk(n->expression); }
+  void visit_literal(const Literal *n) { sum += n->value.number; }
+  void visit_logical(const Logical *n) {
+    walk(n->left);
+    walk(n->right);
+  }
+  void visit_unary(const Unary *n) { walk(n->right); }
+  void visit_call(const Call *n) {
+    walk(n->callee);
+    for (auto arg : n->arguments)
+      walk(arg);
+  }
+  void visit_variable(const Variable *) {}
+  void visit_block(const Block *n) {
+    for (auto s : n->statements)
+      walk(s);
+  }
+  void visit_expression(const Expression *n) { walk(n->expression); }
+  void visit_print(const Print *n) {
+    for (auto e : n->expressions)
+      walk(e);
+  }
+  void visit_var(const Var *n) { walk(n->initializer); }
+  void visit_if(const If *n) {
+    walk(n->condition);
+    walk(n->thenBranch);
+    walk(n->elseBranch);
+  }
+  void visit_while(const While *n) {
+    walk(n->condition);
+    walk(n->body);
+  }
+  void visit_function(const Function *n) {
+    for (auto s : n->body)
+      walk(s);
+  }
+  void visit_return(const Return *n) { walk(n->value); }
+  void visit_class(const Class *n) {
+    for (auto s : n->methods)
+      walk(s);
+  }
+};
+
+// The same walk over the flat layout.
+struct FlatWalker {
+  const FlatAst &ast;
+  size_t nodes = 0;
+  double sum = 0;
+  void walk(FlatRange list, const std::vector<ExprRef> &items) {
+    for (uint32_t i = 0; i < list.count; i++)
+      walk(items[list.first + i]);
+  }
+  void walk(FlatRange list, const std::vector<StmtRef> &items) {
+    for (uint32_t i = 0; i < list.count; i++)
+      walk(items[list.first + i]);
+  }
+  void walk(ExprRef ref) {
+    if (ref.is_null())
+      return;
+    nodes++;
+    uint32_t i = ref.index();
+    switch (ref.kind()) {
+    case Expr::Kind::Assign:
+      walk(ast.assign_nodes[i].value);
+      break;
+    case Expr::Kind::Binary:
+      walk(ast.binary_nodes[i].left);
+      walk(ast.binary_nodes[i].right);
+      break;
+    case Expr::Kind::Grouping:
+      walk(ast.grouping_nodes[i].expression);
+      break;
+    case Expr::Kind::Literal:
+      sum += ast.literal_nodes[i].value.number;
+      break;
+    case Expr::Kind::Logical:
+      walk(ast.logical_nodes[i].left);
+      walk(ast.logical_nodes[i].right);
+      break;
+    case Expr::Kind::Unary:
+      walk(ast.unary_nodes[i].right);
+      break;
+    case Expr::Kind::Call:
+      walk(ast.call_nodes[i].callee);
+      walk(ast.call_nodes[i].arguments, ast.expr_lists);
+      break;
+    case Expr::Kind::Variable:
+      break;
+    }
+  }
+  void walk(StmtRef ref) {
+    if (ref.is_null())
+      return;
+    nodes++;
+    uint32_t i = ref.index();
+    switch (ref.kind()) {
+    case Stmt::Kind::Block:
+      walk(ast.block_nodes[i].statements, ast.stmt_lists);
+      break;
+    case Stmt::Kind::Expression:
+      walk(ast.expression_nodes[i].expression);
+      break;
+    case Stmt::Kind::Print:
+      walk(ast.print_nodes[i].expressions, ast.expr_lists);
+      break;
+    case Stmt::Kind::Var:
+      walk(ast.var_nodes[i].initializer);
+      break;
+    case Stmt::Kind::If:
+      walk(ast.if_nodes[i].condition);
+      walk(ast.if_nodes[i].thenBranch);
+      walk(ast.if_nodes[i].elseBranch);
+      break;
+    case Stmt::Kind::While:
+      walk(ast.while_nodes[i].condition);
+      walk(ast.while_nodes[i].body);
+      break;
+    case Stmt::Kind::Function:
+      walk(ast.function_nodes[i].body, ast.stmt_lists);
+      break;
+    case Stmt::Kind::Return:
+      walk(ast.return_nodes[i].value);
+      break;
+    case Stmt::Kind::Class:
+      walk(ast.class_nodes[i].methods, ast.stmt_lists);
+      break;
+    }
+  }
+};
+
+// Lexed once and shared by all benchmarks.
+static const Scanner &script() {
+  static Scanner *scanner = [] {
+    auto s = new Scanner();
+    s->init(make_script(4 << 20));
+    s->scan();
+    return s;
+  }();
+  return *scanner;
+}
+
+static void BM_Parse(benchmark::State &state) {
+  auto tokens = script().get_tokens();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    Parser parser;
+    parser.init(tokens);
+    benchmark::DoNotOptimize(parser.parse_stmts());
+    bytes = parser.take_arena()->bytes_allocated();
+  }
+  state.counters["ast_bytes"] = bytes;
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_Parse)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseFlat(benchmark::State &state) {
+  auto tokens = script().get_tokens();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    FlatAst ast;
+    Parser parser;
+    parser.init(tokens);
+    parser.parse_flat(ast);
+    bytes = ast.bytes();
+  }
+  state.counters["ast_bytes"] = bytes;
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_ParseFlat)->Unit(benchmark::kMillisecond);
+
+// Top level declarations parsed on range(0) threads, see
+// Parser::parse_stmts(unsigned).
+static void BM_ParseThreads(benchmark::State &state) {
+  auto tokens = script().get_tokens();
+  for (auto _ : state) {
+    Parser parser;
+    parser.init(tokens);
+    benchmark::DoNotOptimize(parser.parse_stmts(state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_ParseThreads)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_Walk(benchmark::State &state) {
+  Parser parser;
+  parser.init(script().get_tokens());
+  auto stmts = parser.parse_stmts();
+  size_t nodes = 0;
+  for (auto _ : state) {
+    Walker walker;
+    for (auto stmt : stmts)
+      walker.walk(stmt);
+    benchmark::DoNotOptimize(walker.sum);
+    nodes = walker.nodes;
+  }
+  state.SetItemsProcessed(state.iterations() * nodes);
+}
+BENCHMARK(BM_Walk)->Unit(benchmark::kMillisecond);
+
+static void BM_WalkFlat(benchmark::State &state) {
+  FlatAst ast;
+  Parser parser;
+  parser.init(script().get_tokens());
+  parser.parse_flat(ast);
+  size_t nodes = 0;
+  for (auto _ : state) {
+    FlatWalker walker{ast};
+    for (auto stmt : ast.program)
+      walker.walk(stmt);
+    benchmark::DoNotOptimize(walker.sum);
+    nodes = walker.nodes;
+  }
+  state.SetItemsProcessed(state.iterations() * nodes);
+}
+BENCHMARK(BM_WalkFlat)->Unit(benchmark::kMillisecond);
+
+// Passes that only care about one kind of node, like collecting constants,
+// read a single vector front to back instead of walking the tree.
+static void BM_LiteralsFlat(benchmark::State &state) {
+  FlatAst ast;
+  Parser parser;
+  parser.init(script().get_tokens());
+  parser.parse_flat(ast);
+  for (auto _ : state) {
+    double sum = 0;
+    for (const auto &literal : ast.literal_nodes)
+      sum += literal.value.number;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * ast.literal_nodes.size());
+}
+BENCHMARK(BM_LiteralsFlat)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+// Evaluator throughput on a tight counting loop, once with the counter in a
+// local scope and once as a global, on recursive calls and on closures. The
+// scripts are parsed and resolved once and evaluated over and over. Reports
+// items/s and heap allocations per item.
+#include "alloc_counter.h"
+#include "eval.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include <benchmark/benchmark.h>
+
+// A script parsed and resolved once, to be evaluated over and over.
+struct Script {
+  Scanner scanner;
+  Parser parser;
+  std::vector<Stmt *> stmts;
+  bool load(const std::string &code, Evaluator &eval) {
+    scanner.init(code);
+    scanner.scan();
+    parser.init(scanner.get_tokens());
+    stmts = parser.parse_stmts();
+    Resolver resolver(&eval);
+    return resolver.resolve(stmts);
+  }
+};
+
+static constexpr int kCount = 100000;
+
+static void run_count(benchmark::State &state, const std::string &loop) {
+  Evaluator eval;
+  Script script;
+  if (!script.load(loop, eval)) {
+    state.SkipWithError("could not resolve the script");
+    return;
+  }
+  size_t allocated = 0;
+  for (auto _ : state) {
+    size_t before = allocation_count();
+    eval.eval(script.stmts);
+    allocated += allocation_count() - before;
+  }
+  state.SetItemsProcessed(state.iterations() * kCount);
+  state.counters["allocs_per_iteration"] = benchmark::Counter(
+      double(allocated) / kCount, benchmark::Counter::kAvgIterations);
+}
+
+// i is read twice and written once per iteration, from the block of the loop
+static void BM_CountLocal(benchmark::State &state) {
+  run_count(state, "{ var i = 0; while (i < " + std::to_string(kCount) +
+                       ") { i = i + 1; } }");
+}
+BENCHMARK(BM_CountLocal)->Unit(benchmark::kMillisecond);
+
+static void BM_CountGlobal(benchmark::State &state) {
+  run_count(state, "var i = 0; while (i < " + std::to_string(kCount) +
+                       ") { i = i + 1; }");
+}
+BENCHMARK(BM_CountGlobal)->Unit(benchmark::kMillisecond);
+
+// Calls and returns, fib(range(0)) makes 2 * fib(n + 1) - 1 of them.
+static void BM_Fib(benchmark::State &state) {
+  int n = state.range(0);
+  Evaluator eval;
+  Script script;
+  if (!script.load("fun fib(n) { if (n < 2) { return n; } "
+                   "return fib(n - 1) + fib(n - 2); } var r = fib(" +
+                       std::to_string(n) + ");",
+                   eval)) {
+    state.SkipWithError("could not resolve the script");
+    return;
+  }
+  double a = 0, b = 1;
+  for (int i = 0; i <= n; i++) {
+    std::swap(a, b);
+    b += a;
+  }
+  size_t calls = 2 * a - 1;
+  size_t allocated = 0;
+  for (auto _ : state) {
+    size_t before = allocation_count();
+    eval.eval(script.stmts);
+    allocated += allocation_count() - before;
+  }
+  state.SetItemsProcessed(state.iterations() * calls);
+  state.counters["allocs_per_call"] = benchmark::Counter(
+      double(allocated) / calls, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Fib)->Arg(20)->Arg(25)->Unit(benchmark::kMillisecond);
+
+// Makes a counter closure and calls it twice, kClosures times. The cells
+// and upvalues come from the pool of the evaluator.
+static constexpr int kClosures = 10000;
+
+static void BM_Closures(benchmark::State &state) {
+  Evaluator eval;
+  Script script;
+  if (!script.load("fun make() { var n = 0; fun inc() { n = n + 1; "
+                   "return n; } return inc; } var t = 0; for (var i = 0; "
+                   "i < " +
+                       std::to_string(kClosures) +
+                       "; i = i + 1) { var c = make(); t = t + c() + c(); }",
+                   eval)) {
+    state.SkipWithError("could not resolve the script");
+    return;
+  }
+  size_t allocated = 0;
+  Pool::Stats before_pool = eval.pool_.stats();
+  for (auto _ : state) {
+    size_t before = allocation_count();
+    eval.eval(script.stmts);
+    allocated += allocation_count() - before;
+  }
+  const Pool::Stats &pool = eval.pool_.stats();
+  state.SetItemsProcessed(state.iterations() * kClosures);
+  state.counters["allocs_per_closure"] = benchmark::Counter(
+      double(allocated) / kClosures, benchmark::Counter::kAvgIterations);
+  state.counters["pooled_per_closure"] = benchmark::Counter(
+      double(pool.allocations - before_pool.allocations) / kClosures,
+      benchmark::Counter::kAvgIterations);
+  state.counters["pool_slabs"] = pool.slabs;
+}
+BENCHMARK(BM_Closures)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
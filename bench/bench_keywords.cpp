@@ -0,0 +1,91 @@
+// Micro-benchmarks for classifying identifiers as reserved words.
+#include "scanner.h"
+#include "source.h"
+#include "token.h"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <unordered_map>
+
+// Identifier heavy source: mostly user identifiers, some of which share a
+// prefix, length or first letter with a keyword, mixed with real keywords.
+static std::string make_identifier_source(size_t n_words) {
+  const std::vector<std::string> words = {
+      "and",    "class",   "else",  "false",   "fun",    "for",   "if",
+      "nil",    "or",      "print", "return",  "super",  "this",  "true",
+      "var",    "while",   "andy",  "classes", "elsa",   "fa",    "funny",
+      "format", "iff",     "nil_",  "orange",  "printf", "ret",   "superb",
+      "thus",   "truest",  "value", "whilst",  "x",      "count", "index",
+      "_tmp",   "counter", "a1",    "b2",      "fib",    "total", "result"};
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, words.size() - 1);
+  std::string source;
+  for (size_t i = 0; i < n_words; i++) {
+    source += words[pick(rng)];
+    source += (i % 8 == 7) ? '\n' : ' ';
+  }
+  return source;
+}
+
+static std::vector<std::string> split_words(const std::string &source) {
+  std::vector<std::string> words;
+  std::string word;
+  for (char c : source) {
+    if (std::isspace(c)) {
+      words.push_back(word);
+      word.clear();
+    } else {
+      word += c;
+    }
+  }
+  return words;
+}
+
+static void BM_KeywordPerfectHash(benchmark::State &state) {
+  auto words = split_words(make_identifier_source(4096));
+  for (auto _ : state) {
+    for (const auto &w : words) {
+      benchmark::DoNotOptimize(keyword_type(w));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_KeywordPerfectHash);
+
+// The previous approach, kept here as the baseline to compare against.
+static void BM_KeywordUnorderedMap(benchmark::State &state) {
+  const std::unordered_map<std::string_view, TokenType> keywords = {
+      {"and", AND},     {"class", CLASS},   {"else", ELSE},   {"false", FALSE},
+      {"fun", FUN},     {"for", FOR},       {"if", IF},       {"nil", NIL},
+      {"or", OR},       {"print", PRINT},   {"return", RETURN},
+      {"super", SUPER}, {"this", THIS},     {"true", TRUE},   {"var", VAR},
+      {"while", WHILE},
+  };
+  auto words = split_words(make_identifier_source(4096));
+  for (auto _ : state) {
+    for (const auto &w : words) {
+      auto it = keywords.find(w);
+      benchmark::DoNotOptimize(it == keywords.end() ? IDENTIFIER : it->second);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_KeywordUnorderedMap);
+
+static void BM_ScanIdentifiers(benchmark::State &state) {
+  auto mode = state.range(0) ? Scanner::Mode::DFA : Scanner::Mode::REGEX;
+  std::string source = make_identifier_source(state.range(1));
+  size_t n_tokens = 0;
+  for (auto _ : state) {
+    Scanner scanner;
+    scanner.init(source, mode);
+    scanner.scan();
+    n_tokens = scanner.get_tokens().size();
+    SourceManager::get().release(scanner.get_source_base());
+  }
+  state.SetItemsProcessed(state.iterations() * n_tokens);
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.SetLabel(mode == Scanner::Mode::DFA ? "dfa" : "regex");
+}
+BENCHMARK(BM_ScanIdentifiers)->Args({0, 1 << 10})->Args({1, 1 << 10});
+
+BENCHMARK_MAIN();
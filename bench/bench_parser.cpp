@@ -0,0 +1,68 @@
+// Parser throughput on expression-dense code. The script is lexed once and
+// the tokens are parsed over and over. Reports tokens/s and heap allocations
+// per token, which counts everything but the nodes themselves since those
+// come from the arena.
+#include "alloc_counter.h"
+#include "parser.h"
+#include "scanner.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+// A random expression with `depth` levels of operators.
+static std::string make_expression(std::mt19937 &rng, int depth) {
+  static const char *operands[] = {"a", "b", "count", "1", "2.5", "\"s\"",
+                                   "nil", "true"};
+  static const char *binary[] = {" + ", " - ", " * ", " / ",
+                                 " == ", " != ", " < ", " >= "};
+  if (depth == 0)
+    return operands[rng() % std::size(operands)];
+  switch (rng() % 6) {
+  case 0:
+    return "-" + make_expression(rng, depth - 1);
+  case 1:
+    return "(" + make_expression(rng, depth - 1) + ")";
+  case 2:
+    return "f(" + make_expression(rng, depth - 1) + ", " +
+           make_expression(rng, depth - 1) + ")";
+  case 3:
+    // kept in parentheses, the parser used to reject `a or b or c`
+    return "(" + make_expression(rng, depth - 1) +
+           (rng() % 2 ? " and " : " or ") + make_expression(rng, depth - 1) +
+           ")";
+  default:
+    return make_expression(rng, depth - 1) +
+           binary[rng() % std::size(binary)] + make_expression(rng, depth - 1);
+  }
+}
+
+static std::string make_script(size_t size) {
+  std::mt19937 rng(14);
+  std::string source;
+  while (source.size() < size)
+    source += "x = " + make_expression(rng, 6) + ";\n";
+  return source;
+}
+
+static void BM_ParseExpressions(benchmark::State &state) {
+  Scanner scanner;
+  scanner.init(make_script(state.range(0)));
+  scanner.scan();
+  auto tokens = scanner.get_tokens();
+  size_t allocated = 0;
+  for (auto _ : state) {
+    Parser parser;
+    parser.init(tokens);
+    size_t before = allocation_count();
+    benchmark::DoNotOptimize(parser.parse_stmts());
+    allocated += allocation_count() - before;
+  }
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+  state.counters["allocs_per_token"] = benchmark::Counter(
+      double(allocated) / tokens.size(), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ParseExpressions)
+    ->Arg(64 << 10)
+    ->Arg(4 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,67 @@
+// Single character edits to a 1 MB script, re-lexed incrementally versus
+// scanned again from scratch.
+#include "scanner.h"
+#include "source.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+static std::string make_script(size_t size) {
+  const std::string chunk = R"(// sum the first n numbers (slowly)
+fun sum(n) {
+  var total = 0;
+  for (var i = 0; i < n; i = i + 1) { total = total + i * 1.5; }
+  return total;
+}
+var message = "the sum is";
+print message; print sum(100);
+)";
+  std::string source;
+  while (source.size() < size)
+    source += chunk;
+  return source;
+}
+
+// Inserts an 'x' at a random offset and removes it again on the next
+// iteration, so the script stays the same size. An 'x' can not make a Lox
+// source fail to lex.
+static void BM_RelexSingleCharEdit(benchmark::State &state) {
+  std::string source = make_script(1 << 20);
+  Scanner scanner;
+  scanner.init(source);
+  scanner.scan();
+  std::mt19937 rng(11);
+  size_t offset = 0, relexed = 0;
+  bool inserted = false;
+  for (auto _ : state) {
+    if (inserted) {
+      scanner.relex({offset, 1, ""});
+    } else {
+      offset = rng() % source.size();
+      scanner.relex({offset, 0, "x"});
+    }
+    inserted = !inserted;
+    relexed += scanner.relexed_tokens();
+  }
+  state.counters["relexed_tokens"] =
+      benchmark::Counter(relexed, benchmark::Counter::kAvgIterations);
+  state.counters["tokens"] = scanner.get_tokens().size();
+  SourceManager::get().release(scanner.get_source_base());
+}
+BENCHMARK(BM_RelexSingleCharEdit)->Unit(benchmark::kMicrosecond);
+
+// The baseline: every edit scans the whole script again.
+static void BM_RescanSingleCharEdit(benchmark::State &state) {
+  std::string source = make_script(1 << 20);
+  std::mt19937 rng(11);
+  for (auto _ : state) {
+    std::string edited = source;
+    edited.insert(rng() % source.size(), 1, 'x');
+    Scanner scanner;
+    scanner.init(edited);
+    scanner.scan();
+    SourceManager::get().release(scanner.get_source_base());
+  }
+}
+BENCHMARK(BM_RescanSingleCharEdit)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,89 @@
+// Scanner throughput on generated corpora. Every corpus is valid Lox at the
+// lexical level and is dominated by one kind of token, so a change to the
+// scanner can be judged per token class. Reports bytes/s, tokens/s and heap
+// allocations per token.
+#include "alloc_counter.h"
+#include "scanner.h"
+#include "source.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+enum Corpus { IDENTIFIERS, NUMBERS, STRINGS, COMMENTS };
+
+static const char *corpus_name(Corpus corpus) {
+  switch (corpus) {
+  case IDENTIFIERS:
+    return "identifiers";
+  case NUMBERS:
+    return "numbers";
+  case STRINGS:
+    return "strings";
+  case COMMENTS:
+    return "comments";
+  }
+  return "";
+}
+
+// One line of the corpus, roughly 40 to 80 bytes.
+static void append_line(Corpus corpus, std::mt19937 &rng, std::string &out) {
+  static const char *words[] = {"count", "index", "total", "result", "fib",
+                                "value", "andy",  "classes", "superb", "x"};
+  auto word = [&] { return words[rng() % std::size(words)]; };
+  auto number = [&] { return std::to_string(rng() % 100000); };
+  switch (corpus) {
+  case IDENTIFIERS:
+    out += std::string("var ") + word() + " = " + word() + " and " + word() +
+           " or " + word() + "; while " + word() + " " + word() + " " +
+           word() + "\n";
+    break;
+  case NUMBERS:
+    out += "print " + number() + " + " + number() + "." + number() + " * " +
+           number() + " - " + number() + " / " + number() + ".5;\n";
+    break;
+  case STRINGS:
+    out += std::string("print \"") + word() + " is not " + word() +
+           "\"; var s = \"" + word() + " " + number() + " " + word() +
+           " over two\nlines\";\n";
+    break;
+  case COMMENTS:
+    out += std::string("// ") + word() + " is computed from " + word() +
+           " and " + word() + ", see above\n" + word() + ";\n";
+    break;
+  }
+}
+
+static std::string make_corpus(Corpus corpus, size_t size) {
+  std::mt19937 rng(5);
+  std::string source;
+  source.reserve(size + 128);
+  while (source.size() < size)
+    append_line(corpus, rng, source);
+  return source;
+}
+
+static void BM_Scan(benchmark::State &state) {
+  Corpus corpus = Corpus(state.range(0));
+  std::string source = make_corpus(corpus, state.range(1));
+  size_t tokens = 0;
+  size_t allocated = 0;
+  for (auto _ : state) {
+    size_t before = allocation_count();
+    Scanner scanner;
+    scanner.init(source);
+    scanner.scan();
+    tokens += scanner.get_tokens().size();
+    SourceManager::get().release(scanner.get_source_base());
+    allocated += allocation_count() - before;
+  }
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.counters["tokens/s"] =
+      benchmark::Counter(tokens, benchmark::Counter::kIsRate);
+  state.counters["allocs/token"] = tokens ? double(allocated) / tokens : 0;
+  state.SetLabel(corpus_name(corpus));
+}
+BENCHMARK(BM_Scan)
+    ->ArgsProduct({{IDENTIFIERS, NUMBERS, STRINGS, COMMENTS},
+                   {1 << 10, 64 << 10, 1 << 20, 16 << 20, 100 << 20}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
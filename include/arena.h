@@ -0,0 +1,73 @@
+// A bump allocator for objects that are all freed together, like the nodes
+// of a syntax tree. Destructors are never run, so only trivially
+// destructible types may be placed in an arena.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Arena {
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  std::vector<Block> blocks_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+  size_t next_block_size_ = 4096;
+  size_t bytes_allocated_ = 0;
+  void *allocate_slow(size_t size, size_t align);
+
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t align) {
+    char *p = (char *)(((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1));
+    if (p + size > end_ || cur_ == nullptr) {
+      return allocate_slow(size, align);
+    }
+    cur_ = p + size;
+    bytes_allocated_ += size;
+    return p;
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "the arena does not run destructors");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Copies items into the arena, e.g. the children of a node that were
+  // collected in a temporary vector.
+  template <typename T> std::span<T> copy(const std::vector<T> &items) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "the arena does not run destructors");
+    if (items.empty()) {
+      return {};
+    }
+    T *p = (T *)allocate(sizeof(T) * items.size(), alignof(T));
+    std::uninitialized_copy(items.begin(), items.end(), p);
+    return std::span<T>(p, items.size());
+  }
+
+  // Takes over the blocks of other, so what was allocated there lives as
+  // long as this arena. other is left empty.
+  void merge(Arena &other);
+
+  // Frees everything allocated so far. The last block is kept and reused.
+  void reset();
+
+  // Whether p points into memory handed out by this arena.
+  bool contains(const void *p) const;
+
+  // Bytes handed out so far, not counting alignment padding.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+};
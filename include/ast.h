@@ -1,234 +1,365 @@
 #pragma once
 #include "utils.h"
+#include "source.h"
+#include "storage.h"
 #include "token.h"
+#include <span>
+#include <type_traits>
+#include <vector>
 
+template <typename T, typename B>
+bool isa(const B *node) {
+  return node != nullptr && T::classof(node);
+}
+
+template <typename T, typename B>
+auto dyn_cast(B *node) {
+  using R = std::conditional_t<std::is_const_v<B>, const T, T>;
+  return isa<T>(node) ? static_cast<R *>(node) : nullptr;
+}
 
 class Expr{
   public:
-    size_t line_no = 0;
+    enum class Kind : uint8_t {
+      Assign,
+      Binary,
+      Grouping,
+      Literal,
+      Logical,
+      Unary,
+      Call,
+      Variable,
+    };
+    const Kind kind;
+    // position in the SourceManager, the line is looked up on demand
+    uint32_t offset = 0;
+    explicit Expr(Kind kind) : kind(kind) {}
+    int line_no() const {
+      return SourceManager::get().position(offset).line;
+    }
     template <typename T, typename V>
     T accept(V v) const {
       return v->visit(this);
     }
-    virtual std::string print_type() {
+    std::string print_type() const {
+      switch (kind) {
+      case Kind::Assign:
+        return "Assign";
+      case Kind::Binary:
+        return "Binary";
+      case Kind::Grouping:
+        return "Grouping";
+      case Kind::Literal:
+        return "Literal";
+      case Kind::Logical:
+        return "Logical";
+      case Kind::Unary:
+        return "Unary";
+      case Kind::Call:
+        return "Call";
+      case Kind::Variable:
+        return "Variable";
+      }
       return "Expr";
     }
-    virtual ~Expr() {} 
 };
 
 class Assign : public Expr {
   public:
-    std::shared_ptr<Token> name;
-    std::shared_ptr<Expr> value;
-    virtual std::string print_type() {
-      return "Assign";
-    }
-    
-    ~Assign() {
+    Token name{};
+    Expr* value{};
+    mutable int storage{};
+    mutable int slot{};
+    Assign() : Expr(Kind::Assign) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Assign;
     }
 };
+static_assert(std::is_trivially_destructible_v<Assign>);
 
 class Binary : public Expr {
   public:
-    std::shared_ptr<Expr> left;
-    std::shared_ptr<Token> op;
-    std::shared_ptr<Expr> right;
-    virtual std::string print_type() {
-      return "Binary";
-    }
-    
-    ~Binary() {
+    Expr* left{};
+    Token op{};
+    Expr* right{};
+    Binary() : Expr(Kind::Binary) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Binary;
     }
 };
+static_assert(std::is_trivially_destructible_v<Binary>);
 
 class Grouping : public Expr {
   public:
-    std::shared_ptr<Expr> expression;
-    virtual std::string print_type() {
-      return "Grouping";
-    }
-    
-    ~Grouping() {
+    Expr* expression{};
+    Grouping() : Expr(Kind::Grouping) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Grouping;
     }
 };
+static_assert(std::is_trivially_destructible_v<Grouping>);
 
 class Literal : public Expr {
   public:
-    std::shared_ptr<Token> value;
-    virtual std::string print_type() {
-      return "Literal";
-    }
-    
-    ~Literal() {
+    Token value{};
+    Literal() : Expr(Kind::Literal) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Literal;
     }
 };
+static_assert(std::is_trivially_destructible_v<Literal>);
 
 class Logical : public Expr {
   public:
-    std::shared_ptr<Expr> left;
-    std::shared_ptr<Token> op;
-    std::shared_ptr<Expr> right;
-    virtual std::string print_type() {
-      return "Logical";
-    }
-    
-    ~Logical() {
+    Expr* left{};
+    Token op{};
+    Expr* right{};
+    Logical() : Expr(Kind::Logical) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Logical;
     }
 };
+static_assert(std::is_trivially_destructible_v<Logical>);
 
 class Unary : public Expr {
   public:
-    std::shared_ptr<Token> op;
-    std::shared_ptr<Expr> right;
-    virtual std::string print_type() {
-      return "Unary";
-    }
-    
-    ~Unary() {
+    Token op{};
+    Expr* right{};
+    Unary() : Expr(Kind::Unary) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Unary;
     }
 };
+static_assert(std::is_trivially_destructible_v<Unary>);
 
 class Call : public Expr {
   public:
-    std::shared_ptr<Expr> callee;
-    std::shared_ptr<Token> paren;
-    std::vector<std::shared_ptr<Expr>> arguments;
-    virtual std::string print_type() {
-      return "Call";
-    }
-    
-    ~Call() {
+    Expr* callee{};
+    Token paren{};
+    std::span<Expr*> arguments{};
+    Call() : Expr(Kind::Call) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Call;
     }
 };
+static_assert(std::is_trivially_destructible_v<Call>);
 
 class Variable : public Expr {
   public:
-    std::shared_ptr<Token> name;
-    virtual std::string print_type() {
-      return "Variable";
-    }
-    
-    ~Variable() {
+    Token name{};
+    mutable int storage{};
+    mutable int slot{};
+    Variable() : Expr(Kind::Variable) {}
+    static bool classof(const Expr *node) {
+      return node->kind == Kind::Variable;
     }
 };
+static_assert(std::is_trivially_destructible_v<Variable>);
+
+template <typename R, typename V>
+R dispatch(V *visitor, const Expr *node) {
+  switch (node->kind) {
+  case Expr::Kind::Assign:
+    return visitor->visit_assign(static_cast<const Assign *>(node));
+  case Expr::Kind::Binary:
+    return visitor->visit_binary(static_cast<const Binary *>(node));
+  case Expr::Kind::Grouping:
+    return visitor->visit_grouping(static_cast<const Grouping *>(node));
+  case Expr::Kind::Literal:
+    return visitor->visit_literal(static_cast<const Literal *>(node));
+  case Expr::Kind::Logical:
+    return visitor->visit_logical(static_cast<const Logical *>(node));
+  case Expr::Kind::Unary:
+    return visitor->visit_unary(static_cast<const Unary *>(node));
+  case Expr::Kind::Call:
+    return visitor->visit_call(static_cast<const Call *>(node));
+  case Expr::Kind::Variable:
+    return visitor->visit_variable(static_cast<const Variable *>(node));
+  }
+  return R();
+}
 
 class Stmt{
   public:
-    size_t line_no = 0;
+    enum class Kind : uint8_t {
+      Block,
+      Expression,
+      Print,
+      Var,
+      If,
+      While,
+      Function,
+      Return,
+      Class,
+    };
+    const Kind kind;
+    // position in the SourceManager, the line is looked up on demand
+    uint32_t offset = 0;
+    explicit Stmt(Kind kind) : kind(kind) {}
+    int line_no() const {
+      return SourceManager::get().position(offset).line;
+    }
     template <typename T, typename V>
     T accept(V v) const {
       return v->visit(this);
     }
-    virtual std::string print_type() {
-      return "Expr";
+    std::string print_type() const {
+      switch (kind) {
+      case Kind::Block:
+        return "Block";
+      case Kind::Expression:
+        return "Expression";
+      case Kind::Print:
+        return "Print";
+      case Kind::Var:
+        return "Var";
+      case Kind::If:
+        return "If";
+      case Kind::While:
+        return "While";
+      case Kind::Function:
+        return "Function";
+      case Kind::Return:
+        return "Return";
+      case Kind::Class:
+        return "Class";
+      }
+      return "Stmt";
     }
-    virtual ~Stmt() {} 
 };
 
 class Block : public Stmt {
   public:
-    std::vector<std::shared_ptr<Stmt>> statements;
-    virtual std::string print_type() {
-      return "Block";
-    }
-    
-    ~Block() {
+    std::span<Stmt*> statements{};
+    mutable int frame_size{};
+    Block() : Stmt(Kind::Block) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Block;
     }
 };
+static_assert(std::is_trivially_destructible_v<Block>);
 
 class Expression : public Stmt {
   public:
-    std::shared_ptr<Expr> expression;
-    virtual std::string print_type() {
-      return "Expression";
-    }
-    
-    ~Expression() {
+    Expr* expression{};
+    Expression() : Stmt(Kind::Expression) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Expression;
     }
 };
+static_assert(std::is_trivially_destructible_v<Expression>);
 
 class Print : public Stmt {
   public:
-    std::vector<std::shared_ptr<Expr>> expressions;
-    virtual std::string print_type() {
-      return "Print";
-    }
-    
-    ~Print() {
+    std::span<Expr*> expressions{};
+    Print() : Stmt(Kind::Print) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Print;
     }
 };
+static_assert(std::is_trivially_destructible_v<Print>);
 
 class Var : public Stmt {
   public:
-    std::shared_ptr<Token> name;
-    std::shared_ptr<Expr> initializer;
-    virtual std::string print_type() {
-      return "Var";
-    }
-    
-    ~Var() {
+    Token name{};
+    Expr* initializer{};
+    mutable int storage{};
+    mutable int slot{};
+    Var() : Stmt(Kind::Var) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Var;
     }
 };
+static_assert(std::is_trivially_destructible_v<Var>);
 
 class If : public Stmt {
   public:
-    std::shared_ptr<Expr> condition;
-    std::shared_ptr<Stmt> thenBranch;
-    std::shared_ptr<Stmt> elseBranch;
-    virtual std::string print_type() {
-      return "If";
-    }
-    
-    ~If() {
+    Expr* condition{};
+    Stmt* thenBranch{};
+    Stmt* elseBranch{};
+    If() : Stmt(Kind::If) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::If;
     }
 };
+static_assert(std::is_trivially_destructible_v<If>);
 
 class While : public Stmt {
   public:
-    std::shared_ptr<Expr> condition;
-    std::shared_ptr<Stmt> body;
-    virtual std::string print_type() {
-      return "While";
-    }
-    
-    ~While() {
+    Expr* condition{};
+    Stmt* body{};
+    While() : Stmt(Kind::While) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::While;
     }
 };
+static_assert(std::is_trivially_destructible_v<While>);
 
 class Function : public Stmt {
   public:
-    std::shared_ptr<Token> name;
-    std::vector<std::shared_ptr<Token>> params;
-    std::vector<std::shared_ptr<Stmt>> body;
-    virtual std::string print_type() {
-      return "Function";
-    }
-    
-    ~Function() {
+    Token name{};
+    std::span<Token> params{};
+    std::span<Stmt*> body{};
+    Token brace{};
+    bool lazy{};
+    mutable int storage{};
+    mutable int slot{};
+    mutable int frame_size{};
+    mutable std::span<Upvalue> upvalues{};
+    mutable std::span<int> cell_params{};
+    Function() : Stmt(Kind::Function) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Function;
     }
 };
+static_assert(std::is_trivially_destructible_v<Function>);
 
 class Return : public Stmt {
   public:
-    std::shared_ptr<Token> keyword;
-    std::shared_ptr<Expr> value;
-    virtual std::string print_type() {
-      return "Return";
-    }
-    
-    ~Return() {
+    Token keyword{};
+    Expr* value{};
+    Return() : Stmt(Kind::Return) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Return;
     }
 };
+static_assert(std::is_trivially_destructible_v<Return>);
 
 class Class : public Stmt {
   public:
-    std::shared_ptr<Token> name;
-    std::vector<std::shared_ptr<Stmt>> methods;
-    virtual std::string print_type() {
-      return "Class";
-    }
-    
-    ~Class() {
+    Token name{};
+    std::span<Stmt*> methods{};
+    mutable int storage{};
+    mutable int slot{};
+    Class() : Stmt(Kind::Class) {}
+    static bool classof(const Stmt *node) {
+      return node->kind == Kind::Class;
     }
 };
+static_assert(std::is_trivially_destructible_v<Class>);
+
+template <typename R, typename V>
+R dispatch(V *visitor, const Stmt *node) {
+  switch (node->kind) {
+  case Stmt::Kind::Block:
+    return visitor->visit_block(static_cast<const Block *>(node));
+  case Stmt::Kind::Expression:
+    return visitor->visit_expression(static_cast<const Expression *>(node));
+  case Stmt::Kind::Print:
+    return visitor->visit_print(static_cast<const Print *>(node));
+  case Stmt::Kind::Var:
+    return visitor->visit_var(static_cast<const Var *>(node));
+  case Stmt::Kind::If:
+    return visitor->visit_if(static_cast<const If *>(node));
+  case Stmt::Kind::While:
+    return visitor->visit_while(static_cast<const While *>(node));
+  case Stmt::Kind::Function:
+    return visitor->visit_function(static_cast<const Function *>(node));
+  case Stmt::Kind::Return:
+    return visitor->visit_return(static_cast<const Return *>(node));
+  case Stmt::Kind::Class:
+    return visitor->visit_class(static_cast<const Class *>(node));
+  }
+  return R();
+}
 
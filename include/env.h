@@ -1,23 +1,40 @@
 #pragma once
 #include "object.h"
+#include "pool.h"
+#include "symbol.h"
 #include "token.h"
+#include "utils.h"
+#include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+
+// A local that closures capture, shared by the frame that declares it and
+// the closures.
+using Cell = std::shared_ptr<Object>;
+// The cells a closure captured, see LoxFunction.
+using Upvalues = std::vector<Cell, PoolAllocator<Cell>>;
 
 class Environment {
 private:
 public:
-  std::unordered_map<std::string, Object> env_map;
+  // The globals, keyed by the SymbolTable id of the name. Locals are kept by
+  // the Evaluator where the Resolver put them, see storage.h.
+  std::unordered_map<Symbol, Object> env_map;
   Environment *enclosing = nullptr;
 
 public:
   Environment() = default;
   Environment(Environment *enclosing) : enclosing(enclosing){};
-  void define(const std::string &name, const Object &value);
-  [[nodiscard]] bool assign(const std::string &name, const Object &value);
+  void define(Symbol name, const Object &value);
+  // For names that are not lexed, like the native functions.
+  void define(std::string_view name, const Object &value);
+  [[nodiscard]] bool assign(Symbol name, const Object &value);
+  [[nodiscard]] bool assign(std::string_view name, const Object &value);
+  // IDENTIFIERs are looked up by their symbol, other tokens by their text.
   Object *get(const Token &t);
-  Object *get(const std::string &name);
-  Object *get_at(int distance, const std::string &name);
-  bool assign_at(int distance, const std::string &name, const Object &value);
+  Object *get(Symbol name);
+  Object *get(std::string_view name);
   std::string print();
   ~Environment();
 };
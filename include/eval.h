@@ -1,16 +1,39 @@
 #pragma once
+#include "arena.h"
 #include "ast.h"
 #include "env.h"
 #include "object.h"
+#include <functional>
 #include <memory>
+#include <optional>
 
 class Evaluator {
 public:
   Evaluator();
-  std::vector<std::shared_ptr<Stmt>> stmts_;
+  struct KeptArena {
+    std::unique_ptr<Arena> arena;
+    // the SourceManager buffer the tokens of the nodes point into, if it
+    // goes away with them
+    std::optional<uint32_t> source;
+  };
+  // the nodes of all code evaluated so far, functions defined in it may
+  // still be called
+  std::vector<KeptArena> arenas_;
+  // The cells and upvalues of closures. It is declared before everything
+  // that can hold on to them, so it is destroyed last.
+  Pool pool_;
   std::shared_ptr<Environment> globals;
+  // the environment top level code runs in, the globals
   std::shared_ptr<Environment> env;
-  std::unordered_map<const Expr *, int> locals;
+  // The locals of the functions being run, where the Resolver put them (see
+  // storage.h): in the value stack, or in a cell in the cell stack if a
+  // closure captures them. Every call has a frame at the same index in
+  // both, frame_ is where the current one starts.
+  std::vector<Object> stack_;
+  std::vector<Cell> cells_;
+  size_t frame_ = 0;
+  // the upvalues of the closure being run
+  const Upvalues *upvalues_ = nullptr;
   Object visit_unary(const Unary *u);
   Object visit_binary(const Binary *b);
   Object visit_literal(const Literal *l);
@@ -20,18 +43,43 @@ public:
   Object visit_assign(const Assign *a);
   Object visit_call(const Call *c);
   Object eval(const Expr *e);
-  Object *lookup_variable(const Token *name, const Expr *expr);
+  Object *lookup_variable(const Variable *v);
+  // The local at slot of the current frame, or the upvalue at slot. Null if
+  // its cell was not made yet.
+  Object *local(int storage, int slot);
   void visit_block(const Block *b);
+  void visit_print(const Print *p);
+  void visit_expression(const Expression *e);
+  void visit_var(const Var *v);
   void visit_if(const If *i);
   void visit_while(const While *w);
-  void eval(std::vector<std::shared_ptr<Stmt>> &&stmts);
+  // A new cell holding value, from pool_.
+  Cell make_cell(Object value);
+  // Defines a name where the Resolver put it. A captured local gets a new
+  // cell, closures made before keep the old one.
+  void define(const Token &name, int storage, int slot, const Object &value);
+  // Runs the body of f in a frame of its own, with the upvalues of the
+  // closure being called. The frame starts at args, which visit_call
+  // evaluated onto the top of the value stack.
+  Object call(const Function *f, const Upvalues &upvalues,
+              std::span<Object> args);
+  void eval(std::span<Stmt *const> stmts);
+  // Keeps the nodes in arena alive for as long as the evaluator, or until
+  // collect finds them unreachable. source is released along with them.
+  void keep_alive(std::unique_ptr<Arena> arena,
+                  std::optional<uint32_t> source = std::nullopt);
+  // Frees the kept arenas that no function reachable from the globals has
+  // nodes in, along with their sources. Only call it between top level
+  // statements, while nothing else holds on to nodes. Returns the number of
+  // arenas freed.
+  size_t collect();
+  // Parses and resolves the body of a function that was parsed lazily, see
+  // Parser::set_lazy_functions. Whoever parsed the program provides it.
+  std::function<bool(const Function *)> load_body;
   Object visit(const Expr *e);
   void visit(const Stmt *s);
   void visit_function(const Function *f);
   void visit_class(const Class *c);
   void visit_return(const Return *r);
-  void execute_block(std::vector<std::shared_ptr<Stmt>> stmts,
-                     std::shared_ptr<Environment> env);
-  void resolve(const Expr *e, int depth);
   ~Evaluator();
 };
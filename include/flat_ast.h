@@ -0,0 +1,962 @@
+#pragma once
+#include "arena.h"
+#include "ast.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A child in the flat AST, the kind of the child in the top bits and its
+// index in the vector of nodes of that kind below them.
+template <typename Base> struct FlatRef {
+  static constexpr uint32_t kIndexBits = 27;
+  static constexpr uint32_t kNull = UINT32_MAX;
+  uint32_t value = kNull;
+  FlatRef() = default;
+  FlatRef(typename Base::Kind kind, size_t index)
+    : value(static_cast<uint32_t>(kind) << kIndexBits |
+            static_cast<uint32_t>(index)) {}
+  bool is_null() const { return value == kNull; }
+  typename Base::Kind kind() const {
+    return static_cast<typename Base::Kind>(value >> kIndexBits);
+  }
+  uint32_t index() const { return value & ((1u << kIndexBits) - 1); }
+};
+
+// A run of items in one of the list vectors, e.g. the arguments of a call.
+struct FlatRange {
+  uint32_t first = 0;
+  uint32_t count = 0;
+  // whether the range lies in a list of `size` items
+  bool within(size_t size) const {
+    return first <= size && count <= size - first;
+  }
+};
+
+template <typename T>
+FlatRange flat_append(std::vector<T> &list, const std::vector<T> &items) {
+  FlatRange range{static_cast<uint32_t>(list.size()),
+                  static_cast<uint32_t>(items.size())};
+  list.insert(list.end(), items.begin(), items.end());
+  return range;
+}
+
+using ExprRef = FlatRef<Expr>;
+
+struct FlatAssign {
+  uint32_t offset = 0;
+  Token name{};
+  ExprRef value{};
+  int storage{};
+  int slot{};
+};
+
+struct FlatBinary {
+  uint32_t offset = 0;
+  ExprRef left{};
+  Token op{};
+  ExprRef right{};
+};
+
+struct FlatGrouping {
+  uint32_t offset = 0;
+  ExprRef expression{};
+};
+
+struct FlatLiteral {
+  uint32_t offset = 0;
+  Token value{};
+};
+
+struct FlatLogical {
+  uint32_t offset = 0;
+  ExprRef left{};
+  Token op{};
+  ExprRef right{};
+};
+
+struct FlatUnary {
+  uint32_t offset = 0;
+  Token op{};
+  ExprRef right{};
+};
+
+struct FlatCall {
+  uint32_t offset = 0;
+  ExprRef callee{};
+  Token paren{};
+  FlatRange arguments{};
+};
+
+struct FlatVariable {
+  uint32_t offset = 0;
+  Token name{};
+  int storage{};
+  int slot{};
+};
+
+using StmtRef = FlatRef<Stmt>;
+
+struct FlatBlock {
+  uint32_t offset = 0;
+  FlatRange statements{};
+  int frame_size{};
+};
+
+struct FlatExpression {
+  uint32_t offset = 0;
+  ExprRef expression{};
+};
+
+struct FlatPrint {
+  uint32_t offset = 0;
+  FlatRange expressions{};
+};
+
+struct FlatVar {
+  uint32_t offset = 0;
+  Token name{};
+  ExprRef initializer{};
+  int storage{};
+  int slot{};
+};
+
+struct FlatIf {
+  uint32_t offset = 0;
+  ExprRef condition{};
+  StmtRef thenBranch{};
+  StmtRef elseBranch{};
+};
+
+struct FlatWhile {
+  uint32_t offset = 0;
+  ExprRef condition{};
+  StmtRef body{};
+};
+
+struct FlatFunction {
+  uint32_t offset = 0;
+  Token name{};
+  FlatRange params{};
+  FlatRange body{};
+  Token brace{};
+  bool lazy{};
+  int storage{};
+  int slot{};
+  int frame_size{};
+  FlatRange upvalues{};
+  FlatRange cell_params{};
+};
+
+struct FlatReturn {
+  uint32_t offset = 0;
+  Token keyword{};
+  ExprRef value{};
+};
+
+struct FlatClass {
+  uint32_t offset = 0;
+  Token name{};
+  FlatRange methods{};
+  int storage{};
+  int slot{};
+};
+
+// Changes with grammar.txt, so flat ASTs stored with an older layout are
+// not read.
+constexpr uint32_t kFlatAstVersion = 0xd6316fa7;
+
+// A flat AST stored elsewhere, e.g. in a mapped file.
+struct FlatAstView {
+  std::span<const FlatAssign> assign_nodes;
+  std::span<const FlatBinary> binary_nodes;
+  std::span<const FlatGrouping> grouping_nodes;
+  std::span<const FlatLiteral> literal_nodes;
+  std::span<const FlatLogical> logical_nodes;
+  std::span<const FlatUnary> unary_nodes;
+  std::span<const FlatCall> call_nodes;
+  std::span<const FlatVariable> variable_nodes;
+  std::span<const FlatBlock> block_nodes;
+  std::span<const FlatExpression> expression_nodes;
+  std::span<const FlatPrint> print_nodes;
+  std::span<const FlatVar> var_nodes;
+  std::span<const FlatIf> if_nodes;
+  std::span<const FlatWhile> while_nodes;
+  std::span<const FlatFunction> function_nodes;
+  std::span<const FlatReturn> return_nodes;
+  std::span<const FlatClass> class_nodes;
+  std::span<const ExprRef> expr_lists;
+  std::span<const StmtRef> stmt_lists;
+  std::span<const Token> token_lists;
+  std::span<const Upvalue> upvalue_lists;
+  std::span<const int> int_lists;
+  std::span<const StmtRef> program;
+  // Calls f with every array above, in declaration order.
+  template <typename F> void for_each_array(F &&f) {
+    f(assign_nodes);
+    f(binary_nodes);
+    f(grouping_nodes);
+    f(literal_nodes);
+    f(logical_nodes);
+    f(unary_nodes);
+    f(call_nodes);
+    f(variable_nodes);
+    f(block_nodes);
+    f(expression_nodes);
+    f(print_nodes);
+    f(var_nodes);
+    f(if_nodes);
+    f(while_nodes);
+    f(function_nodes);
+    f(return_nodes);
+    f(class_nodes);
+    f(expr_lists);
+    f(stmt_lists);
+    f(token_lists);
+    f(upvalue_lists);
+    f(int_lists);
+    f(program);
+  }
+};
+
+// The nodes of a program in one contiguous vector per kind.
+struct FlatAst {
+  std::vector<FlatAssign> assign_nodes;
+  std::vector<FlatBinary> binary_nodes;
+  std::vector<FlatGrouping> grouping_nodes;
+  std::vector<FlatLiteral> literal_nodes;
+  std::vector<FlatLogical> logical_nodes;
+  std::vector<FlatUnary> unary_nodes;
+  std::vector<FlatCall> call_nodes;
+  std::vector<FlatVariable> variable_nodes;
+  std::vector<FlatBlock> block_nodes;
+  std::vector<FlatExpression> expression_nodes;
+  std::vector<FlatPrint> print_nodes;
+  std::vector<FlatVar> var_nodes;
+  std::vector<FlatIf> if_nodes;
+  std::vector<FlatWhile> while_nodes;
+  std::vector<FlatFunction> function_nodes;
+  std::vector<FlatReturn> return_nodes;
+  std::vector<FlatClass> class_nodes;
+  std::vector<ExprRef> expr_lists;
+  std::vector<StmtRef> stmt_lists;
+  std::vector<Token> token_lists;
+  std::vector<Upvalue> upvalue_lists;
+  std::vector<int> int_lists;
+  // the top level statements in source order
+  std::vector<StmtRef> program;
+  // Calls f with every array above, in declaration order.
+  template <typename F> void for_each_array(F &&f) const {
+    f(assign_nodes);
+    f(binary_nodes);
+    f(grouping_nodes);
+    f(literal_nodes);
+    f(logical_nodes);
+    f(unary_nodes);
+    f(call_nodes);
+    f(variable_nodes);
+    f(block_nodes);
+    f(expression_nodes);
+    f(print_nodes);
+    f(var_nodes);
+    f(if_nodes);
+    f(while_nodes);
+    f(function_nodes);
+    f(return_nodes);
+    f(class_nodes);
+    f(expr_lists);
+    f(stmt_lists);
+    f(token_lists);
+    f(upvalue_lists);
+    f(int_lists);
+    f(program);
+  }
+  size_t bytes() const {
+    size_t bytes = 0;
+    for_each_array([&](const auto &items) {
+      bytes += items.size() * sizeof(items[0]);
+    });
+    return bytes;
+  }
+  FlatAstView view() const {
+    FlatAstView view;
+    view.assign_nodes = assign_nodes;
+    view.binary_nodes = binary_nodes;
+    view.grouping_nodes = grouping_nodes;
+    view.literal_nodes = literal_nodes;
+    view.logical_nodes = logical_nodes;
+    view.unary_nodes = unary_nodes;
+    view.call_nodes = call_nodes;
+    view.variable_nodes = variable_nodes;
+    view.block_nodes = block_nodes;
+    view.expression_nodes = expression_nodes;
+    view.print_nodes = print_nodes;
+    view.var_nodes = var_nodes;
+    view.if_nodes = if_nodes;
+    view.while_nodes = while_nodes;
+    view.function_nodes = function_nodes;
+    view.return_nodes = return_nodes;
+    view.class_nodes = class_nodes;
+    view.expr_lists = expr_lists;
+    view.stmt_lists = stmt_lists;
+    view.token_lists = token_lists;
+    view.upvalue_lists = upvalue_lists;
+    view.int_lists = int_lists;
+    view.program = program;
+    return view;
+  }
+};
+
+// Sees every node flatten() and inflate() convert and translates the tokens
+// on the way, e.g. to store a flat AST in a file. This one changes nothing.
+struct FlatContext {
+  // cleared by inflate() when a ref or range points outside the arrays,
+  // which only a damaged file does
+  bool ok = true;
+  // inflate() gives up after this many nodes, so refs that form a loop end
+  size_t nodes_left = SIZE_MAX;
+  Token token(const Token &t) { return t; }
+  void flattened(const Expr *, ExprRef) {}
+  void inflated(ExprRef, const Expr *) {}
+  void flattened(const Stmt *, StmtRef) {}
+  void inflated(StmtRef, const Stmt *) {}
+};
+
+template <typename C>
+ExprRef flatten(FlatAst &ast, const Expr *node, C &context);
+template <typename C>
+Expr *inflate(const FlatAstView &ast, ExprRef ref, Arena &arena, C &context);
+template <typename C>
+StmtRef flatten(FlatAst &ast, const Stmt *node, C &context);
+template <typename C>
+Stmt *inflate(const FlatAstView &ast, StmtRef ref, Arena &arena, C &context);
+
+template <typename C>
+ExprRef flatten(FlatAst &ast, const Expr *node, C &context) {
+  if (node == nullptr) {
+    return {};
+  }
+  switch (node->kind) {
+  case Expr::Kind::Assign: {
+    auto n = static_cast<const Assign *>(node);
+    FlatAssign flat;
+    flat.offset = n->offset;
+    flat.name = context.token(n->name);
+    flat.value = flatten(ast, n->value, context);
+    flat.storage = n->storage;
+    flat.slot = n->slot;
+    ast.assign_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Assign, ast.assign_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Binary: {
+    auto n = static_cast<const Binary *>(node);
+    FlatBinary flat;
+    flat.offset = n->offset;
+    flat.left = flatten(ast, n->left, context);
+    flat.op = context.token(n->op);
+    flat.right = flatten(ast, n->right, context);
+    ast.binary_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Binary, ast.binary_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Grouping: {
+    auto n = static_cast<const Grouping *>(node);
+    FlatGrouping flat;
+    flat.offset = n->offset;
+    flat.expression = flatten(ast, n->expression, context);
+    ast.grouping_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Grouping, ast.grouping_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Literal: {
+    auto n = static_cast<const Literal *>(node);
+    FlatLiteral flat;
+    flat.offset = n->offset;
+    flat.value = context.token(n->value);
+    ast.literal_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Literal, ast.literal_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Logical: {
+    auto n = static_cast<const Logical *>(node);
+    FlatLogical flat;
+    flat.offset = n->offset;
+    flat.left = flatten(ast, n->left, context);
+    flat.op = context.token(n->op);
+    flat.right = flatten(ast, n->right, context);
+    ast.logical_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Logical, ast.logical_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Unary: {
+    auto n = static_cast<const Unary *>(node);
+    FlatUnary flat;
+    flat.offset = n->offset;
+    flat.op = context.token(n->op);
+    flat.right = flatten(ast, n->right, context);
+    ast.unary_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Unary, ast.unary_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Call: {
+    auto n = static_cast<const Call *>(node);
+    FlatCall flat;
+    flat.offset = n->offset;
+    flat.callee = flatten(ast, n->callee, context);
+    flat.paren = context.token(n->paren);
+    std::vector<ExprRef> arguments;
+    for (auto item : n->arguments) {
+      arguments.push_back(flatten(ast, item, context));
+    }
+    flat.arguments = flat_append(ast.expr_lists, arguments);
+    ast.call_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Call, ast.call_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Expr::Kind::Variable: {
+    auto n = static_cast<const Variable *>(node);
+    FlatVariable flat;
+    flat.offset = n->offset;
+    flat.name = context.token(n->name);
+    flat.storage = n->storage;
+    flat.slot = n->slot;
+    ast.variable_nodes.push_back(flat);
+    ExprRef ref(Expr::Kind::Variable, ast.variable_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  }
+  return {};
+}
+
+inline ExprRef flatten(FlatAst &ast, const Expr *node) {
+  FlatContext context;
+  return flatten(ast, node, context);
+}
+
+template <typename C>
+Expr *inflate(const FlatAstView &ast, ExprRef ref, Arena &arena, C &context) {
+  if (ref.is_null() || !context.ok) {
+    return nullptr;
+  }
+  if (context.nodes_left == 0) {
+    context.ok = false;
+    return nullptr;
+  }
+  context.nodes_left--;
+  switch (ref.kind()) {
+  case Expr::Kind::Assign: {
+    if (ref.index() >= ast.assign_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatAssign &flat = ast.assign_nodes[ref.index()];
+    auto n = arena.make<Assign>();
+    n->offset = flat.offset;
+    n->name = context.token(flat.name);
+    n->value = inflate(ast, flat.value, arena, context);
+    n->storage = flat.storage;
+    n->slot = flat.slot;
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Binary: {
+    if (ref.index() >= ast.binary_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatBinary &flat = ast.binary_nodes[ref.index()];
+    auto n = arena.make<Binary>();
+    n->offset = flat.offset;
+    n->left = inflate(ast, flat.left, arena, context);
+    n->op = context.token(flat.op);
+    n->right = inflate(ast, flat.right, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Grouping: {
+    if (ref.index() >= ast.grouping_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatGrouping &flat = ast.grouping_nodes[ref.index()];
+    auto n = arena.make<Grouping>();
+    n->offset = flat.offset;
+    n->expression = inflate(ast, flat.expression, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Literal: {
+    if (ref.index() >= ast.literal_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatLiteral &flat = ast.literal_nodes[ref.index()];
+    auto n = arena.make<Literal>();
+    n->offset = flat.offset;
+    n->value = context.token(flat.value);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Logical: {
+    if (ref.index() >= ast.logical_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatLogical &flat = ast.logical_nodes[ref.index()];
+    auto n = arena.make<Logical>();
+    n->offset = flat.offset;
+    n->left = inflate(ast, flat.left, arena, context);
+    n->op = context.token(flat.op);
+    n->right = inflate(ast, flat.right, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Unary: {
+    if (ref.index() >= ast.unary_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatUnary &flat = ast.unary_nodes[ref.index()];
+    auto n = arena.make<Unary>();
+    n->offset = flat.offset;
+    n->op = context.token(flat.op);
+    n->right = inflate(ast, flat.right, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Call: {
+    if (ref.index() >= ast.call_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatCall &flat = ast.call_nodes[ref.index()];
+    if (!flat.arguments.within(ast.expr_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    auto n = arena.make<Call>();
+    n->offset = flat.offset;
+    n->callee = inflate(ast, flat.callee, arena, context);
+    n->paren = context.token(flat.paren);
+    std::vector<Expr*> arguments;
+    for (uint32_t i = 0; i < flat.arguments.count; i++) {
+      auto item = ast.expr_lists[flat.arguments.first + i];
+      arguments.push_back(inflate(ast, item, arena, context));
+    }
+    n->arguments = arena.copy(arguments);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Expr::Kind::Variable: {
+    if (ref.index() >= ast.variable_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatVariable &flat = ast.variable_nodes[ref.index()];
+    auto n = arena.make<Variable>();
+    n->offset = flat.offset;
+    n->name = context.token(flat.name);
+    n->storage = flat.storage;
+    n->slot = flat.slot;
+    context.inflated(ref, n);
+    return n;
+  }
+  }
+  // a kind no node has
+  context.ok = false;
+  return nullptr;
+}
+
+inline Expr *inflate(const FlatAst &ast, ExprRef ref, Arena &arena) {
+  FlatContext context;
+  return inflate(ast.view(), ref, arena, context);
+}
+
+template <typename C>
+StmtRef flatten(FlatAst &ast, const Stmt *node, C &context) {
+  if (node == nullptr) {
+    return {};
+  }
+  switch (node->kind) {
+  case Stmt::Kind::Block: {
+    auto n = static_cast<const Block *>(node);
+    FlatBlock flat;
+    flat.offset = n->offset;
+    std::vector<StmtRef> statements;
+    for (auto item : n->statements) {
+      statements.push_back(flatten(ast, item, context));
+    }
+    flat.statements = flat_append(ast.stmt_lists, statements);
+    flat.frame_size = n->frame_size;
+    ast.block_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Block, ast.block_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Expression: {
+    auto n = static_cast<const Expression *>(node);
+    FlatExpression flat;
+    flat.offset = n->offset;
+    flat.expression = flatten(ast, n->expression, context);
+    ast.expression_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Expression, ast.expression_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Print: {
+    auto n = static_cast<const Print *>(node);
+    FlatPrint flat;
+    flat.offset = n->offset;
+    std::vector<ExprRef> expressions;
+    for (auto item : n->expressions) {
+      expressions.push_back(flatten(ast, item, context));
+    }
+    flat.expressions = flat_append(ast.expr_lists, expressions);
+    ast.print_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Print, ast.print_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Var: {
+    auto n = static_cast<const Var *>(node);
+    FlatVar flat;
+    flat.offset = n->offset;
+    flat.name = context.token(n->name);
+    flat.initializer = flatten(ast, n->initializer, context);
+    flat.storage = n->storage;
+    flat.slot = n->slot;
+    ast.var_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Var, ast.var_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::If: {
+    auto n = static_cast<const If *>(node);
+    FlatIf flat;
+    flat.offset = n->offset;
+    flat.condition = flatten(ast, n->condition, context);
+    flat.thenBranch = flatten(ast, n->thenBranch, context);
+    flat.elseBranch = flatten(ast, n->elseBranch, context);
+    ast.if_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::If, ast.if_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::While: {
+    auto n = static_cast<const While *>(node);
+    FlatWhile flat;
+    flat.offset = n->offset;
+    flat.condition = flatten(ast, n->condition, context);
+    flat.body = flatten(ast, n->body, context);
+    ast.while_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::While, ast.while_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Function: {
+    auto n = static_cast<const Function *>(node);
+    FlatFunction flat;
+    flat.offset = n->offset;
+    flat.name = context.token(n->name);
+    std::vector<Token> params;
+    for (auto item : n->params) {
+      params.push_back(context.token(item));
+    }
+    flat.params = flat_append(ast.token_lists, params);
+    std::vector<StmtRef> body;
+    for (auto item : n->body) {
+      body.push_back(flatten(ast, item, context));
+    }
+    flat.body = flat_append(ast.stmt_lists, body);
+    flat.brace = context.token(n->brace);
+    flat.lazy = n->lazy;
+    flat.storage = n->storage;
+    flat.slot = n->slot;
+    flat.frame_size = n->frame_size;
+    std::vector<Upvalue> upvalues;
+    for (auto item : n->upvalues) {
+      upvalues.push_back(item);
+    }
+    flat.upvalues = flat_append(ast.upvalue_lists, upvalues);
+    std::vector<int> cell_params;
+    for (auto item : n->cell_params) {
+      cell_params.push_back(item);
+    }
+    flat.cell_params = flat_append(ast.int_lists, cell_params);
+    ast.function_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Function, ast.function_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Return: {
+    auto n = static_cast<const Return *>(node);
+    FlatReturn flat;
+    flat.offset = n->offset;
+    flat.keyword = context.token(n->keyword);
+    flat.value = flatten(ast, n->value, context);
+    ast.return_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Return, ast.return_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  case Stmt::Kind::Class: {
+    auto n = static_cast<const Class *>(node);
+    FlatClass flat;
+    flat.offset = n->offset;
+    flat.name = context.token(n->name);
+    std::vector<StmtRef> methods;
+    for (auto item : n->methods) {
+      methods.push_back(flatten(ast, item, context));
+    }
+    flat.methods = flat_append(ast.stmt_lists, methods);
+    flat.storage = n->storage;
+    flat.slot = n->slot;
+    ast.class_nodes.push_back(flat);
+    StmtRef ref(Stmt::Kind::Class, ast.class_nodes.size() - 1);
+    context.flattened(n, ref);
+    return ref;
+  }
+  }
+  return {};
+}
+
+inline StmtRef flatten(FlatAst &ast, const Stmt *node) {
+  FlatContext context;
+  return flatten(ast, node, context);
+}
+
+template <typename C>
+Stmt *inflate(const FlatAstView &ast, StmtRef ref, Arena &arena, C &context) {
+  if (ref.is_null() || !context.ok) {
+    return nullptr;
+  }
+  if (context.nodes_left == 0) {
+    context.ok = false;
+    return nullptr;
+  }
+  context.nodes_left--;
+  switch (ref.kind()) {
+  case Stmt::Kind::Block: {
+    if (ref.index() >= ast.block_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatBlock &flat = ast.block_nodes[ref.index()];
+    if (!flat.statements.within(ast.stmt_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    auto n = arena.make<Block>();
+    n->offset = flat.offset;
+    std::vector<Stmt*> statements;
+    for (uint32_t i = 0; i < flat.statements.count; i++) {
+      auto item = ast.stmt_lists[flat.statements.first + i];
+      statements.push_back(inflate(ast, item, arena, context));
+    }
+    n->statements = arena.copy(statements);
+    n->frame_size = flat.frame_size;
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Expression: {
+    if (ref.index() >= ast.expression_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatExpression &flat = ast.expression_nodes[ref.index()];
+    auto n = arena.make<Expression>();
+    n->offset = flat.offset;
+    n->expression = inflate(ast, flat.expression, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Print: {
+    if (ref.index() >= ast.print_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatPrint &flat = ast.print_nodes[ref.index()];
+    if (!flat.expressions.within(ast.expr_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    auto n = arena.make<Print>();
+    n->offset = flat.offset;
+    std::vector<Expr*> expressions;
+    for (uint32_t i = 0; i < flat.expressions.count; i++) {
+      auto item = ast.expr_lists[flat.expressions.first + i];
+      expressions.push_back(inflate(ast, item, arena, context));
+    }
+    n->expressions = arena.copy(expressions);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Var: {
+    if (ref.index() >= ast.var_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatVar &flat = ast.var_nodes[ref.index()];
+    auto n = arena.make<Var>();
+    n->offset = flat.offset;
+    n->name = context.token(flat.name);
+    n->initializer = inflate(ast, flat.initializer, arena, context);
+    n->storage = flat.storage;
+    n->slot = flat.slot;
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::If: {
+    if (ref.index() >= ast.if_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatIf &flat = ast.if_nodes[ref.index()];
+    auto n = arena.make<If>();
+    n->offset = flat.offset;
+    n->condition = inflate(ast, flat.condition, arena, context);
+    n->thenBranch = inflate(ast, flat.thenBranch, arena, context);
+    n->elseBranch = inflate(ast, flat.elseBranch, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::While: {
+    if (ref.index() >= ast.while_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatWhile &flat = ast.while_nodes[ref.index()];
+    auto n = arena.make<While>();
+    n->offset = flat.offset;
+    n->condition = inflate(ast, flat.condition, arena, context);
+    n->body = inflate(ast, flat.body, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Function: {
+    if (ref.index() >= ast.function_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatFunction &flat = ast.function_nodes[ref.index()];
+    if (!flat.params.within(ast.token_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    if (!flat.body.within(ast.stmt_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    if (!flat.upvalues.within(ast.upvalue_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    if (!flat.cell_params.within(ast.int_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    auto n = arena.make<Function>();
+    n->offset = flat.offset;
+    n->name = context.token(flat.name);
+    std::vector<Token> params;
+    for (uint32_t i = 0; i < flat.params.count; i++) {
+      auto item = ast.token_lists[flat.params.first + i];
+      params.push_back(context.token(item));
+    }
+    n->params = arena.copy(params);
+    std::vector<Stmt*> body;
+    for (uint32_t i = 0; i < flat.body.count; i++) {
+      auto item = ast.stmt_lists[flat.body.first + i];
+      body.push_back(inflate(ast, item, arena, context));
+    }
+    n->body = arena.copy(body);
+    n->brace = context.token(flat.brace);
+    n->lazy = flat.lazy;
+    n->storage = flat.storage;
+    n->slot = flat.slot;
+    n->frame_size = flat.frame_size;
+    std::vector<Upvalue> upvalues;
+    for (uint32_t i = 0; i < flat.upvalues.count; i++) {
+      auto item = ast.upvalue_lists[flat.upvalues.first + i];
+      upvalues.push_back(item);
+    }
+    n->upvalues = arena.copy(upvalues);
+    std::vector<int> cell_params;
+    for (uint32_t i = 0; i < flat.cell_params.count; i++) {
+      auto item = ast.int_lists[flat.cell_params.first + i];
+      cell_params.push_back(item);
+    }
+    n->cell_params = arena.copy(cell_params);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Return: {
+    if (ref.index() >= ast.return_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatReturn &flat = ast.return_nodes[ref.index()];
+    auto n = arena.make<Return>();
+    n->offset = flat.offset;
+    n->keyword = context.token(flat.keyword);
+    n->value = inflate(ast, flat.value, arena, context);
+    context.inflated(ref, n);
+    return n;
+  }
+  case Stmt::Kind::Class: {
+    if (ref.index() >= ast.class_nodes.size()) {
+      context.ok = false;
+      return nullptr;
+    }
+    const FlatClass &flat = ast.class_nodes[ref.index()];
+    if (!flat.methods.within(ast.stmt_lists.size())) {
+      context.ok = false;
+      return nullptr;
+    }
+    auto n = arena.make<Class>();
+    n->offset = flat.offset;
+    n->name = context.token(flat.name);
+    std::vector<Stmt*> methods;
+    for (uint32_t i = 0; i < flat.methods.count; i++) {
+      auto item = ast.stmt_lists[flat.methods.first + i];
+      methods.push_back(inflate(ast, item, arena, context));
+    }
+    n->methods = arena.copy(methods);
+    n->storage = flat.storage;
+    n->slot = flat.slot;
+    context.inflated(ref, n);
+    return n;
+  }
+  }
+  // a kind no node has
+  context.ok = false;
+  return nullptr;
+}
+
+inline Stmt *inflate(const FlatAst &ast, StmtRef ref, Arena &arena) {
+  FlatContext context;
+  return inflate(ast.view(), ref, arena, context);
+}
+
+template <typename C>
+std::vector<Stmt *> inflate(const FlatAstView &ast, Arena &arena,
+                            C &context) {
+  std::vector<Stmt *> stmts;
+  for (auto ref : ast.program) {
+    stmts.push_back(inflate(ast, ref, arena, context));
+  }
+  return stmts;
+}
+
+inline std::vector<Stmt *> inflate(const FlatAst &ast, Arena &arena) {
+  FlatContext context;
+  return inflate(ast.view(), arena, context);
+}
@@ -0,0 +1,34 @@
+// A pass between the resolver and the evaluator that folds expressions on
+// constants into literals, e.g. `2 * 3 + 1` into `7` and `"a" + "b"` into
+// `"ab"`, and drops the branches of if and while statements that a constant
+// condition rules out. Folded literals keep the offset of the expression they
+// replace, so errors still point at the right line.
+#pragma once
+#include "arena.h"
+#include "ast.h"
+#include "eval.h"
+#include <vector>
+
+class ConstantFolder {
+  // nodes made by the pass are allocated here
+  Arena &arena_;
+  // computes folded values, so they come out exactly as at run time
+  Evaluator eval_;
+  size_t folded_ = 0;
+  Expr *fold_binary(Binary *b);
+  Expr *fold_unary(Unary *u);
+  // Folds every statement of stmts, returns a new span if any is dropped.
+  std::span<Stmt *> fold(std::span<Stmt *> stmts);
+  // Stands in for a dropped statement where one is required.
+  Stmt *empty_block();
+
+public:
+  explicit ConstantFolder(Arena &arena) : arena_(arena) {}
+  void fold(std::vector<Stmt *> &stmts);
+  // Returns the statement to run in place of s, nullptr if it does nothing.
+  Stmt *fold(Stmt *s);
+  // Returns the expression to evaluate in place of e.
+  Expr *fold(Expr *e);
+  // Number of expressions and statements replaced so far.
+  size_t folded() const { return folded_; }
+};
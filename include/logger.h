@@ -50,15 +50,18 @@ public:
     }
   }
 
+  // Check if the level is less than the level_ and if the category is the
+  // same as the category_ or if the category_ is ALL
+  // or if the level is ERROR
+  bool Enabled(LogLevel level, const char *category) const {
+    return level == LogLevel::ERROR ||
+           (level <= level_ && ((strcmp(category_, LogCategory::ALL) == 0) ||
+                                strcmp(category_, category) == 0));
+  }
+
   template <typename... Args>
   void Log(LogLevel level, const char *category, Args... args) {
-    // Check if the level is less than the level_ and if the category is the
-    // same as the category_ or if the category_ is ALL
-    // or if the level is ERROR
-    // then log the message
-    if (level == LogLevel::ERROR ||
-        (level <= level_ && ((strcmp(category_, LogCategory::ALL) == 0) ||
-                             strcmp(category_, category) == 0))) {
+    if (Enabled(level, category)) {
       out_ << "[" << std::string(category_) << "] ";
       LogImpl(args...);
     }
@@ -76,20 +79,31 @@ private:
 class CLog;
 // A simple singleton logger with cout as the output stream
 class CLog {
-  inline static Logger *instance;
   CLog() = delete;
+  // created on first use, which may happen on any thread
+  static Logger *get() {
+    static Logger *instance = new Logger(std::cout);
+    return instance;
+  }
 
 public:
+  // For messages that are expensive to put together, e.g. a dump of an
+  // environment, so they are only built when they will be logged.
+  static bool Enabled(LogLevel level, const char *category) {
+    return get()->Enabled(level, category);
+  }
+
   template <typename... Args>
   static void Log(LogLevel level, const char *category, Args... args) {
-    if (instance == nullptr) {
-      instance = new Logger(std::cout);
-    }
-    instance->Log(level, category, args...);
+    get()->Log(level, category, args...);
   }
 
   static void FLog(LogLevel level, const char *category, const char *fmt, ...)
       __attribute__((format(printf, 3, 4))) {
+    // the evaluator logs on every variable access, skip the formatting
+    if (!Enabled(level, category)) {
+      return;
+    }
     va_list args;
     int size = 2048;
     char line[size];
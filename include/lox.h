@@ -8,12 +8,40 @@
 class Lox {
 public:
   bool had_error_ = false;
+  // threads used to lex and parse script files, see Scanner::scan(unsigned)
+  // and Parser::parse_stmts(unsigned)
+  unsigned threads_ = 1;
+  // parse the bodies of top level functions on their first call
+  bool lazy_functions_ = false;
+  // keep resolved script files in .loxc files, see program_cache.h
+  bool cache_programs_ = false;
   Evaluator eval_;
 
+  Lox();
   void error(const std::string &message, int line_no);
   void report(const std::string &message, const std::string &where,
               int line_no);
   void run(const std::string &lox_code);
+  void run(Scanner &scanner);
+  // Parses what scanner lexes into nodes owned by arena. Returns no
+  // statements if the source has errors.
+  std::vector<Stmt *> parse(Scanner &scanner, std::unique_ptr<Arena> &arena);
+  // Resolves stmts, whose nodes live in arena, which also gets the lists the
+  // Resolver makes for them.
+  bool resolve(const std::vector<Stmt *> &stmts, Arena &arena);
+  // Runs a program parsed into the flat layout, see Parser::parse_flat.
+  void run(const FlatAst &ast);
+  // Resolves, folds and evaluates stmts, whose nodes live in arena and whose
+  // tokens point into source, if it is given.
+  void execute(std::vector<Stmt *> stmts, std::unique_ptr<Arena> arena,
+               std::optional<uint32_t> source = std::nullopt);
+  // Completes a function parsed with lazy_functions_.
+  bool load_body(const Function *f);
+  // Reads and runs lines from stdin. The nodes and sources of lines are
+  // freed once no function refers to them, so memory use stays flat.
   void run_prompt();
   void run_file(const std::string &file_path);
+  // Runs the script at file_path, which is registered at base, from its
+  // .loxc file, or parses it and writes that file.
+  void run_cached(const std::string &file_path, uint32_t base);
 };
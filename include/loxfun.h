@@ -5,14 +5,16 @@
 class LoxFunction : public Callable {
 public:
   const Function *f;
-  // TODO(kartikarcot) create a copy of the environment where it was created
-  std::shared_ptr<Environment> closure;
+  // the cells of the variables of enclosing functions f uses, in the order
+  // of f->upvalues
+  Upvalues upvalues;
   std::string name = "LoxFunction";
-  LoxFunction(const Function *f, std::shared_ptr<Environment> closure);
+  LoxFunction(const Function *f, Upvalues upvalues);
   LoxFunction(const LoxFunction &f) = default;
-  virtual Object call(std::vector<Object> args, Evaluator *eval) override;
+  virtual Object call(std::span<Object> args, Evaluator *eval) override;
   virtual int arity() override;
-  std::string to_string() { return "<fn " + f->name->literal_string + ">"; }
+  std::string to_string() { return "<fn " + name + ">"; }
   virtual Callable *Clone() override { return new LoxFunction(*this); }
+  virtual LoxFunction *lox_function() override { return this; }
   ~LoxFunction();
 };
@@ -0,0 +1,29 @@
+// Read only access to the whole contents of a file. Regular files are memory
+// mapped, anything that cannot be mapped (pipes, stdin, empty files) is read
+// into a heap buffer instead. Either way the contents are followed by a '\0'
+// byte, which the scanner relies on.
+#pragma once
+#include <string>
+
+class MappedFile {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  // the mapping, if the file was mapped
+  void *map_ = nullptr;
+  size_t map_size_ = 0;
+  // the contents, if the file was read
+  std::string buffer_;
+  bool map(int fd, size_t size);
+  bool read_all(int fd);
+
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  // Opens path, or stdin if path is "-". Returns false if it can't be read.
+  bool open(const std::string &path);
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool is_mapped() const { return map_ != nullptr; }
+  ~MappedFile();
+};
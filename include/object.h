@@ -1,6 +1,7 @@
 #pragma once
 #include "parser.h"
 #include <cstring>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -10,13 +11,19 @@ class Evaluator;
 
 class Object;
 
+class LoxFunction;
+
 class Callable {
 public:
   std::string name = "Callable";
   virtual int arity() = 0;
-  virtual Object call(std::vector<Object> args, Evaluator *env) = 0;
+  // args are only valid until the callable evaluates code itself.
+  virtual Object call(std::span<Object> args, Evaluator *env) = 0;
   virtual ~Callable(){};
   virtual Callable *Clone() = 0;
+  // The function when it is written in Lox, nullptr for natives. Works
+  // without RTTI.
+  virtual LoxFunction *lox_function() { return nullptr; }
 };
 
 struct Object {
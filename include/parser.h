@@ -1,48 +1,109 @@
 #pragma once
 
+#include <span>
 #include <vector>
 
+#include "arena.h"
 #include "ast.h"
+#include "flat_ast.h"
+#include "scanner.h"
 #include "token.h"
+#include <array>
+#include <initializer_list>
+#include <memory>
+
+// Binding power of an operator, an operator only takes operands that bind
+// tighter than itself.
+enum class Precedence : uint8_t {
+  NONE,
+  ASSIGNMENT, // =
+  LOGIC_OR,   // or
+  LOGIC_AND,  // and
+  EQUALITY,   // == !=
+  COMPARISON, // < > <= >=
+  TERM,       // + -
+  FACTOR,     // * /
+  UNARY,      // ! -
+  CALL,       // ()
+};
 
 class Parser {
-  std::vector<Token> tokens_;
-  std::shared_ptr<Expr> expression();
-  std::shared_ptr<Expr> assignment();
-  std::shared_ptr<Expr> equality();
-  std::shared_ptr<Expr> comparison();
-  std::shared_ptr<Expr> unary();
-  std::shared_ptr<Expr> factor();
-  std::shared_ptr<Expr> term();
-  std::shared_ptr<Expr> primary();
-  std::shared_ptr<Expr> logic_or();
-  std::shared_ptr<Expr> logic_and();
-  std::shared_ptr<Expr> call();
-  bool match(std::vector<TokenType> options);
+  std::span<const Token> tokens_;
+  // When parsing from a scanner, tokens are pulled on demand into a small
+  // ring buffer instead of being read from tokens_.
+  static constexpr int kWindow = 4;
+  Scanner *scanner_ = nullptr;
+  std::array<Token, kWindow> window_;
+  int pulled_ = 0;
+  // every node the parser creates is allocated here
+  std::unique_ptr<Arena> arena_ = std::make_unique<Arena>();
+  const Token &token_at(int i);
+  Expr *expression();
+  // Parses an expression whose operators bind at least as tight as min.
+  Expr *parse_precedence(Precedence min);
+  // Unary operators, groupings, variables and literals.
+  Expr *prefix();
+  bool match(std::initializer_list<TokenType> options);
   bool peek(Token &t);
   bool advance(Token &t);
   bool previous(Token &t);
   Token consume(TokenType type, std::string message);
   bool is_at_end();
   int current_ = -1;
+  // nesting of the block being parsed, 0 at the top level
+  int depth_ = 0;
+  bool lazy_functions_ = false;
+  // parsers of the chunks of a parallel parse stay quiet, errors are
+  // reported by the serial parse it falls back to
+  bool report_errors_ = true;
   const int kMaxArgs = 255;
+  // Takes the place of ::report in the parser, see report_errors_. Errors
+  // carry the offset of the token, its line is only looked up when reported.
+  void report(const std::string &message, const std::string &where,
+              uint32_t offset);
+  // Token indices at which a top level fun, class or var declaration starts,
+  // found by counting braces and parentheses only.
+  std::vector<size_t> find_declarations() const;
   void synchronize();
-  int get_current_line();
+  uint32_t get_current_offset();
 
 public:
-  void init(const std::vector<Token> &tokens);
-  std::shared_ptr<Expr> parse();
-  std::vector<std::shared_ptr<Stmt>> parse_stmts();
-  std::shared_ptr<Stmt> parse_declaration();
-  std::shared_ptr<Stmt> parse_var_declaration();
-  std::shared_ptr<Stmt> parse_statement();
-  std::shared_ptr<Stmt> parse_if();
-  std::shared_ptr<Stmt> parse_while();
-  std::shared_ptr<Stmt> parse_expression_statement();
-  std::shared_ptr<Stmt> parse_for();
-  std::shared_ptr<Stmt> parse_function();
-  std::shared_ptr<Stmt> parse_return();
-  std::shared_ptr<Stmt> parse_class();
-  std::shared_ptr<Expr> finish_call(std::shared_ptr<Expr> expr);
-  bool parse_block(std::vector<std::shared_ptr<Stmt>> &statements);
+  // The parser reads the tokens in place, they must outlive it.
+  void init(std::span<const Token> tokens);
+  // Parses tokens as the scanner produces them, so only a few tokens are
+  // held in memory at any time. The scanner must outlive the parser.
+  void init(Scanner &scanner);
+  // Hands over the arena holding the trees parsed so far, which stay valid
+  // for as long as the arena lives. The parser starts a new arena.
+  std::unique_ptr<Arena> take_arena();
+  // With lazy functions, the bodies of top level functions are only brace
+  // matched. They have Function::lazy set and must be completed with
+  // parse_lazy_body before they are resolved or run.
+  void set_lazy_functions(bool lazy) { lazy_functions_ = lazy; }
+  // Parses the body of f, starting at f->brace, into this
+  // parser's arena.
+  bool parse_lazy_body(Function *f);
+  Expr *parse();
+  std::vector<Stmt *> parse_stmts();
+  // Same as parse_stmts(), but splits the tokens into chunks at top level
+  // declarations and parses them on up to `threads` threads. The statements
+  // come back in source order and are the ones parse_stmts() makes. Only
+  // for parsers initialized with tokens.
+  std::vector<Stmt *> parse_stmts(unsigned threads);
+  // Parses straight into the flat layout. Each top level declaration is
+  // flattened as soon as it is parsed and its nodes are dropped, so no more
+  // than one declaration is held as pointer nodes at a time.
+  bool parse_flat(FlatAst &ast);
+  Stmt *parse_declaration();
+  Stmt *parse_var_declaration();
+  Stmt *parse_statement();
+  Stmt *parse_if();
+  Stmt *parse_while();
+  Stmt *parse_expression_statement();
+  Stmt *parse_for();
+  Stmt *parse_function(bool lazy = false);
+  Stmt *parse_return();
+  Stmt *parse_class();
+  Expr *finish_call(Expr *expr);
+  bool parse_block(std::vector<Stmt *> &statements);
 };
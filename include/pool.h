@@ -0,0 +1,97 @@
+// A free-list allocator for the small objects the Evaluator makes and drops
+// over and over, like the cells of captured locals and the upvalues of
+// closures. A freed block goes on the free list for its size and is handed
+// out again before a new slab is carved up, so a program that has reached
+// its working set no longer calls into the system allocator. Not thread
+// safe, every Evaluator has its own.
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+class Pool {
+public:
+  // What the pool has done so far, e.g. to see how much it saves.
+  struct Stats {
+    // blocks handed out, and how many of them came off a free list
+    size_t allocations = 0;
+    size_t reused = 0;
+    size_t frees = 0;
+    // slabs taken from the system allocator, and requests too large for the
+    // pool, which it passes on to the system allocator
+    size_t slabs = 0;
+    size_t large = 0;
+  };
+  // block sizes are rounded up to a multiple of kGrain, the blocks of up to
+  // kMaxSize bytes are pooled
+  static constexpr size_t kGrain = 16;
+  static constexpr size_t kMaxSize = 256;
+  static constexpr size_t kSlabSize = 64 * 1024;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+  FreeBlock *free_[kMaxSize / kGrain] = {};
+  std::vector<std::unique_ptr<char[]>> slabs_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+  Stats stats_;
+  void *allocate_slow(size_t size_class);
+  static size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / kGrain;
+  }
+
+public:
+  Pool() = default;
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  void *allocate(size_t size) {
+    stats_.allocations++;
+    if (size > kMaxSize) {
+      stats_.large++;
+      return ::operator new(size);
+    }
+    size_t c = size_class(size);
+    if (FreeBlock *block = free_[c]) {
+      free_[c] = block->next;
+      stats_.reused++;
+      return block;
+    }
+    return allocate_slow(c);
+  }
+
+  // size must be the size p was allocated with.
+  void deallocate(void *p, size_t size) {
+    stats_.frees++;
+    if (size > kMaxSize) {
+      ::operator delete(p);
+      return;
+    }
+    size_t c = size_class(size);
+    auto block = static_cast<FreeBlock *>(p);
+    block->next = free_[c];
+    free_[c] = block;
+  }
+
+  const Stats &stats() const { return stats_; }
+};
+
+// Lets containers and std::allocate_shared take their memory from a Pool,
+// which has to outlive them.
+template <typename T> struct PoolAllocator {
+  using value_type = T;
+  Pool *pool;
+  PoolAllocator(Pool *pool) : pool(pool) {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &other) : pool(other.pool) {}
+  T *allocate(size_t n) {
+    return static_cast<T *>(pool->allocate(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) { pool->deallocate(p, n * sizeof(T)); }
+  template <typename U> bool operator==(const PoolAllocator<U> &other) const {
+    return pool == other.pool;
+  }
+};
@@ -0,0 +1,29 @@
+// Resolved programs stored on disk, so running a script that has not changed
+// skips lexing, parsing and resolving. A .loxc file holds the flat AST of the
+// program (see flat_ast.h), which carries the variable slots the resolver
+// found, keyed by a hash of the source. Every array is stored as its raw
+// bytes at an 8 byte aligned offset, so loading maps the file and inflates
+// the nodes straight out of the mapping into an arena.
+#pragma once
+#include "arena.h"
+#include "ast.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// FNV-1a of the source text.
+uint64_t hash_source(std::string_view source);
+// $LOX_CACHE_DIR/<hash>.loxc if LOX_CACHE_DIR is set, otherwise the script
+// path with a 'c' appended, e.g. fib.lox -> fib.loxc.
+std::string cache_path(const std::string &script, uint64_t hash);
+// Writes stmts, parsed from the source buffer at base and resolved, to path.
+// The file is written next to path and renamed into place, so readers never
+// see half of it.
+bool save_program(const std::string &path, uint64_t hash, uint32_t base,
+                  const std::vector<Stmt *> &stmts);
+// Reads the program saved for the source buffer at base into arena and
+// stmts, ready to evaluate. Returns false if there is no cache file, it was
+// saved for another source or by another build, or it is damaged.
+bool load_program(const std::string &path, uint64_t hash, uint32_t base,
+                  Arena &arena, std::vector<Stmt *> &stmts);
@@ -2,6 +2,7 @@
 #pragma once
 #include "ast.h"
 #include "eval.h"
+#include <memory>
 
 class Resolver {
 public:
@@ -9,15 +10,49 @@ public:
     NONE,
     FUNCTION
   } current_function_type = FunctionType::NONE;
-  std::vector<std::unordered_map<std::string, bool>> scopes;
+  // A name declared in a scope: whether it is defined yet, its slot in the
+  // frame of its function and whether a closure captures it.
+  struct Local {
+    bool defined = false;
+    bool captured = false;
+    int slot = 0;
+    // The storage of the nodes that declare the name and use it from its own
+    // function. They are kStack until a closure captures the name, then
+    // end_scope makes them kCell.
+    std::vector<int *> storage;
+  };
+  struct Scope {
+    // the names declared in the scope, by symbol
+    std::unordered_map<Symbol, Local> names;
+  };
+  std::vector<Scope> scopes;
+  // A function being resolved. The top level code is the one at the bottom.
+  struct FunctionScope {
+    // the first of the scopes that are the function's
+    size_t first_scope = 0;
+    // the frame slots of the function: the next free one and the most that
+    // were in use at once
+    int frame_top = 0;
+    int frame_size = 0;
+    // the variables of enclosing functions it captures
+    std::vector<Upvalue> upvalues;
+  };
+  std::vector<FunctionScope> functions_ = {FunctionScope{}};
+  // Where the upvalue lists of the resolved functions go, usually the arena
+  // of the nodes. Without one the Resolver makes its own, which the
+  // Evaluator keeps alive once the Resolver is done.
+  Arena *arena_ = nullptr;
+  std::unique_ptr<Arena> own_arena_;
   Evaluator *eval;
   bool had_error_ = false;
-  Resolver(Evaluator *eval) : eval(eval){};
+  Resolver(Evaluator *eval, Arena *arena = nullptr)
+      : arena_(arena), eval(eval){};
+  ~Resolver();
   void visit(const Stmt *stmt);
   void visit(const Expr *expr);
-  void visit_var_stmt(const Var *var);
-  void visit_var_expr(const Variable *var_expr);
-  void visit_expr_stmt(const Expression *expr_stmt);
+  void visit_var(const Var *var);
+  void visit_variable(const Variable *var_expr);
+  void visit_expression(const Expression *expr_stmt);
   void visit_assign(const Assign *assign);
   void visit_binary(const Binary *b);
   void visit_call(const Call *c);
@@ -35,12 +70,22 @@ public:
   void visit_while(const While *wh);
   void begin_scope();
   void end_scope();
-  bool resolve(std::vector<std::shared_ptr<Stmt>> stmts);
+  bool resolve(std::span<Stmt *const> stmts);
   void resolve(const Stmt *stmt);
-  void resolve_local(const Expr *e, const std::string &name);
+  // Records where name is declared, as seen from the function being
+  // resolved, in the storage and slot of the node that uses it.
+  void resolve_local(const Token &name, int *storage, int *slot);
+  // Returns the upvalue of functions_[function] that captures `slot` of the
+  // frame of functions_[owner], adding it and the upvalues it is captured
+  // through to the functions in between.
+  int add_upvalue(size_t function, size_t owner, int slot);
+  // Copies items into arena_, making one if there is none.
+  template <typename T> std::span<T> keep(const std::vector<T> &items);
   void resolve(const Expr *expr);
-  void resolve(const Expr *expr, int depth);
   void resolve_function(const Function *f, FunctionType type);
-  void declare(const Token *name);
+  // Declares name in the innermost scope, in the next slot of the frame, and
+  // records where on the declaring node if there is one. Names at the top
+  // level are globals.
+  void declare(const Token *name, int *storage = nullptr, int *slot = nullptr);
   void define(const Token *name);
 };
@@ -1,17 +1,80 @@
 #pragma once
 
 #include "token.h"
+#include <span>
 #include <vector>
 
 class Scanner {
-  std::string source_;
+public:
+  // REGEX is the original longest-match over the token regex table. DFA is a
+  // hand written single pass lexer that produces the same token stream. The
+  // regex path is kept around so that the two can be diffed against each
+  // other.
+  enum class Mode { REGEX, DFA };
+
+  // Replaces `removed` bytes at `offset` of the source with `inserted`.
+  struct Edit {
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+  };
+
+private:
+  // the source is owned by the SourceManager, base_ is its offset there
+  const char *source_ = nullptr;
+  size_t size_ = 0;
+  uint32_t base_ = 0;
   std::vector<Token> tokens_;
+  Mode mode_ = Mode::DFA;
   void chew_through_whitespace(size_t &idx);
-  bool parse_token(size_t &idx);
-  int current_line_ = 0;
+  bool parse_token(size_t &idx, Token &t);
+  bool parse_token_dfa(size_t &idx, Token &t);
+  void make_token(TokenType type, size_t idx, size_t len, Token &t);
+  // position of the next character to lex
+  size_t idx_ = 0;
+  bool had_error_ = false;
+  // chunk scanners used by the parallel scan stay quiet, errors are reported
+  // by the serial scan it falls back to
+  bool report_errors_ = true;
+  // and leave the symbols of IDENTIFIERs to the merge, the SymbolTable is
+  // not synchronized
+  bool intern_symbols_ = true;
+  size_t find_split(size_t from) const;
+  // tokens lexed by the last relex
+  size_t relexed_ = 0;
 
 public:
-  void init(const std::string &source);
+  void init(const std::string &source, Mode mode = Mode::DFA);
+  // Scans a buffer that is already registered with the SourceManager.
+  void init(uint32_t base, Mode mode = Mode::DFA);
+  // Continues lexing at offset, which must be the start of a token in the
+  // buffer passed to init, e.g. to lex part of a source again.
+  void seek(uint32_t offset);
+  // Lexes the whole source into the token vector returned by get_tokens.
   bool scan();
-  std::vector<Token> get_tokens() { return tokens_; }
+  // Same as scan(), but splits a large source into chunks at newlines that
+  // are not inside a STRING literal and lexes them on up to `threads`
+  // threads. The token stream is identical to the one scan() produces.
+  bool scan(unsigned threads);
+  // Applies edit to a source that has been scanned and updates the tokens.
+  // Only the tokens from just before the edit up to the first one that lines
+  // up with an old token again are lexed, the rest are the old tokens moved
+  // by the length difference. The old buffer is released and the edited
+  // source registered in its place, so tokens of the old source must not be
+  // used afterwards. Returns false if the edited source could not be lexed,
+  // or without touching the source if the edit does not lie within it.
+  bool relex(const Edit &edit);
+  // Number of tokens the last relex had to lex.
+  size_t relexed_tokens() const { return relexed_; }
+  // Lexes and returns just the next token, for consumers that pull tokens one
+  // at a time instead of materializing all of them. Once the source is
+  // exhausted it keeps returning END_OF_FILE. Returns false if the source
+  // could not be lexed.
+  bool next_token(Token &t);
+  bool had_error() const { return had_error_; }
+  // The tokens stay owned by the scanner, which must outlive any parser
+  // reading them.
+  std::span<const Token> get_tokens() const { return tokens_; }
+  // Offset of the scanned source in the SourceManager.
+  uint32_t get_source_base() const { return base_; }
 };
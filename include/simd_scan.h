@@ -0,0 +1,33 @@
+// Vectorized helpers for the scanner's hot loops. Each routine has an AVX2, an
+// SSE2 and a scalar implementation; the widest one the CPU supports is picked
+// once at runtime.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Returns the number of leading whitespace characters (as classified by
+// std::isspace in the "C" locale) in [p, p + n).
+size_t skip_whitespace(const char *p, size_t n);
+
+// Appends the offset of every '\n' in [p, p + n) to newlines, adding base to
+// each. Used to build the line index of a source.
+void find_newlines(const char *p, size_t n, uint32_t base,
+                   std::vector<uint32_t> &newlines);
+
+// Returns the offset of the first byte that ends a // comment, i.e. one of
+// '\n', '(', ')' or '\0', or n if there is none.
+size_t find_comment_end(const char *p, size_t n);
+
+// Returns the offset of the first byte that ends the body of a STRING
+// literal, i.e. one of '"', '(', ')' or '\0', or n if there is none.
+size_t find_string_end(const char *p, size_t n);
+
+// Name of the implementation picked for this CPU: "avx2", "sse2" or "scalar".
+const char *simd_scan_impl();
+
+// Makes the routines above use the named implementation, so each one can be
+// tested on a CPU that would pick another. Returns false if this build or CPU
+// cannot run it. Not thread safe, call it before scanning starts.
+bool set_simd_scan_impl(std::string_view name);
@@ -0,0 +1,70 @@
+// A process wide registry of source text. Every buffer the interpreter lexes
+// is given a range in one 32 bit offset space, so a Token can refer to its
+// lexeme with just an offset and a length, and the text is only stored once.
+// Registration is not synchronized: sources must not be added or released
+// while other threads look up text.
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SourceManager {
+  struct Buffer {
+    uint32_t base;
+    uint32_t size;
+    const char *data;
+    // whatever owns the memory behind data
+    std::shared_ptr<const void> owner;
+    // offsets of the newlines in the buffer, built on first use
+    mutable std::vector<uint32_t> newlines;
+    mutable bool indexed = false;
+  };
+  // sorted by base, buffers are appended and erased when released
+  std::vector<Buffer> buffers_;
+  std::unordered_map<std::string, uint32_t> interned_;
+  uint32_t next_base_ = 0;
+  uint32_t reserve(size_t size);
+  const Buffer *find(uint32_t offset) const;
+
+public:
+  // Both counted from 0.
+  struct Position {
+    int line;
+    int column;
+  };
+
+  static SourceManager &get();
+
+  // Takes ownership of contents and returns the offset of its first byte.
+  // The buffer is always followed by a '\0' that the scanner may read.
+  uint32_t add(std::string contents);
+  // Registers memory owned by someone else, e.g. a mapped file. The memory
+  // must be followed by a readable '\0' and is kept alive by holding on to
+  // owner; with a null owner the caller must keep it alive for as long as
+  // tokens refer to it.
+  uint32_t add_view(const char *data, size_t size,
+                    std::shared_ptr<const void> owner = nullptr);
+  // The whole buffer starting at base.
+  std::string_view buffer(uint32_t base) const;
+  // Base of the buffer holding offset.
+  uint32_t base_of(uint32_t offset) const;
+  // Returns the offset of a buffer holding exactly text, adding it the first
+  // time a given text is seen. Used for tokens that are not lexed from a
+  // source, e.g. the ones synthesized by the parser.
+  uint32_t intern(std::string_view text);
+  // Frees the buffer starting at base. Tokens that point into it must not be
+  // used afterwards, their text is empty. The offsets of the buffer are
+  // handed out again once no buffer after it is registered.
+  void release(uint32_t base);
+
+  // Pointer to the byte at offset.
+  const char *data(uint32_t offset) const;
+  std::string_view text(uint32_t offset, uint32_t length) const;
+  // Line and column of the byte at offset. Only errors and logs need these,
+  // so the newline index of a buffer is built the first time it is asked
+  // for a position.
+  Position position(uint32_t offset) const;
+};
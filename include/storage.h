@@ -0,0 +1,23 @@
+#pragma once
+
+// Where a variable lives at runtime, as the Resolver records it on the nodes
+// that declare and use the variable, along with a slot.
+// Globals are looked up by name in the globals Environment.
+constexpr int kGlobal = 0;
+// A local no closure captures, at `slot` of the current frame of the
+// Evaluator's value stack.
+constexpr int kStack = 1;
+// A local some closure captures. It is a cell shared with the closures, kept
+// at `slot` of the current frame of the Evaluator's cell stack.
+constexpr int kCell = 2;
+// A variable of an enclosing function, in the cell at `slot` of the upvalues
+// of the closure being run.
+constexpr int kUpvalue = 3;
+
+// A variable a closure captures when it is created: the cell at `index` of
+// the frame it is created in if `local`, or else the cell at `index` of the
+// upvalues of the closure that creates it.
+struct Upvalue {
+  bool local = false;
+  int index = 0;
+};
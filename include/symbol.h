@@ -0,0 +1,30 @@
+// A process wide table of identifiers. Every distinct identifier gets a
+// small dense id the first time it is lexed, so scopes and environments key
+// on an integer instead of hashing and comparing the name on every lookup.
+// Ids are never reused. Like the SourceManager the table is not
+// synchronized, the parallel scan interns on one thread.
+#pragma once
+#include "utils.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Symbol = uint32_t;
+
+class SymbolTable {
+  StringMap<Symbol> ids_;
+  // the keys of ids_, which stay put as the map grows
+  std::vector<const std::string *> names_;
+
+public:
+  static constexpr Symbol kNone = UINT32_MAX;
+
+  static SymbolTable &get();
+  // The id of name, adding it the first time it is seen.
+  Symbol intern(std::string_view name);
+  // The id of name, or kNone if it was never interned.
+  Symbol find(std::string_view name) const;
+  std::string_view name(Symbol id) const { return *names_[id]; }
+  size_t size() const { return names_.size(); }
+};
@@ -1,9 +1,11 @@
 #pragma once
-#include <regex>
+#include "symbol.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
-enum TokenType {
+enum TokenType : uint8_t {
   // punctuation
   LEFT_PAREN,  // (
   RIGHT_PAREN, // )
@@ -54,67 +56,43 @@ enum TokenType {
   END_OF_FILE
 };
 
+// A token is a view of its lexeme in the SourceManager plus the parsed value
+// of NUMBER literals or the symbol of IDENTIFIERs. It owns no memory, so it
+// is cheap to copy around. The line of a token is looked up from its offset
+// when it is needed.
 struct Token {
-  TokenType token_type_;
-  std::string literal_string;
-  void *literal = nullptr;
-  int line_no;
-  void release_data() {
-    if (literal != nullptr) {
-      switch (token_type_) {
-      case NUMBER:
-        delete (float *)literal;
-        break;
-      case FALSE:
-        delete (bool *)literal;
-        break;
-      case TRUE:
-        delete (bool *)literal;
-      default:
-        break;
-      }
-    }
-    literal = nullptr;
-  }
-
-  void copy_data(const Token &t) {
-    this->literal_string = t.literal_string;
-    this->token_type_ = t.token_type_;
-    this->line_no = t.line_no;
-    if (t.literal != nullptr) {
-      switch (t.token_type_) {
-      case NUMBER:
-        this->literal = new float(*(float *)t.literal);
-        break;
-      case FALSE:
-        this->literal = new bool(*(bool *)t.literal);
-        break;
-      case TRUE:
-        this->literal = new bool(*(bool *)t.literal);
-        break;
-      case STRING:
-        this->literal = (void *)this->literal_string.c_str();
-      default:
-        break;
-      }
-    }
-  }
-
-  ~Token() { release_data(); }
-
-  // assignment operator
-  Token &operator=(const Token &t) {
-    this->release_data();
-    this->copy_data(t);
-    return *this;
-  }
+  // location of the lexeme in the SourceManager offset space. For STRING
+  // tokens it covers the text between the quotes.
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  union {
+    // value of a NUMBER token
+    float number = 0;
+    // id of an IDENTIFIER in the SymbolTable, set by the scanner
+    Symbol symbol;
+  };
+  TokenType token_type_ = END_OF_FILE;
 
   Token(){};
 
-  Token(TokenType t, std::string l, void *v, int line_no)
-      : token_type_(t), literal_string(l), literal(v), line_no(line_no){};
+  Token(TokenType t, uint32_t offset, uint32_t length)
+      : offset(offset), length(length), token_type_(t){};
+
+  // A token whose lexeme is not part of a scanned source, the text is
+  // interned in the SourceManager and IDENTIFIERs in the SymbolTable.
+  Token(TokenType t, std::string_view text);
 
-  Token(const Token &t) { this->copy_data(t); }
+  std::string_view lexeme() const;
+  // 0 based line of the token in its source.
+  int line() const;
 };
 
+static_assert(sizeof(Token) <= 16, "Token should stay compact");
+
 std::string token_type_to_str(TokenType t);
+
+// Parses the value of a NUMBER lexeme.
+float parse_number(std::string_view text);
+
+// Returns the reserved word type for word, or IDENTIFIER if it is not one.
+TokenType keyword_type(std::string_view word);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 std::string read_file_into_string(const std::string &file_path);
@@ -11,3 +13,16 @@ std::vector<std::string> split(const std::string &s,
 void ltrim(std::string &s);
 void rtrim(std::string &s);
 void trim(std::string &s);
+
+// Hash for string keyed maps that can be probed with a std::string_view
+// without materializing a std::string.
+struct StringHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+template <typename V>
+using StringMap =
+    std::unordered_map<std::string, V, StringHash, std::equal_to<>>;
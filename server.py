@@ -7,6 +7,11 @@ from flask import Flask, render_template, request
 
 app = Flask(__name__)
 
+# resolved programs are cached by content hash, so code that is submitted
+# again is not parsed again. The hash is not a secret, so the cache lives in
+# a directory only this server can write to (mkdtemp makes it 0700).
+CACHE_DIR = os.environ.get("LOX_CACHE_DIR") or tempfile.mkdtemp(prefix="loxc-")
+
 # route to index.html file
 @app.route("/")
 def home():
@@ -37,7 +42,10 @@ def run_python():
             # run the binary on the file
             # the output will be a byte string
             # we will decode it to a string
-            output = subprocess.check_output(["./src/cpplox", f.name])
+            output = subprocess.check_output(
+                ["./src/cpplox", "--cache", f.name],
+                env=dict(os.environ, LOX_CACHE_DIR=CACHE_DIR),
+            )
             output = output.decode("utf-8")
             # delete the file
             os.remove(f.name)
@@ -0,0 +1,43 @@
+#include "arena.h"
+#include <algorithm>
+#include <iterator>
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+  // blocks double up to 64 KiB, larger requests get a block of their own
+  size_t block_size = std::max(next_block_size_, size + align);
+  next_block_size_ = std::min<size_t>(next_block_size_ * 2, 64 * 1024);
+  blocks_.push_back(
+      {std::unique_ptr<char[]>(new char[block_size]), block_size});
+  cur_ = blocks_.back().data.get();
+  end_ = cur_ + block_size;
+  return allocate(size, align);
+}
+
+void Arena::merge(Arena &other) {
+  // in front of the current block, which is still being bumped into
+  blocks_.insert(blocks_.begin(), std::make_move_iterator(other.blocks_.begin()),
+                 std::make_move_iterator(other.blocks_.end()));
+  bytes_allocated_ += other.bytes_allocated_;
+  other.blocks_.clear();
+  other.cur_ = other.end_ = nullptr;
+  other.bytes_allocated_ = 0;
+}
+
+bool Arena::contains(const void *p) const {
+  auto c = static_cast<const char *>(p);
+  for (const auto &block : blocks_) {
+    if (block.data.get() <= c && c < block.data.get() + block.size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Arena::reset() {
+  if (blocks_.empty()) {
+    return;
+  }
+  blocks_.erase(blocks_.begin(), blocks_.end() - 1);
+  cur_ = blocks_.back().data.get();
+  bytes_allocated_ = 0;
+}
@@ -7,13 +7,18 @@ Environment::~Environment() {
   // it's not your job
 }
 
-void Environment::define(const std::string &name, const Object &value) {
-  env_map[name] = value;
+void Environment::define(Symbol name, const Object &value) {
+  env_map.insert_or_assign(name, value);
 }
 
-bool Environment::assign(const std::string &name, const Object &value) {
-  if (env_map.find(name) != env_map.end()) {
-    env_map[name] = value;
+void Environment::define(std::string_view name, const Object &value) {
+  define(SymbolTable::get().intern(name), value);
+}
+
+bool Environment::assign(Symbol name, const Object &value) {
+  auto it = env_map.find(name);
+  if (it != env_map.end()) {
+    it->second = value;
     return true;
   }
   bool ret = false;
@@ -26,11 +31,27 @@ bool Environment::assign(const std::string &name, const Object &value) {
   return true;
 }
 
-Object *Environment::get(const Token &t) { return get(t.literal_string); }
+bool Environment::assign(std::string_view name, const Object &value) {
+  Symbol symbol = SymbolTable::get().find(name);
+  return symbol != SymbolTable::kNone && assign(symbol, value);
+}
+
+Object *Environment::get(const Token &t) {
+  if (t.token_type_ == IDENTIFIER) {
+    return get(t.symbol);
+  }
+  return get(t.lexeme());
+}
+
+Object *Environment::get(std::string_view name) {
+  Symbol symbol = SymbolTable::get().find(name);
+  return symbol == SymbolTable::kNone ? nullptr : get(symbol);
+}
 
-Object *Environment::get(const std::string &name) {
-  if (env_map.find(name) != env_map.end()) {
-    return &env_map.at(name);
+Object *Environment::get(Symbol name) {
+  auto it = env_map.find(name);
+  if (it != env_map.end()) {
+    return &it->second;
   }
   Object *o = nullptr;
   if (enclosing != nullptr) {
@@ -48,7 +69,8 @@ std::string Environment::print() {
   // if it exists
   std::string ret = "";
   for (auto &kv : env_map) {
-    ret += kv.first + " = " + Object::object_to_str(kv.second) + "\n";
+    ret += std::string(SymbolTable::get().name(kv.first)) + " = " +
+           Object::object_to_str(kv.second) + "\n";
   }
   if (enclosing != nullptr) {
     ret += "Enclosing environment:\n";
@@ -56,35 +78,3 @@ std::string Environment::print() {
   }
   return ret;
 }
-
-Object *Environment::get_at(int distance, const std::string &name) {
-  // get the environment at the given distance
-  // and then get the value from that environment
-  Environment *e = this;
-  for (int i = 0; i < distance; i++) {
-    if (e->enclosing == nullptr) {
-      CLog::FLog(LogLevel::ERROR, LogCategory::ENV,
-                 "[get_at] Enclosing environment is null");
-      return nullptr;
-    }
-    e = e->enclosing;
-  }
-  return e->get(name);
-}
-
-bool Environment::assign_at(int distance, const std::string &name,
-                            const Object &value) {
-  // get the environment at the given distance
-  // and then assign the value to that environment
-  Environment *e = this;
-  for (int i = 0; i < distance; i++) {
-    if (e->enclosing == nullptr) {
-      CLog::FLog(LogLevel::ERROR, LogCategory::ENV,
-                 "[assign_at] Enclosing environment is null");
-      return false;
-    }
-    e = e->enclosing;
-  }
-  e->define(name, value);
-  return true;
-}
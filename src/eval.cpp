@@ -6,10 +6,12 @@
 #include "printer.h"
 #include "token.h"
 #include "utils.h"
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstddef>
 #include <math.h>
+#include <unordered_set>
 
 Object Evaluator::eval(const Expr *e) {
   return e->accept<Object, Evaluator *>(this);
@@ -27,7 +29,7 @@ double time_now() {
 class Clock : public Callable {
 public:
   std::string name = "clock";
-  Object call(std::vector<Object> args, Evaluator *) override {
+  Object call(std::span<Object> args, Evaluator *) override {
     return Object(FLOAT, new float(time_now()));
   }
   Clock *Clone() override { return new Clock(*this); }
@@ -38,7 +40,7 @@ public:
 class ToString : public Callable {
 public:
   std::string name = "str";
-  Object call(std::vector<Object> args, Evaluator *) override {
+  Object call(std::span<Object> args, Evaluator *) override {
     if (args.size() != 1) {
       CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
                  "toString() takes exactly 1 argument");
@@ -57,11 +59,62 @@ Evaluator::Evaluator() {
   env = globals;
 }
 
-// TODO(kartikarcot): take ownwership of these statements
-// and release them appropriately
-void Evaluator::eval(std::vector<std::shared_ptr<Stmt>> &&stmts) {
-  // concatenate stmts_ and stmts
-  stmts_.insert(stmts_.end(), stmts.begin(), stmts.end());
+void Evaluator::keep_alive(std::unique_ptr<Arena> arena,
+                           std::optional<uint32_t> source) {
+  arenas_.push_back({std::move(arena), source});
+}
+
+size_t Evaluator::collect() {
+  // the declarations of the functions held by the globals and, through the
+  // cells they captured, by other functions
+  std::vector<const Function *> functions;
+  std::unordered_set<const Object *> seen;
+  std::vector<const Object *> pending;
+  for (const auto &[name, value] : globals->env_map) {
+    pending.push_back(&value);
+  }
+  while (!pending.empty()) {
+    const Object *value = pending.back();
+    pending.pop_back();
+    if (value == nullptr || value->type != FUNCTION ||
+        !seen.insert(value).second) {
+      continue;
+    }
+    if (auto f = ((Callable *)value->val)->lox_function()) {
+      functions.push_back(f->f);
+      for (const Cell &cell : f->upvalues) {
+        pending.push_back(cell.get());
+      }
+    }
+  }
+  // A function needs its own node, its body, which was parsed into another
+  // arena if the function is lazy, and the lists the Resolver made for it.
+  std::vector<char> live(arenas_.size());
+  for (auto f : functions) {
+    for (size_t i = 0; i < arenas_.size(); i++) {
+      const Arena &arena = *arenas_[i].arena;
+      if (arena.contains(f) ||
+          (!f->body.empty() && arena.contains(f->body.data())) ||
+          (!f->upvalues.empty() && arena.contains(f->upvalues.data())) ||
+          (!f->cell_params.empty() && arena.contains(f->cell_params.data()))) {
+        live[i] = true;
+      }
+    }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < arenas_.size(); i++) {
+    if (live[i]) {
+      arenas_[kept++] = std::move(arenas_[i]);
+    } else if (arenas_[i].source) {
+      SourceManager::get().release(*arenas_[i].source);
+    }
+  }
+  size_t freed = arenas_.size() - kept;
+  arenas_.resize(kept);
+  return freed;
+}
+
+void Evaluator::eval(std::span<Stmt *const> stmts) {
   for (const auto &stmt : stmts) {
     if (stmt == nullptr) {
       CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
@@ -182,7 +235,7 @@ static inline Object handle_bang_equal(const Object &left_val,
   case FLOAT: {
     float &value1 = *((float *)left_val.val);
     float &value2 = *((float *)right_val.val);
-    return {FLOAT, new bool(value1 != value2)};
+    return {BOOL, new bool(value1 != value2)};
   }
   case STR: {
     char *value1 = ((char *)left_val.val);
@@ -291,19 +344,19 @@ static inline Object handle_less_equal(const Object &left_val,
 }
 
 Object Evaluator::visit_unary(const Unary *u) {
-  const Object &value = visit(u->right.get());
+  const Object &value = visit(u->right);
   if (value.type == UNDEFINED) {
     // propagate the undefined upwards
     return value;
   }
-  if (u->op->token_type_ == BANG) {
+  if (u->op.token_type_ == BANG) {
     // do something
     bool new_value = !is_truthy(value);
     return {BOOL, new bool(new_value)};
-  } else if (u->op->token_type_ == MINUS) {
+  } else if (u->op.token_type_ == MINUS) {
     if (!process_minus(value)) {
       error("Could not process the unary operation for '-' operator",
-            u->op->line_no);
+            u->op.line());
       // return a nill
       // TODO: maybe we need a better way of handling this
       return Object();
@@ -315,24 +368,26 @@ Object Evaluator::visit_unary(const Unary *u) {
     snprintf(error_str, 80,
              "Could not process the unary operation for %s with value of the "
              "type %s",
-             token_type_to_str(u->op->token_type_).c_str(),
+             token_type_to_str(u->op.token_type_).c_str(),
              Object::type_to_str(value.type).c_str());
-    error(error_str, u->op->line_no);
+    error(error_str, u->op.line());
   }
   return Object();
 }
 
 static bool literal_2_object(const Literal *l, Object &obj) {
-  switch (l->value->token_type_) {
+  switch (l->value.token_type_) {
   case NUMBER: {
     obj.type = FLOAT;
-    obj.val = new float(*(float *)l->value->literal);
+    obj.val = new float(l->value.number);
     return true;
   }
   case STRING: {
     obj.type = STR;
-    obj.val = new char[l->value->literal_string.size() + 1];
-    strcpy((char *)obj.val, l->value->literal_string.c_str());
+    std::string_view text = l->value.lexeme();
+    obj.val = new char[text.size() + 1];
+    memcpy(obj.val, text.data(), text.size());
+    ((char *)obj.val)[text.size()] = '\0';
     return true;
   }
   case FALSE: {
@@ -356,25 +411,25 @@ Object Evaluator::visit_literal(const Literal *l) {
   Object obj;
   if (!literal_2_object(l, obj)) {
     char error_str[60];
-    snprintf(error_str, 60, "Could not evaluate the literal: %s",
-             l->value->literal_string.c_str());
-    error(error_str, l->value->line_no);
+    snprintf(error_str, 60, "Could not evaluate the literal: %.*s",
+             (int)l->value.length, l->value.lexeme().data());
+    error(error_str, l->value.line());
     return Object();
   }
   return obj;
 }
 
 Object Evaluator::visit_binary(const Binary *b) {
-  const Object &left_val = visit(b->left.get());
+  const Object &left_val = visit(b->left);
   if (left_val.type == UNDEFINED) {
     return left_val;
   }
-  const Object &right_val = visit(b->right.get());
+  const Object &right_val = visit(b->right);
   if (right_val.type == UNDEFINED) {
     return right_val;
   }
   // handle the operators
-  switch (b->op->token_type_) {
+  switch (b->op.token_type_) {
   case PLUS: {
     return handle_plus(left_val, right_val);
     break;
@@ -421,28 +476,36 @@ Object Evaluator::visit_binary(const Binary *b) {
   }
 }
 
-Object *Evaluator::lookup_variable(const Token *name, const Expr *expr) {
-  if (locals.find(expr) != locals.end()) {
-    int distance = locals[expr];
-    CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
-               "Looking up variable %s at distance %d",
-               name->literal_string.c_str(), distance);
-    return env->get_at(distance, name->literal_string);
-  } else {
-    CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
-               "Looking up variable %s at global scope",
-               name->literal_string.c_str());
-    return globals->get(name->literal_string);
+Object *Evaluator::lookup_variable(const Variable *v) {
+  if (v->storage != kGlobal) {
+    return local(v->storage, v->slot);
+  }
+  CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
+             "Looking up variable %.*s at global scope", (int)v->name.length,
+             v->name.lexeme().data());
+  return globals->get(v->name.symbol);
+}
+
+Object *Evaluator::local(int storage, int slot) {
+  switch (storage) {
+  case kStack:
+    return &stack_[frame_ + slot];
+  case kCell:
+    return cells_[frame_ + slot].get();
+  case kUpvalue:
+    return (*upvalues_)[slot].get();
+  default:
+    return nullptr;
   }
 }
 
 Object Evaluator::visit_variable(const Variable *v) {
-  Object *obj_ptr = lookup_variable(v->name.get(), v);
+  Object *obj_ptr = lookup_variable(v);
   if (obj_ptr != nullptr) {
     return *obj_ptr;
   }
-  report("Variable " + v->name->literal_string + " is not defined", "",
-         v->name->line_no);
+  report("Variable " + std::string(v->name.lexeme()) + " is not defined", "",
+         v->name.line());
 
   CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
              "Lookup failed with Environment:\n%s", this->env->print().c_str());
@@ -450,232 +513,156 @@ Object Evaluator::visit_variable(const Variable *v) {
 }
 
 Object Evaluator::visit_assign(const Assign *a) {
-  const Object &obj = visit(a->value.get());
+  const Object &obj = visit(a->value);
   if (obj.type == UNDEFINED) {
     report("Could not evaluate the value of the assignment", "",
-           a->value->line_no);
+           a->value->line_no());
     return obj;
   }
-  if (locals.find(a) != locals.end()) {
-    int distance = locals[a];
+  if (a->storage == kGlobal) {
     CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
-               "[Assign] Looking up variable %s at distance %d",
-               a->name->literal_string.c_str(), distance);
-    bool ret = env->assign_at(distance, a->name->literal_string, obj);
+               "[Assign] Looking up variable %.*s at global scope",
+               (int)a->name.length, a->name.lexeme().data());
+    bool ret = globals->assign(a->name.symbol, obj);
     return obj;
-  } else {
-    CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
-               "[Assign] Looking up variable %s at global scope",
-               a->name->literal_string.c_str());
-    bool ret = globals->assign(a->name->literal_string, obj);
+  } else if (Object *o = local(a->storage, a->slot)) {
+    *o = obj;
     return obj;
   }
-  report("Variable " + a->name->literal_string +
+  report("Variable " + std::string(a->name.lexeme()) +
              " is not defined to be assigned to",
-         "", a->name->line_no);
+         "", a->name.line());
   return Object();
 }
 
 Object Evaluator::visit_logical(const Logical *l) {
   char error_str[60];
-  snprintf(error_str, 60, "Could not evaluate the logical literal: %s",
-           l->op->literal_string.c_str());
-  Object l_res = visit(l->left.get());
+  snprintf(error_str, 60, "Could not evaluate the logical literal: %.*s",
+           (int)l->op.length, l->op.lexeme().data());
+  Object l_res = visit(l->left);
   if (l_res.type == UNDEFINED) {
-    error(error_str, l->op->line_no);
+    error(error_str, l->op.line());
     return l_res;
   }
   bool l_truthy = is_truthy(l_res);
-  if (l_truthy && l->op->token_type_ == OR) {
+  if (l_truthy && l->op.token_type_ == OR) {
     return Object(BOOL, new bool(true));
   }
-  if (!l_truthy && l->op->token_type_ == AND) {
+  if (!l_truthy && l->op.token_type_ == AND) {
     return Object(BOOL, new bool(false));
   }
-  Object r_res = visit(l->right.get());
+  Object r_res = visit(l->right);
   if (r_res.type == UNDEFINED) {
-    error(error_str, l->op->line_no);
+    error(error_str, l->op.line());
     return r_res;
   }
   bool r_truthy = is_truthy(r_res);
-  if (r_truthy && l->op->token_type_ == OR) {
+  if (r_truthy && l->op.token_type_ == OR) {
     return Object(BOOL, new bool(true));
   }
-  if (r_truthy && l->op->token_type_ == AND) {
+  if (r_truthy && l->op.token_type_ == AND) {
     return Object(BOOL, new bool(true));
   }
   return Object(BOOL, new bool(false));
 }
 
 Object Evaluator::visit(const Expr *e) {
-  PrettyPrinter p;
-  CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL, "Visiting Expression: %s",
-             p.paranthesize(e).c_str());
-  const Binary *b = nullptr;
-  b = dynamic_cast<const Binary *>(e);
-  if (b != nullptr) {
-    return visit_binary(b);
-  }
-  const Unary *u = nullptr;
-  u = dynamic_cast<const Unary *>(e);
-  if (u != nullptr) {
-    return visit_unary(u);
-  }
-  const Literal *l = nullptr;
-  l = dynamic_cast<const Literal *>(e);
-  if (l != nullptr) {
-    return visit_literal(l);
-  }
-  const Grouping *g = nullptr;
-  g = dynamic_cast<const Grouping *>(e);
-  if (g != nullptr) {
-    return visit(g->expression.get());
-  }
-  const Variable *v = nullptr;
-  v = dynamic_cast<const Variable *>(e);
-  if (v != nullptr) {
-    return visit_variable(v);
-  }
-  const Assign *a = nullptr;
-  a = dynamic_cast<const Assign *>(e);
-  if (a != nullptr) {
-    return visit_assign(a);
-  }
-
-  const Logical *lo = nullptr;
-  lo = dynamic_cast<const Logical *>(e);
-  if (lo != nullptr) {
-    return visit_logical(lo);
-  }
-  const Call *c = nullptr;
-  c = dynamic_cast<const Call *>(e);
-  if (c != nullptr) {
-    return visit_call(c);
+  // printing the expression costs more than evaluating most of them
+  if (CLog::Enabled(LogLevel::DEBUG, LogCategory::EVAL)) {
+    PrettyPrinter p;
+    CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL, "Visiting Expression: %s",
+               p.paranthesize(e).c_str());
   }
-  CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
-             "Could not evaluate the "
-             "expression! No rules "
-             "matched! Report this error "
-             "to askarthikkumar@gmail.com");
+  return dispatch<Object>(this, e);
+}
 
-  // Nothing matched we are returning
-  return Object();
+Object Evaluator::visit_grouping(const Grouping *g) {
+  return visit(g->expression);
 }
 
 void Evaluator::visit_block(const Block *b) {
   assert(b != nullptr);
-  auto old_env = env;
-  {
-    this->env = std::make_shared<Environment>(old_env.get());
-    for (auto st : b->statements) {
-      assert(st != nullptr);
-      visit(st.get());
-    }
+  // the locals of the block are in the current frame, which grows to make
+  // room for them
+  size_t top = stack_.size();
+  if (top < frame_ + b->frame_size) {
+    stack_.resize(frame_ + b->frame_size);
+    cells_.resize(frame_ + b->frame_size);
+  }
+  for (auto st : b->statements) {
+    assert(st != nullptr);
+    visit(st);
   }
-  this->env = old_env;
+  stack_.resize(top);
+  cells_.resize(top);
 }
 
-void Evaluator::visit(const Stmt *s) {
-  const Print *p = nullptr;
-  p = dynamic_cast<const Print *>(s);
-  if (p != nullptr) {
-    // construct a string of all the results of the expressions
-    std::string result;
-    for (auto e : p->expressions) {
-      result += Object::object_to_str(visit(e.get()));
-      result += " ";
-    }
-    // do something
-    printf("%s\n", result.c_str());
-    return;
-  }
-  const Expression *e = nullptr;
-  e = dynamic_cast<const Expression *>(s);
-  if (e != nullptr) {
-    // do something
-    PrettyPrinter p;
-    visit(e->expression.get());
-    return;
-  }
-  const Var *v = nullptr;
-  v = dynamic_cast<const Var *>(s);
-  if (v != nullptr) {
-    // do something
-    const Object &value = visit(v->initializer.get());
-    env->define(v->name->literal_string, std::move(value));
-    return;
-  }
-  const Block *b = nullptr;
-  b = dynamic_cast<const Block *>(s);
-  if (b != nullptr) {
-    visit_block(b);
-    return;
-  }
-  const If *i = nullptr;
-  i = dynamic_cast<const If *>(s);
-  if (i != nullptr) {
-    visit_if(i);
-    return;
-  }
-  const While *w = nullptr;
-  w = dynamic_cast<const While *>(s);
-  if (w != nullptr) {
-    visit_while(w);
-    return;
-  }
-  const Function *f = nullptr;
-  f = dynamic_cast<const Function *>(s);
-  if (f != nullptr) {
-    visit_function(f);
-    return;
-  }
-  const Class *c = nullptr;
-  c = dynamic_cast<const Class *>(s);
-  if (c != nullptr) {
-    visit_class(c);
-    return;
+void Evaluator::visit(const Stmt *s) { dispatch<void>(this, s); }
+
+void Evaluator::visit_print(const Print *p) {
+  // construct a string of all the results of the expressions
+  std::string result;
+  for (auto e : p->expressions) {
+    result += Object::object_to_str(visit(e));
+    result += " ";
   }
-  const Return *r = nullptr;
-  r = dynamic_cast<const Return *>(s);
-  if (r != nullptr) {
-    visit_return(r);
-    return;
+  printf("%s\n", result.c_str());
+}
+
+void Evaluator::visit_expression(const Expression *e) { visit(e->expression); }
+
+void Evaluator::visit_var(const Var *v) {
+  const Object &value = visit(v->initializer);
+  define(v->name, v->storage, v->slot, value);
+}
+
+Cell Evaluator::make_cell(Object value) {
+  return std::allocate_shared<Object>(PoolAllocator<Object>(&pool_),
+                                      std::move(value));
+}
+
+void Evaluator::define(const Token &name, int storage, int slot,
+                       const Object &value) {
+  switch (storage) {
+  case kStack:
+    stack_[frame_ + slot] = value;
+    break;
+  case kCell:
+    cells_[frame_ + slot] = make_cell(value);
+    break;
+  default:
+    globals->define(name.symbol, value);
+    break;
   }
-  // if we reached here then print an error
-  CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
-             "Could not evaluate the "
-             "statement! No rules "
-             "matched! Report this error "
-             "to askarthikkumar@gmail.com");
 }
 
 void Evaluator::visit_if(const If *i) {
-  Object o = visit(i->condition.get());
+  Object o = visit(i->condition);
   if (o.type == UNDEFINED) {
     report("Could not evaluate the condition for the if block", "",
-           i->condition->line_no);
+           i->condition->line_no());
     return;
   }
   if (is_truthy(o)) {
-    visit(i->thenBranch.get());
+    visit(i->thenBranch);
   } else if (i->elseBranch != nullptr) {
-    visit(i->elseBranch.get());
+    visit(i->elseBranch);
   }
 }
 
 void Evaluator::visit_while(const While *w) {
-  Object o = visit(w->condition.get());
+  Object o = visit(w->condition);
   if (o.type == UNDEFINED) {
     report("Could not evaluate the expression in the while condition", "",
-           w->condition->line_no);
+           w->condition->line_no());
     return;
   }
   while (is_truthy(o)) {
-    visit(w->body.get());
-    o = visit(w->condition.get());
+    visit(w->body);
+    o = visit(w->condition);
     if (o.type == UNDEFINED) {
       report("Could not evaluate the expression in the while condition", "",
-             w->condition->line_no);
+             w->condition->line_no());
       return;
     }
   }
@@ -683,86 +670,110 @@ void Evaluator::visit_while(const While *w) {
 
 Object Evaluator::visit_call(const Call *c) {
   // get the function object
-  Object callee = visit(c->callee.get());
-  std::vector<Object> args;
+  Object callee = visit(c->callee);
+  // The arguments are evaluated onto the top of the value stack, where the
+  // frame of a Lox function starts, so they need not be copied there.
+  size_t base = stack_.size();
   for (auto e : c->arguments) {
-    Object o = visit(e.get());
+    Object o = visit(e);
     if (o.type == UNDEFINED) {
-      report("Could not evaluate the argument", "", e->line_no);
+      report("Could not evaluate the argument", "", e->line_no());
+      stack_.resize(base);
       return o;
     }
-    args.push_back(o);
+    stack_.push_back(std::move(o));
   }
+  std::span<Object> args(stack_.data() + base, c->arguments.size());
+  Object ret;
   if (callee.type != FUNCTION) {
-    report("Can only call functions and classes", "", c->paren->line_no);
-    return Object();
-  }
-  if (callee.val == nullptr) {
+    report("Can only call functions and classes", "", c->paren.line());
+  } else if (callee.val == nullptr) {
     report("Function object not defined with a callable. Report to "
            "askarthikkumar@gmail.com",
-           "", c->paren->line_no);
-    return Object();
-  }
-  Callable *func = (Callable *)(callee.val);
-  if (args.size() != func->arity()) {
+           "", c->paren.line());
+  } else if (Callable *func = (Callable *)(callee.val);
+             args.size() != func->arity()) {
     report("Expected " + std::to_string(func->arity()) + " arguments but got " +
                std::to_string(args.size()),
-           "", c->paren->line_no);
-    return Object();
-  }
-  return func->call(args, this);
-}
-
-void Evaluator::execute_block(std::vector<std::shared_ptr<Stmt>> statements,
-                              std::shared_ptr<Environment> clos_env) {
-  auto old_env = this->env;
+           "", c->paren.line());
+  } else {
+    ret = func->call(args, this);
+  }
+  stack_.resize(base);
+  return ret;
+}
+
+Object Evaluator::call(const Function *f, const Upvalues &upvalues,
+                       std::span<Object> args) {
+  size_t frame = frame_;
+  const Upvalues *enclosing = upvalues_;
+  // the arguments already are the first slots of the frame, the parameters
+  size_t base = stack_.size() - args.size();
+  assert(args.data() == stack_.data() + base);
+  size_t top = base + std::max<size_t>(f->frame_size, f->params.size());
+  stack_.resize(top);
+  cells_.resize(top);
+  frame_ = base;
+  upvalues_ = &upvalues;
+  for (int i : f->cell_params) {
+    cells_[base + i] = make_cell(std::move(stack_[base + i]));
+  }
+  Object ret;
   try {
-    this->env = clos_env;
-    for (auto s : statements) {
-      visit(s.get());
+    for (auto s : f->body) {
+      visit(s);
     }
   } catch (Object &o) {
-    CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL,
-               "Caught the return object %s", Object::object_to_str(o).c_str());
-    this->env = old_env;
-    throw o;
+    if (CLog::Enabled(LogLevel::DEBUG, LogCategory::FUN)) {
+      CLog::FLog(LogLevel::DEBUG, LogCategory::FUN,
+                 "Returning from function with value %s",
+                 Object::object_to_str(o).c_str());
+    }
+    ret = std::move(o);
   }
-  this->env = old_env;
+  stack_.resize(base);
+  cells_.resize(base);
+  frame_ = frame;
+  upvalues_ = enclosing;
+  return ret;
 }
 
 void Evaluator::visit_function(const Function *f) {
-  auto func = new LoxFunction(f, env);
-  env->define(f->name->literal_string, Object(FUNCTION, func));
-  return;
+  // f can call itself, so its own cell is made before it is captured
+  if (f->storage == kCell) {
+    cells_[frame_ + f->slot] = make_cell(Object());
+  }
+  Upvalues upvalues{PoolAllocator<Cell>(&pool_)};
+  upvalues.reserve(f->upvalues.size());
+  for (const Upvalue &upvalue : f->upvalues) {
+    upvalues.push_back(upvalue.local ? cells_[frame_ + upvalue.index]
+                                     : (*upvalues_)[upvalue.index]);
+  }
+  Object func(FUNCTION, new LoxFunction(f, std::move(upvalues)));
+  if (f->storage == kCell) {
+    *cells_[frame_ + f->slot] = std::move(func);
+  } else {
+    define(f->name, f->storage, f->slot, func);
+  }
 }
 
 void Evaluator::visit_class(const Class *c) {
-  CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL, "Visiting class %s",
-             c->name->literal_string.c_str());
-  env->define(c->name->literal_string, Object());
-  auto class_ptr = new LoxClass(c->name->literal_string);
-  bool ret =
-      env->assign(c->name->literal_string, Object(CLASS_TYPE, class_ptr));
-  if (!ret) {
-    CLog::FLog(LogLevel::ERROR, LogCategory::EVAL,
-               "Could not assign the class to the environment");
-  }
+  CLog::FLog(LogLevel::DEBUG, LogCategory::EVAL, "Visiting class %.*s",
+             (int)c->name.length, c->name.lexeme().data());
+  auto class_ptr = new LoxClass(std::string(c->name.lexeme()));
+  define(c->name, c->storage, c->slot, Object(CLASS_TYPE, class_ptr));
   return;
 }
 
 void Evaluator::visit_return(const Return *r) {
   Object value;
   if (r->value != nullptr) {
-    value = visit(r->value.get());
+    value = visit(r->value);
   }
   throw value;
 }
 
-void Evaluator::resolve(const Expr *e, int depth) { locals.insert({e, depth}); }
-
 Evaluator::~Evaluator() {
   globals.reset();
   env.reset();
-  locals.clear();
-  stmts_.clear();
 }
@@ -0,0 +1,250 @@
+#include "folder.h"
+#include "object.h"
+#include <cstdio>
+
+// Literals whose value is known without running anything. nil is left out,
+// the evaluator does not take it as a value.
+static bool is_constant(const Expr *e) {
+  if (e == nullptr || e->kind != Expr::Kind::Literal) {
+    return false;
+  }
+  switch (static_cast<const Literal *>(e)->value.token_type_) {
+  case NUMBER:
+  case STRING:
+  case TRUE:
+  case FALSE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The truthiness of a constant, as the evaluator sees it.
+static bool is_truthy(const Expr *e) {
+  TokenType type = static_cast<const Literal *>(e)->value.token_type_;
+  return type != FALSE;
+}
+
+// A literal for value, or nullptr if it has no literal form.
+static Literal *make_literal(Arena &arena, const Object &value,
+                             uint32_t offset) {
+  Token t;
+  switch (value.type) {
+  case FLOAT: {
+    float number = *(float *)value.val;
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", number);
+    t = Token(NUMBER, text);
+    t.number = number;
+    break;
+  }
+  case STR:
+    t = Token(STRING, (const char *)value.val);
+    break;
+  case BOOL:
+    t = *(bool *)value.val ? Token(TRUE, "true") : Token(FALSE, "false");
+    break;
+  default:
+    return nullptr;
+  }
+  auto l = arena.make<Literal>();
+  l->value = t;
+  l->offset = offset;
+  return l;
+}
+
+Expr *ConstantFolder::fold_binary(Binary *b) {
+  b->left = fold(b->left);
+  b->right = fold(b->right);
+  if (!is_constant(b->left) || !is_constant(b->right)) {
+    return b;
+  }
+  switch (b->op.token_type_) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case SLASH:
+  case BANG_EQUAL:
+  case EQUAL_EQUAL:
+  case GREATER:
+  case GREATER_EQUAL:
+  case LESS:
+  case LESS_EQUAL:
+    break;
+  default:
+    return b;
+  }
+  // operands of the wrong type evaluate to nothing, those are left for the
+  // evaluator to report
+  Literal *l = make_literal(arena_, eval_.visit(b), b->offset);
+  if (l == nullptr) {
+    return b;
+  }
+  folded_++;
+  return l;
+}
+
+Expr *ConstantFolder::fold_unary(Unary *u) {
+  u->right = fold(u->right);
+  if (!is_constant(u->right)) {
+    return u;
+  }
+  Token value = static_cast<Literal *>(u->right)->value;
+  if (u->op.token_type_ == MINUS && value.token_type_ != NUMBER) {
+    // an error at run time
+    return u;
+  }
+  Literal *l = make_literal(arena_, eval_.visit(u), u->offset);
+  if (l == nullptr) {
+    return u;
+  }
+  folded_++;
+  return l;
+}
+
+Expr *ConstantFolder::fold(Expr *e) {
+  if (e == nullptr) {
+    return e;
+  }
+  switch (e->kind) {
+  case Expr::Kind::Assign: {
+    auto a = static_cast<Assign *>(e);
+    a->value = fold(a->value);
+    return a;
+  }
+  case Expr::Kind::Binary:
+    return fold_binary(static_cast<Binary *>(e));
+  case Expr::Kind::Grouping: {
+    auto g = static_cast<Grouping *>(e);
+    g->expression = fold(g->expression);
+    if (!is_constant(g->expression)) {
+      return g;
+    }
+    folded_++;
+    g->expression->offset = g->offset;
+    return g->expression;
+  }
+  case Expr::Kind::Logical: {
+    auto l = static_cast<Logical *>(e);
+    l->left = fold(l->left);
+    l->right = fold(l->right);
+    return l;
+  }
+  case Expr::Kind::Unary:
+    return fold_unary(static_cast<Unary *>(e));
+  case Expr::Kind::Call: {
+    auto c = static_cast<Call *>(e);
+    c->callee = fold(c->callee);
+    for (auto &arg : c->arguments) {
+      arg = fold(arg);
+    }
+    return c;
+  }
+  case Expr::Kind::Literal:
+  case Expr::Kind::Variable:
+    return e;
+  }
+  return e;
+}
+
+Stmt *ConstantFolder::empty_block() { return arena_.make<Block>(); }
+
+std::span<Stmt *> ConstantFolder::fold(std::span<Stmt *> stmts) {
+  std::vector<Stmt *> kept;
+  for (auto s : stmts) {
+    if (Stmt *folded = fold(s)) {
+      kept.push_back(folded);
+    }
+  }
+  if (kept.size() == stmts.size()) {
+    std::copy(kept.begin(), kept.end(), stmts.begin());
+    return stmts;
+  }
+  return arena_.copy(kept);
+}
+
+void ConstantFolder::fold(std::vector<Stmt *> &stmts) {
+  std::vector<Stmt *> kept;
+  for (auto s : stmts) {
+    if (Stmt *folded = fold(s)) {
+      kept.push_back(folded);
+    }
+  }
+  stmts = std::move(kept);
+}
+
+Stmt *ConstantFolder::fold(Stmt *s) {
+  if (s == nullptr) {
+    return s;
+  }
+  switch (s->kind) {
+  case Stmt::Kind::Block: {
+    auto b = static_cast<Block *>(s);
+    b->statements = fold(b->statements);
+    return b;
+  }
+  case Stmt::Kind::Expression: {
+    auto e = static_cast<Expression *>(s);
+    e->expression = fold(e->expression);
+    return e;
+  }
+  case Stmt::Kind::Print: {
+    auto p = static_cast<Print *>(s);
+    for (auto &e : p->expressions) {
+      e = fold(e);
+    }
+    return p;
+  }
+  case Stmt::Kind::Var: {
+    auto v = static_cast<Var *>(s);
+    v->initializer = fold(v->initializer);
+    return v;
+  }
+  case Stmt::Kind::If: {
+    auto i = static_cast<If *>(s);
+    i->condition = fold(i->condition);
+    i->thenBranch = fold(i->thenBranch);
+    i->elseBranch = fold(i->elseBranch);
+    if (!is_constant(i->condition)) {
+      if (i->thenBranch == nullptr) {
+        i->thenBranch = empty_block();
+      }
+      return i;
+    }
+    folded_++;
+    return is_truthy(i->condition) ? i->thenBranch : i->elseBranch;
+  }
+  case Stmt::Kind::While: {
+    auto w = static_cast<While *>(s);
+    w->condition = fold(w->condition);
+    w->body = fold(w->body);
+    if (is_constant(w->condition) && !is_truthy(w->condition)) {
+      folded_++;
+      return nullptr;
+    }
+    if (w->body == nullptr) {
+      w->body = empty_block();
+    }
+    return w;
+  }
+  case Stmt::Kind::Function: {
+    auto f = static_cast<Function *>(s);
+    // a lazy body is folded once it is parsed
+    f->body = fold(f->body);
+    return f;
+  }
+  case Stmt::Kind::Return: {
+    auto r = static_cast<Return *>(s);
+    r->value = fold(r->value);
+    return r;
+  }
+  case Stmt::Kind::Class: {
+    auto c = static_cast<Class *>(s);
+    for (auto &method : c->methods) {
+      method = fold(method);
+    }
+    return c;
+  }
+  }
+  return s;
+}
@@ -1,30 +1,116 @@
 #include "lox.h"
+#include "folder.h"
 #include "logger.h"
+#include "mapped_file.h"
 #include "printer.h"
+#include "program_cache.h"
+#include "source.h"
 #include "utils.h"
 #include <iostream>
 #include <sstream>
 
+Lox::Lox() {
+  eval_.load_body = [this](const Function *f) { return load_body(f); };
+}
+
 void Lox::run(const std::string &lox_code) {
   Scanner scanner;
   scanner.init(lox_code);
-  scanner.scan();
-  auto tokens = scanner.get_tokens();
-  Parser parser;
-  parser.init(tokens);
-  auto stmts = parser.parse_stmts();
+  // the source is only needed for as long as its nodes
+  uint32_t source = scanner.get_source_base();
+  std::unique_ptr<Arena> arena;
+  auto stmts = parse(scanner, arena);
+  if (stmts.empty()) {
+    SourceManager::get().release(source);
+    return;
+  }
+  execute(stmts, std::move(arena), source);
+}
+
+void Lox::run(Scanner &scanner) {
+  std::unique_ptr<Arena> arena;
+  auto stmts = parse(scanner, arena);
   if (stmts.empty())
     return;
-  Resolver resolver(&eval_);
+  execute(stmts, std::move(arena));
+}
+
+std::vector<Stmt *> Lox::parse(Scanner &scanner,
+                               std::unique_ptr<Arena> &arena) {
+  Parser parser;
+  // a scanner that has lexed everything up front hands over its tokens,
+  // otherwise the parser pulls them one at a time
+  if (scanner.get_tokens().empty())
+    parser.init(scanner);
+  else
+    parser.init(scanner.get_tokens());
+  parser.set_lazy_functions(lazy_functions_);
+  auto stmts = parser.parse_stmts(threads_);
+  if (scanner.had_error())
+    return {};
+  arena = parser.take_arena();
+  return stmts;
+}
+
+bool Lox::resolve(const std::vector<Stmt *> &stmts, Arena &arena) {
+  Resolver resolver(&eval_, &arena);
   if (!resolver.resolve(stmts)) {
     CLog::FLog(LogLevel::ERROR, LogCategory::ALL, "Resolver failed");
+    return false;
+  }
+  return true;
+}
+
+void Lox::run(const FlatAst &ast) {
+  auto arena = std::make_unique<Arena>();
+  auto stmts = inflate(ast, *arena);
+  if (stmts.empty())
     return;
+  execute(stmts, std::move(arena));
+}
+
+void Lox::execute(std::vector<Stmt *> stmts, std::unique_ptr<Arena> arena,
+                  std::optional<uint32_t> source) {
+  // kept even if resolving fails, collect() frees the nodes and the source
+  // together
+  Arena &nodes = *arena;
+  eval_.keep_alive(std::move(arena), source);
+  if (!resolve(stmts, nodes))
+    return;
+  ConstantFolder(nodes).fold(stmts);
+  eval_.eval(stmts);
+}
+
+bool Lox::load_body(const Function *f) {
+  // the body is lexed again straight from the source, which the
+  // SourceManager still holds
+  Scanner scanner;
+  scanner.init(SourceManager::get().base_of(f->brace.offset));
+  scanner.seek(f->brace.offset);
+  Parser parser;
+  parser.init(scanner);
+  // the node is completed in place, once, before its body is read
+  auto function = const_cast<Function *>(f);
+  if (!parser.parse_lazy_body(function) || scanner.had_error())
+    return false;
+  auto arena = parser.take_arena();
+  Resolver resolver(&eval_, arena.get());
+  resolver.resolve_function(f, Resolver::FunctionType::FUNCTION);
+  if (resolver.had_error_) {
+    CLog::FLog(LogLevel::ERROR, LogCategory::ALL, "Resolver failed");
+    function->body = {};
+    function->cell_params = {};
+    function->lazy = true;
+    return false;
   }
-  eval_.eval(std::move(stmts));
+  ConstantFolder(*arena).fold(function);
+  eval_.keep_alive(std::move(arena));
+  return true;
 }
 
 void Lox::run_prompt() {
   std::string line;
+  size_t next_collect = 64;
   while (true) {
     std::cout << ">>> ";
     std::getline(std::cin, line);
@@ -32,10 +118,55 @@ void Lox::run_prompt() {
     if (std::cin.eof())
       break;
     run(line);
+    // every line leaves an arena behind, the ones no function needs any more
+    // are freed once they make up half of them
+    if (eval_.arenas_.size() >= next_collect) {
+      eval_.collect();
+      next_collect = 2 * eval_.arenas_.size() + 64;
+    }
   }
 }
 
 void Lox::run_file(const std::string &file_path) {
-  std::string contents = read_file_into_string(file_path);
-  run(contents);
+  // the file is lexed straight out of the mapping, which stays alive for as
+  // long as the SourceManager holds the buffer
+  auto file = std::make_shared<MappedFile>();
+  if (!file->open(file_path)) {
+    ::report("Could not read " + file_path, "", 0);
+    return;
+  }
+  uint32_t base =
+      SourceManager::get().add_view(file->data(), file->size(), file);
+  if (cache_programs_ && file_path != "-") {
+    run_cached(file_path, base);
+    return;
+  }
+  Scanner scanner;
+  scanner.init(base);
+  if (threads_ > 1 && !scanner.scan(threads_))
+    return;
+  run(scanner);
+}
+
+void Lox::run_cached(const std::string &file_path, uint32_t base) {
+  uint64_t hash = hash_source(SourceManager::get().buffer(base));
+  std::string path = cache_path(file_path, hash);
+  auto arena = std::make_unique<Arena>();
+  std::vector<Stmt *> stmts;
+  if (!load_program(path, hash, base, *arena, stmts)) {
+    Scanner scanner;
+    scanner.init(base);
+    if (threads_ > 1 && !scanner.scan(threads_))
+      return;
+    stmts = parse(scanner, arena);
+    if (stmts.empty() || !resolve(stmts, *arena))
+      return;
+    ConstantFolder(*arena).fold(stmts);
+    // a cache that can't be written only costs the next run its time
+    if (!save_program(path, hash, base, stmts))
+      CLog::FLog(LogLevel::INFO, LogCategory::ALL, "Could not write %s",
+                 path.c_str());
+  }
+  eval_.keep_alive(std::move(arena));
+  eval_.eval(stmts);
 }
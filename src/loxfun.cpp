@@ -5,40 +5,42 @@
 #include "logger.h"
 #include <memory>
 
-LoxFunction::LoxFunction(const Function *f,
-                         std::shared_ptr<Environment> closure) {
-  this->f = f;
-  this->closure = closure;
-  this->name = f->name->literal_string;
+// The values in the cells of a closure, for the debug log.
+static std::string print_upvalues(const Upvalues &upvalues) {
+  std::string ret;
+  for (size_t i = 0; i < upvalues.size(); i++) {
+    ret += "[" + std::to_string(i) +
+           "] = " + Object::object_to_str(*upvalues[i]) + "\n";
+  }
+  return ret;
+}
+
+LoxFunction::LoxFunction(const Function *f, Upvalues upvalues)
+    : f(f), upvalues(std::move(upvalues)) {
+  this->name = std::string(f->name.lexeme());
   CLog::FLog(LogLevel::DEBUG, LogCategory::FUN, "Creating function %s",
-             this->f->name->literal_string.c_str());
-  CLog::FLog(LogLevel::DEBUG, LogCategory::FUN,
-             "Closure has the following variables:\n%s",
-             this->closure->print().c_str());
+             this->name.c_str());
+  if (CLog::Enabled(LogLevel::DEBUG, LogCategory::FUN)) {
+    CLog::FLog(LogLevel::DEBUG, LogCategory::FUN,
+               "Closure has the following upvalues:\n%s",
+               print_upvalues(this->upvalues).c_str());
+  }
 }
 
-Object LoxFunction::call(std::vector<Object> args, Evaluator *eval) {
+Object LoxFunction::call(std::span<Object> args, Evaluator *eval) {
   CLog::FLog(LogLevel::DEBUG, LogCategory::FUN, "Calling function %s",
-             f->name->literal_string.c_str());
+             name.c_str());
   CLog::FLog(LogLevel::DEBUG, LogCategory::FUN, "With %zu arguments",
              args.size());
-  CLog::FLog(LogLevel::DEBUG, LogCategory::FUN,
-             "Closure has the following variables:\n%s\nAddress: %zu",
-             closure->print().c_str(), (size_t)closure.get());
-  auto local = std::make_shared<Environment>(closure.get());
-  for (size_t i = 0; i < f->params.size(); i++) {
-    local->define(f->params[i]->literal_string, args[i]);
-  }
-
-  try {
-    eval->execute_block(f->body, local);
-  } catch (Object ret) {
+  if (CLog::Enabled(LogLevel::DEBUG, LogCategory::FUN)) {
     CLog::FLog(LogLevel::DEBUG, LogCategory::FUN,
-               "Returning from function with value %s",
-               Object::object_to_str(ret).c_str());
-    return ret;
+               "Closure has the following upvalues:\n%s",
+               print_upvalues(upvalues).c_str());
+  }
+  if (f->lazy && !(eval->load_body && eval->load_body(f))) {
+    return Object();
   }
-  return Object();
+  return eval->call(f, upvalues, args);
 }
 
 int LoxFunction::arity() { return f->params.size(); }
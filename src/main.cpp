@@ -6,6 +6,33 @@
 
 int main(int argc, char **argv) {
   Lox interpreter;
+  while (argc >= 2 && argv[1][0] == '-') {
+    std::string option = argv[1];
+    if (option == "-j" && argc >= 3) {
+      // -j N lexes and parses the script on N threads
+      int threads = atoi(argv[2]);
+      if (threads < 1) {
+        CLog::Log(LogLevel::INFO, LogCategory::ALL,
+                  "The number of threads must be at least 1");
+        return -1;
+      }
+      interpreter.threads_ = threads;
+      argc -= 2;
+      argv += 2;
+    } else if (option == "--lazy") {
+      // function bodies are parsed when they are first called
+      interpreter.lazy_functions_ = true;
+      argc -= 1;
+      argv += 1;
+    } else if (option == "--cache") {
+      // scripts are run from a .loxc file once they have been parsed
+      interpreter.cache_programs_ = true;
+      argc -= 1;
+      argv += 1;
+    } else {
+      break;
+    }
+  }
   if (argc == 1) {
     interpreter.run_prompt();
   } else if (argc == 2) {
@@ -13,7 +40,8 @@ int main(int argc, char **argv) {
     interpreter.run_file(file_path);
   } else {
     CLog::Log(LogLevel::INFO, LogCategory::ALL,
-              "The correct usage is cpplox [script] or just cpplox");
+              "The correct usage is cpplox [-j threads] [--lazy] [--cache] "
+              "[script] or just cpplox");
     return -1;
   }
   return 0;
@@ -0,0 +1,79 @@
+#include "mapped_file.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string &path) {
+  int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool ok = false;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      map(fd, st.st_size)) {
+    ok = true;
+  } else {
+    ok = read_all(fd);
+  }
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  return ok;
+}
+
+bool MappedFile::map(int fd, size_t size) {
+  // Reserve one byte more than the file, rounded up to whole pages, as an
+  // anonymous zero filled mapping and map the file over the front of it.
+  // The bytes after the file then read as '\0', even when the file size is
+  // an exact multiple of the page size.
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t map_size = (size + 1 + page - 1) / page * page;
+  void *region = mmap(nullptr, map_size, PROT_READ,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return false;
+  }
+  void *file = mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  if (file == MAP_FAILED) {
+    munmap(region, map_size);
+    return false;
+  }
+  // the scanner reads the source front to back exactly once
+  madvise(region, size, MADV_SEQUENTIAL);
+  map_ = region;
+  map_size_ = map_size;
+  data_ = (const char *)region;
+  size_ = size;
+  return true;
+}
+
+bool MappedFile::read_all(int fd) {
+  buffer_.clear();
+  char chunk[1 << 16];
+  while (true) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0) {
+      CLog::FLog(LogLevel::ERROR, LogCategory::ALL, "Could not read file: %s",
+                 strerror(errno));
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    buffer_.append(chunk, n);
+  }
+  data_ = buffer_.c_str();
+  size_ = buffer_.size();
+  return true;
+}
+
+MappedFile::~MappedFile() {
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+}
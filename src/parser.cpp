@@ -3,9 +3,16 @@
 #include "logger.h"
 #include "printer.h"
 #include "token.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <memory>
+#include <thread>
 
 /*
+Expressions are parsed by precedence climbing over kInfixPrecedence, which
+gives the same trees as this grammar:
+
 expression     -> assignment ;
 assignment     -> IDENTIFIER "=" assignment | logic_or ;
 logic_or       -> logic_and ( "or" logic_and )* ;
@@ -20,242 +27,212 @@ expression
 ")" ;
 */
 
-void Parser::init(const std::vector<Token> &tokens) {
+void Parser::init(std::span<const Token> tokens) {
   tokens_ = tokens;
+  scanner_ = nullptr;
   current_ = 0;
+  depth_ = 0;
   return;
 }
 
-int Parser::get_current_line() {
-  if (is_at_end() || current_ > tokens_.size()) {
-    return tokens_[current_ - 1].line_no;
-  }
-  if (current_ < 0) {
-    report("Report this error to askarthikkumar@gmail.com", "", -1);
-    return -1;
-  }
-  return tokens_[current_].line_no;
+void Parser::init(Scanner &scanner) {
+  tokens_ = {};
+  scanner_ = &scanner;
+  pulled_ = 0;
+  current_ = 0;
+  depth_ = 0;
+  return;
 }
 
-std::shared_ptr<Expr> Parser::logic_or() {
-  auto l_and = logic_and();
-  if (l_and == nullptr) {
-    return nullptr;
+const Token &Parser::token_at(int i) {
+  if (scanner_ == nullptr) {
+    if (static_cast<size_t>(i) < tokens_.size()) {
+      return tokens_[i];
+    }
+    // behave as if the tokens were terminated by END_OF_FILE
+    static const Token eof;
+    return eof;
   }
-  auto op = std::make_shared<Token>();
-  if (peek(*op) && op->token_type_ == OR) {
-    Token _;
-    advance(_);
-    auto r_and = logic_and();
-    if (r_and == nullptr) {
-      return nullptr;
+  // pull tokens from the scanner until i is in the window. The parser never
+  // looks further back than the previous token, so the oldest tokens can
+  // be overwritten.
+  assert(i >= pulled_ - kWindow);
+  while (pulled_ <= i) {
+    Token &slot = window_[pulled_ % kWindow];
+    if (!scanner_->next_token(slot)) {
+      // a lexing error ends the token stream
+      slot = Token();
     }
-    auto l = std::make_shared<Logical>();
-    l->left = l_and;
-    l->op = op;
-    l->right = r_and;
-    l->line_no = op->line_no;
-    return l;
-  } else {
-    return l_and;
+    pulled_++;
   }
+  return window_[i % kWindow];
 }
 
-std::shared_ptr<Expr> Parser::logic_and() {
-  std::shared_ptr<Expr> l_eq = equality();
-  if (l_eq == nullptr) {
-    return nullptr;
-  }
-  auto op = std::make_shared<Token>();
-  ;
-  if (peek(*op) && op->token_type_ == AND) {
-    Token _;
-    advance(_);
-    std::shared_ptr<Expr> r_eq = equality();
-    if (r_eq == nullptr) {
-      return nullptr;
-    }
-    auto l = std::make_shared<Logical>();
-    l->left = l_eq;
-    l->op = op;
-    l->right = r_eq;
-    l->line_no = op->line_no;
-    return l;
-  } else {
-    return l_eq;
-  }
+std::unique_ptr<Arena> Parser::take_arena() {
+  return std::exchange(arena_, std::make_unique<Arena>());
 }
 
-std::shared_ptr<Expr> Parser::assignment() {
-  // try to match an equality or other subsumed
-  // lower level expressions
-  std::shared_ptr<Expr> e = logic_or();
-  if (e == nullptr) {
-    return nullptr;
-  }
-  if (match({EQUAL})) {
-    // if we still have a trailing equals then maybe lhs is an
-    // assignable target. Check if the lhs evaluates to a variable
-    // Right now, the only valid target is a simple variable expression, but
-    // we’ll add fields later.
-    std::shared_ptr<Variable> v = dynamic_pointer_cast<Variable>(e);
-    if (v == nullptr) {
-      // this is bad call a parser error
-      report("Invalid assignment target.", "", e->line_no);
-      return nullptr;
-    }
-    // otherwise this means maybe there is a valid expression on the other side
-    std::shared_ptr<Expr> eval_expr = assignment();
-    if (eval_expr == nullptr) {
-      return nullptr;
-    }
-    auto a = std::make_shared<Assign>();
-    a->name = v->name;
-    a->value = eval_expr;
-    a->line_no = e->line_no;
-    return a;
-  } else {
-    return e;
+uint32_t Parser::get_current_offset() {
+  if (is_at_end() && current_ > 0) {
+    return token_at(current_ - 1).offset;
   }
+  return token_at(current_).offset;
 }
 
-std::shared_ptr<Expr> Parser::expression() {
-  std::shared_ptr<Expr> e = assignment();
-  Token t;
-  return e;
+void Parser::report(const std::string &message, const std::string &where,
+                    uint32_t offset) {
+  // the line is looked up only here, quiet parsers run on other threads
+  if (report_errors_) {
+    ::report(message, where, SourceManager::get().position(offset).line);
+  }
 }
 
-std::shared_ptr<Expr> Parser::equality() {
-  auto expr = comparison();
-  if (expr == nullptr) {
-    return nullptr;
-  }
-  while (match({BANG_EQUAL, EQUAL_EQUAL})) {
-    Token op;
-    if (!previous(op)) {
-      report("Issue parsing equality", "", tokens_[current_].line_no);
-      return nullptr;
+// Binding power of every token in infix position. A token with NONE ends the
+// expression it follows.
+static constexpr auto kInfixPrecedence = [] {
+  std::array<Precedence, END_OF_FILE + 1> table{};
+  table[EQUAL] = Precedence::ASSIGNMENT;
+  table[OR] = Precedence::LOGIC_OR;
+  table[AND] = Precedence::LOGIC_AND;
+  table[BANG_EQUAL] = Precedence::EQUALITY;
+  table[EQUAL_EQUAL] = Precedence::EQUALITY;
+  table[GREATER] = Precedence::COMPARISON;
+  table[GREATER_EQUAL] = Precedence::COMPARISON;
+  table[LESS] = Precedence::COMPARISON;
+  table[LESS_EQUAL] = Precedence::COMPARISON;
+  table[MINUS] = Precedence::TERM;
+  table[PLUS] = Precedence::TERM;
+  table[SLASH] = Precedence::FACTOR;
+  table[STAR] = Precedence::FACTOR;
+  table[LEFT_PAREN] = Precedence::CALL;
+  return table;
+}();
+
+Expr *Parser::expression() { return parse_precedence(Precedence::ASSIGNMENT); }
+
+Expr *Parser::parse_precedence(Precedence min) {
+  Expr *left = prefix();
+  while (left != nullptr) {
+    Token op = token_at(current_);
+    Precedence power = kInfixPrecedence[op.token_type_];
+    if (power == Precedence::NONE || power < min) {
+      break;
     }
-    std::shared_ptr<Expr> right = comparison();
-    if (right == nullptr) {
-      return nullptr;
+    current_++;
+    switch (power) {
+    case Precedence::CALL:
+      left = finish_call(left);
+      break;
+    case Precedence::ASSIGNMENT: {
+      // right associative, and only a variable can be assigned to
+      Variable *v = dyn_cast<Variable>(left);
+      if (v == nullptr) {
+        report("Invalid assignment target.", "", left->offset);
+        return nullptr;
+      }
+      Expr *value = parse_precedence(Precedence::ASSIGNMENT);
+      if (value == nullptr) {
+        return nullptr;
+      }
+      auto a = arena_->make<Assign>();
+      a->name = v->name;
+      a->value = value;
+      a->offset = left->offset;
+      left = a;
+      break;
     }
-    std::shared_ptr<Expr> new_expr = std::make_shared<Binary>();
-    static_pointer_cast<Binary>(new_expr)->left = expr;
-    static_pointer_cast<Binary>(new_expr)->op = std::make_shared<Token>(op);
-    static_pointer_cast<Binary>(new_expr)->right = right;
-    expr = new_expr;
-    expr->line_no = op.line_no;
-  }
-  return expr;
-}
-
-std::shared_ptr<Expr> Parser::comparison() {
-  auto expr = term();
-  if (expr == nullptr) {
-    return nullptr;
-  }
-  while (match({GREATER, GREATER_EQUAL, LESS, LESS_EQUAL})) {
-    Token op;
-    if (!previous(op)) {
-      report("Issue parsing comparison", "", tokens_[current_].line_no);
-      return nullptr;
+    default: {
+      // left associative, the right operand only takes tighter operators
+      Expr *right = parse_precedence(
+          static_cast<Precedence>(static_cast<uint8_t>(power) + 1));
+      if (right == nullptr) {
+        return nullptr;
+      }
+      if (op.token_type_ == OR || op.token_type_ == AND) {
+        auto l = arena_->make<Logical>();
+        l->left = left;
+        l->op = op;
+        l->right = right;
+        left = l;
+      } else {
+        auto b = arena_->make<Binary>();
+        b->left = left;
+        b->op = op;
+        b->right = right;
+        left = b;
+      }
+      left->offset = op.offset;
+      break;
     }
-    auto right = term();
-    if (right == nullptr) {
-      return nullptr;
     }
-    std::shared_ptr<Expr> new_expr = std::make_shared<Binary>();
-    static_pointer_cast<Binary>(new_expr)->left = expr;
-    static_pointer_cast<Binary>(new_expr)->op = std::make_shared<Token>(op);
-    static_pointer_cast<Binary>(new_expr)->right = right;
-    expr = new_expr;
-    expr->line_no = op.line_no;
   }
-
-  return expr;
+  return left;
 }
 
-std::shared_ptr<Expr> Parser::term() {
-  auto expr = factor();
-  if (expr == nullptr) {
-    return nullptr;
-  }
-  while (match({PLUS, MINUS})) {
-    Token op;
-    if (!previous(op)) {
-      report("Issue parsing term", "", tokens_[current_].line_no);
-      return nullptr;
-    }
-    auto right = factor();
+Expr *Parser::prefix() {
+  Token t = token_at(current_);
+  switch (t.token_type_) {
+  case BANG:
+  case MINUS: {
+    current_++;
+    Expr *right = parse_precedence(Precedence::UNARY);
     if (right == nullptr) {
       return nullptr;
     }
-    auto new_expr = std::make_shared<Binary>();
-    static_pointer_cast<Binary>(new_expr)->left = expr;
-    static_pointer_cast<Binary>(new_expr)->op = std::make_shared<Token>(op);
-    static_pointer_cast<Binary>(new_expr)->right = right;
-    expr = new_expr;
-    expr->line_no = op.line_no;
-  }
-  return expr;
-}
-
-std::shared_ptr<Expr> Parser::factor() {
-  auto expr = unary();
-  if (expr == nullptr) {
-    return nullptr;
+    auto u = arena_->make<Unary>();
+    u->op = t;
+    u->right = right;
+    u->offset = t.offset;
+    return u;
   }
-  while (match({SLASH, STAR})) {
-    Token op;
-    if (!previous(op)) {
-      report("Issue parsing factor", "", tokens_[current_].line_no);
-      return nullptr;
-    }
-    auto right = unary();
-    if (right == nullptr) {
+  case LEFT_PAREN: {
+    // if a grouped then start from the top
+    current_++;
+    Expr *expr = expression();
+    if (expr == nullptr) {
       return nullptr;
     }
-    auto new_expr = std::make_shared<Binary>();
-    static_pointer_cast<Binary>(new_expr)->left = expr;
-    static_pointer_cast<Binary>(new_expr)->op = std::make_shared<Token>(op);
-    static_pointer_cast<Binary>(new_expr)->right = right;
-    expr = new_expr;
-    expr->line_no = op.line_no;
-  }
-  return expr;
-}
-
-std::shared_ptr<Expr> Parser::unary() {
-  if (match({BANG, MINUS})) {
-    Token op;
-    if (!previous(op)) {
-      report("Issue parsing code", "", tokens_[current_].line_no);
+    if (!match({RIGHT_PAREN})) {
+      report("Expected )", "", get_current_offset());
       return nullptr;
     }
-    auto op_expr = unary();
-    auto expr = std::make_shared<Unary>();
-    static_pointer_cast<Unary>(expr)->op = std::make_shared<Token>(op);
-    static_pointer_cast<Unary>(expr)->right = op_expr;
-    expr->line_no = op.line_no;
+    expr->offset = get_current_offset();
     return expr;
   }
-  return call();
+  case IDENTIFIER: {
+    current_++;
+    auto v = arena_->make<Variable>();
+    v->name = t;
+    v->offset = get_current_offset();
+    return v;
+  }
+  case END_OF_FILE:
+    report("Unexpected end of file", "", get_current_offset());
+    return nullptr;
+  default: {
+    // otherwise it has to be a literal
+    auto l = arena_->make<Literal>();
+    l->value = t;
+    l->offset = get_current_offset();
+    current_++;
+    return l;
+  }
+  }
 }
 
-std::shared_ptr<Expr> Parser::finish_call(std::shared_ptr<Expr> expr) {
+Expr *Parser::finish_call(Expr *expr) {
   // we have a left paren
   // we need to parse the arguments if any exist
   // and then the right paren
-  std::vector<std::shared_ptr<Expr>> args;
+  std::vector<Expr *> args;
   Token t;
   if (!peek(t)) {
-    report("Issue parsing call", "", get_current_line());
+    report("Issue parsing call", "", get_current_offset());
     return nullptr;
   }
   if (t.token_type_ != RIGHT_PAREN) {
     do {
-      auto arg = assignment();
+      auto arg = expression();
       if (arg == nullptr) {
         return nullptr;
       }
@@ -263,109 +240,54 @@ std::shared_ptr<Expr> Parser::finish_call(std::shared_ptr<Expr> expr) {
       if (args.size() > kMaxArgs) {
         report("Too many arguments. Max number of arguments supported is " +
                    std::to_string(kMaxArgs),
-               "", get_current_line());
+               "", get_current_offset());
         return nullptr;
       }
     } while (match({COMMA}));
   }
   // match the right paren
   if (!advance(t) || t.token_type_ != RIGHT_PAREN) {
-    report("Expected )", "", get_current_line());
+    report("Expected )", "", get_current_offset());
     return nullptr;
   }
   // construct the call object
-  auto call = std::make_shared<Call>();
+  auto call = arena_->make<Call>();
   call->callee = expr;
-  call->arguments = args;
-  call->paren = std::make_shared<Token>(t);
+  call->arguments = arena_->copy(args);
+  call->paren = t;
   return call;
 }
 
-std::shared_ptr<Expr> Parser::call() {
-  std::shared_ptr<Expr> expr = primary();
-  if (expr == nullptr) {
-    return nullptr;
-  }
-  // to allow for calls like fn(a)(b). Aka currying
-  while (true) {
-    if (match({LEFT_PAREN})) {
-      expr = finish_call(expr);
-    } else {
-      break;
-    }
-  }
-  return expr;
-}
-
-std::shared_ptr<Expr> Parser::primary() {
-  if (match({LEFT_PAREN})) {
-    // if a grouped then start from the top
-    std::shared_ptr<Expr> expr = assignment();
-    if (!match({RIGHT_PAREN})) {
-      report("Expected )", "", get_current_line());
-      return nullptr;
-    }
-    Token t;
-    peek(t);
-    expr->line_no = get_current_line();
-    return expr;
-  } else if (match({IDENTIFIER})) {
-    // if identifier then create a variable node
-    auto expr = std::make_shared<Variable>();
-    static_pointer_cast<Variable>(expr)->name = std::make_shared<Token>();
-    previous(*static_pointer_cast<Variable>(expr)->name);
-    expr->line_no = get_current_line();
-    return expr;
-  } else {
-    // otherwise it has to be a literal or some parse error
-    Token t;
-    if (!peek(t)) {
-      if (is_at_end()) {
-        report("Unexpected end of file", "", get_current_line());
-      } else {
-        report("Report this error to askarthikkumar@gmail.com", "", -1);
-      }
-      return nullptr;
-    }
-    auto expr = std::make_shared<Literal>();
-    static_pointer_cast<Literal>(expr)->value = std::make_shared<Token>(t);
-    expr->line_no = get_current_line();
-    advance(t);
-    return expr;
-  }
-  return nullptr;
-}
-
 Token Parser::consume(TokenType type, std::string message) {
   Token t;
   if (!peek(t)) {
-    report("Unexpected end of file", "", get_current_line());
+    report("Unexpected end of file", "", get_current_offset());
     return t;
   }
   if (t.token_type_ == type) {
     advance(t);
     return t;
   }
-  report(message, "", get_current_line());
+  report(message, "", get_current_offset());
   return t;
 }
 
 bool Parser::peek(Token &t) {
   if (is_at_end())
     return false;
-  if (current_ < 0 || current_ >= tokens_.size())
+  if (current_ < 0)
     return false;
-  t = tokens_[current_];
+  t = token_at(current_);
   return true;
 }
 
 bool Parser::is_at_end() {
-  if (tokens_[current_].token_type_ == END_OF_FILE)
+  if (token_at(current_).token_type_ == END_OF_FILE)
     return true;
   return false;
 }
 
-bool Parser::match(std::vector<TokenType> options) {
+bool Parser::match(std::initializer_list<TokenType> options) {
   Token t;
   if (!peek(t))
     return false;
@@ -389,7 +311,7 @@ bool Parser::advance(Token &t) {
 bool Parser::previous(Token &t) {
   if (current_ == 0)
     return false;
-  t = tokens_[current_ - 1];
+  t = token_at(current_ - 1);
   return true;
 }
 
@@ -418,9 +340,9 @@ void Parser::synchronize() {
   }
 }
 
-std::shared_ptr<Expr> Parser::parse() { return expression(); }
+Expr *Parser::parse() { return expression(); }
 
-std::shared_ptr<Stmt> Parser::parse_statement() {
+Stmt *Parser::parse_statement() {
   // consume statement
   Token t;
   peek(t);
@@ -429,10 +351,10 @@ std::shared_ptr<Stmt> Parser::parse_statement() {
     match({PRINT});
     // match a left paren
     if (!match({LEFT_PAREN})) {
-      report("Expected (", "", get_current_line());
+      report("Expected (", "", get_current_offset());
       return nullptr;
     }
-    std::vector<std::shared_ptr<Expr>> expressions;
+    std::vector<Expr *> expressions;
     // read a list of comma seperated expressions
     while (!match({RIGHT_PAREN})) {
       // read a single expression
@@ -447,18 +369,18 @@ std::shared_ptr<Stmt> Parser::parse_statement() {
         if (match({RIGHT_PAREN})) {
           break;
         }
-        report("Expected , or )", "", get_current_line());
+        report("Expected , or )", "", get_current_offset());
         return nullptr;
       }
     }
     if (!match({SEMICOLON})) {
       report("Missing semicolon at the end of the statement", "",
-             get_current_line());
+             get_current_offset());
       return nullptr;
     }
-    auto p = std::make_shared<Print>();
-    p->expressions = expressions;
-    p->line_no = t.line_no;
+    auto p = arena_->make<Print>();
+    p->expressions = arena_->copy(expressions);
+    p->offset = t.offset;
     return p;
     break;
   }
@@ -466,111 +388,111 @@ std::shared_ptr<Stmt> Parser::parse_statement() {
     // consume left brace
     Token _;
     advance(_);
-    std::vector<std::shared_ptr<Stmt>> stmts;
+    std::vector<Stmt *> stmts;
     if (!parse_block(stmts)) {
       return nullptr;
     }
-    auto b = std::make_shared<Block>();
-    b->statements = std::move(stmts);
-    b->line_no = t.line_no;
+    auto b = arena_->make<Block>();
+    b->statements = arena_->copy(stmts);
+    b->offset = t.offset;
     return b;
     break;
   }
   case IF: {
     auto if_st = parse_if();
-    if_st->line_no = t.line_no;
+    if_st->offset = t.offset;
     return if_st;
   }
   case WHILE: {
     auto while_st = parse_while();
-    while_st->line_no = t.line_no;
+    while_st->offset = t.offset;
     return while_st;
   }
   case FOR: {
     auto for_st = parse_for();
-    for_st->line_no = t.line_no;
+    for_st->offset = t.offset;
     return for_st;
   }
   case RETURN: {
     match({RETURN});
     auto return_st = parse_return();
-    return_st->line_no = t.line_no;
+    return_st->offset = t.offset;
     return return_st;
   }
   default: {
     auto expr_st = parse_expression_statement();
     if (expr_st) {
-      expr_st->line_no = t.line_no;
+      expr_st->offset = t.offset;
     }
     return expr_st;
   }
   }
 }
 
-std::shared_ptr<Stmt> Parser::parse_var_declaration() {
-  auto t = std::make_shared<Token>();
-  if (!advance(*t) || t->token_type_ != IDENTIFIER) {
+Stmt *Parser::parse_var_declaration() {
+  Token t;
+  if (!advance(t) || t.token_type_ != IDENTIFIER) {
     report("Missing/Invalid identifier in variable declaration statement", "",
-           get_current_line());
+           get_current_offset());
   }
   if (match({EQUAL})) {
     auto ex = expression();
     if (ex) {
-      auto var = std::make_shared<Var>();
+      auto var = arena_->make<Var>();
       var->name = t;
       var->initializer = ex;
       if (match({SEMICOLON})) {
-        var->line_no = t->line_no;
+        var->offset = t.offset;
         return var;
       } else {
         report("Missing ; in variable declaration statement", "",
-               get_current_line());
+               get_current_offset());
       }
     } else {
       report("Could not parse the expression assigned to the variable", "",
-             get_current_line());
+             get_current_offset());
     }
   } else {
     report("Missing = in variable declaration statement", "",
-           get_current_line());
+           get_current_offset());
   }
   return nullptr;
 }
 
-std::shared_ptr<Stmt> Parser::parse_function() {
+Stmt *Parser::parse_function(bool lazy) {
   Token t;
   if (peek(t) && t.token_type_ == IDENTIFIER) {
     advance(t);
   } else {
     report("Missing/Invalid identifier in function declaration statement", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
   auto name = t;
   if (!match({LEFT_PAREN})) {
     report("Missing ( in function declaration statement", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
-  std::vector<std::shared_ptr<Token>> params;
+  std::vector<Token> params;
   while (!match({RIGHT_PAREN})) {
     Token t;
     if (!peek(t) || t.token_type_ != IDENTIFIER) {
       report("Missing/Invalid identifier in function declaration statement", "",
-             get_current_line());
+             get_current_offset());
       return nullptr;
     }
     advance(t);
-    params.push_back(std::make_shared<Token>(t));
+    params.push_back(t);
     if (params.size() > kMaxArgs) {
       report("Too many arguments in function declaration statement", "",
-             get_current_line());
+             get_current_offset());
       return nullptr;
     }
     if (!match({COMMA})) {
       if (!match({RIGHT_PAREN})) {
         report("Missing ) or , in function declaration statement", "",
-               get_current_line());
+               get_current_offset());
         return nullptr;
         break;
       } else {
@@ -586,37 +508,52 @@ std::shared_ptr<Stmt> Parser::parse_function() {
     advance(t);
   } else {
     report("Missing { in function declaration statement", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
-  std::vector<std::shared_ptr<Stmt>> body;
+  auto f = arena_->make<Function>();
+  f->name = name;
+  f->params = arena_->copy(params);
+  f->brace = t;
+  if (lazy) {
+    // only match the braces, the body is parsed by parse_lazy_body
+    for (int depth = 1; depth > 0;) {
+      if (!advance(t)) {
+        report("Expected } after block", "", get_current_offset());
+        return nullptr;
+      }
+      if (t.token_type_ == LEFT_BRACE) {
+        depth++;
+      } else if (t.token_type_ == RIGHT_BRACE) {
+        depth--;
+      }
+    }
+    f->lazy = true;
+    return f;
+  }
+  std::vector<Stmt *> body;
   if (!parse_block(body)) {
-    // cast to Block and iterate over the statements
     return nullptr;
   }
-
-  auto f = std::make_shared<Function>();
-  f->name = std::make_shared<Token>(name);
-  f->params = params;
-  f->body = body;
+  f->body = arena_->copy(body);
   return f;
 }
 
-std::shared_ptr<Stmt> Parser::parse_class() {
+Stmt *Parser::parse_class() {
   Token t;
   if (!peek(t) || t.token_type_ != IDENTIFIER) {
     report("Missing/Invalid identifier in class declaration statement", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
   advance(t);
-  auto name = std::make_shared<Token>(t);
+  auto name = t;
   // consume the left brace
   if (!match({LEFT_BRACE})) {
-    report("Missing { in class declaration statement", "", get_current_line());
+    report("Missing { in class declaration statement", "", get_current_offset());
     return nullptr;
   }
-  std::vector<std::shared_ptr<Stmt>> methods;
+  std::vector<Stmt *> methods;
   Token t_right_brace;
   while (!is_at_end() && peek(t_right_brace) &&
          t_right_brace.token_type_ != RIGHT_BRACE) {
@@ -625,32 +562,34 @@ std::shared_ptr<Stmt> Parser::parse_class() {
       methods.push_back(method);
     } else {
       report("Missing/Invalid method in class declaration statement", "",
-             get_current_line());
+             get_current_offset());
       return nullptr;
     }
   }
   if (!match({RIGHT_BRACE})) {
-    report("Missing } in class declaration statement", "", get_current_line());
+    report("Missing } in class declaration statement", "", get_current_offset());
     return nullptr;
   }
-  auto c = std::make_shared<Class>();
+  auto c = arena_->make<Class>();
   c->name = name;
-  c->methods = methods;
+  c->methods = arena_->copy(methods);
   return c;
 }
 
-std::shared_ptr<Stmt> Parser::parse_declaration() {
+Stmt *Parser::parse_declaration() {
   // We seperate the declaration type statements from other statements because
   // we don't want to allow certain kinds of syntax like this:
   // if (monday) var beverage = "espresso"; Here the var declaration is
   // just inside an if block. That could be allowed but is pointless and
   // confusing to be allowed
-  std::shared_ptr<Stmt> s = nullptr;
+  Stmt *s = nullptr;
   // if we match a var start point then we are a variable declaration
   if (match({VAR})) {
     s = parse_var_declaration();
   } else if (match({FUN})) {
-    s = parse_function();
+    // only functions declared at the top level are resolved in the global
+    // scope and can be completed later without the enclosing scopes
+    s = parse_function(lazy_functions_ && depth_ == 0);
   } else if (match({CLASS})) {
     s = parse_class();
   } else {
@@ -665,104 +604,242 @@ std::shared_ptr<Stmt> Parser::parse_declaration() {
   return s;
 }
 
-bool Parser::parse_block(std::vector<std::shared_ptr<Stmt>> &statements) {
+bool Parser::parse_block(std::vector<Stmt *> &statements) {
   Token t;
+  depth_++;
   // we have tokens to parse and it's not a right paren
   while (!is_at_end() && peek(t) && t.token_type_ != RIGHT_BRACE) {
     auto expr = parse_declaration();
     if (!expr) {
+      depth_--;
       return false;
     }
     statements.push_back(expr);
   }
+  depth_--;
   if (!match({RIGHT_BRACE})) {
-    report("Expected } after block", "", get_current_line());
+    report("Expected } after block", "", get_current_offset());
+    return false;
+  }
+  return true;
+}
+
+bool Parser::parse_lazy_body(Function *f) {
+  if (!match({LEFT_BRACE})) {
+    report("Missing { in function declaration statement", "",
+           get_current_offset());
     return false;
   }
+  std::vector<Stmt *> body;
+  if (!parse_block(body)) {
+    return false;
+  }
+  f->body = arena_->copy(body);
+  f->lazy = false;
   return true;
 }
 
-std::vector<std::shared_ptr<Stmt>> Parser::parse_stmts() {
-  std::vector<std::shared_ptr<Stmt>> statements;
+std::vector<Stmt *> Parser::parse_stmts() {
+  std::vector<Stmt *> statements;
   while (!is_at_end()) {
     auto expr = parse_declaration();
     if (!expr) {
       return {};
     }
-    expr->line_no = tokens_[current_].line_no;
+    expr->offset = token_at(current_).offset;
     statements.push_back(expr);
   }
   return statements;
 }
 
-std::shared_ptr<Stmt> Parser::parse_if() {
+std::vector<size_t> Parser::find_declarations() const {
+  std::vector<size_t> starts;
+  int depth = 0;
+  for (size_t i = current_; i < tokens_.size(); i++) {
+    switch (tokens_[i].token_type_) {
+    case LEFT_BRACE:
+    case LEFT_PAREN:
+      depth++;
+      break;
+    case RIGHT_BRACE:
+    case RIGHT_PAREN:
+      depth--;
+      break;
+    case FUN:
+    case CLASS:
+    case VAR: {
+      // not the body of an if, while or for
+      TokenType before = i > 0 ? tokens_[i - 1].token_type_ : SEMICOLON;
+      if (depth == 0 && (before == SEMICOLON || before == RIGHT_BRACE)) {
+        starts.push_back(i);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return starts;
+}
+
+// The condition of a for loop without one. Interning its lexeme writes to the
+// SourceManager, so parse_stmts(threads) does it before starting the threads.
+static const Token &false_token() {
+  static const Token token(FALSE, "false");
+  return token;
+}
+
+// chunks smaller than this are not worth a thread
+static constexpr size_t kMinChunkTokens = 16 * 1024;
+
+std::vector<Stmt *> Parser::parse_stmts(unsigned threads) {
+  if (scanner_ != nullptr || static_cast<size_t>(current_) >= tokens_.size()) {
+    return parse_stmts();
+  }
+  size_t size = tokens_.size() - current_;
+  threads = std::min<size_t>(threads, size / kMinChunkTokens);
+  if (threads <= 1) {
+    return parse_stmts();
+  }
+  // A chunk is a run of whole top level statements, so it parses on its own.
+  // Where the brace count is thrown off by a syntax error a chunk fails and
+  // the serial parse below reports the error.
+  auto starts = find_declarations();
+  std::vector<size_t> splits = {static_cast<size_t>(current_)};
+  for (unsigned i = 1; i < threads; i++) {
+    size_t target = std::max(splits.back() + 1, current_ + size * i / threads);
+    auto it = std::lower_bound(starts.begin(), starts.end(), target);
+    if (it == starts.end()) {
+      break;
+    }
+    splits.push_back(*it);
+  }
+  splits.push_back(tokens_.size());
+
+  // Interning the false of a for loop is the one write to shared state a
+  // parse may do, so it is done up front.
+  false_token();
+  std::vector<Parser> chunks(splits.size() - 1);
+  std::vector<std::vector<Stmt *>> stmts(chunks.size());
+  auto parse_chunk = [&](size_t i) {
+    Parser &chunk = chunks[i];
+    chunk.init(tokens_.subspan(splits[i], splits[i + 1] - splits[i]));
+    chunk.lazy_functions_ = lazy_functions_;
+    chunk.report_errors_ = false;
+    stmts[i] = chunk.parse_stmts();
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    workers.emplace_back(parse_chunk, i);
+  }
+  parse_chunk(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<Stmt *> statements;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (stmts[i].empty()) {
+      return parse_stmts();
+    }
+  }
+  for (size_t i = 0; i < chunks.size(); i++) {
+    // the last statement of a chunk saw its end, not the next token
+    if (i + 1 < chunks.size()) {
+      stmts[i].back()->offset = tokens_[splits[i + 1]].offset;
+    }
+    statements.insert(statements.end(), stmts[i].begin(), stmts[i].end());
+    arena_->merge(*chunks[i].take_arena());
+  }
+  current_ = tokens_.size() - 1;
+  return statements;
+}
+
+bool Parser::parse_flat(FlatAst &ast) {
+  auto arena = std::exchange(arena_, std::make_unique<Arena>());
+  bool ok = true;
+  while (!is_at_end()) {
+    auto stmt = parse_declaration();
+    if (!stmt) {
+      ok = false;
+      break;
+    }
+    stmt->offset = token_at(current_).offset;
+    ast.program.push_back(flatten(ast, stmt));
+    arena_->reset();
+  }
+  arena_ = std::move(arena);
+  return ok;
+}
+
+Stmt *Parser::parse_if() {
   Token t;
   advance(t);
   if (!match({LEFT_PAREN})) {
-    report("Expect '(' after 'if'.", "", t.line_no);
+    report("Expect '(' after 'if'.", "", t.offset);
     return nullptr;
   }
-  std::shared_ptr<Expr> e = expression();
+  Expr *e = expression();
   if (e == nullptr) {
     return nullptr;
   }
   if (!match({RIGHT_PAREN})) {
-    report("Expect ')' after 'if' condition", "", get_current_line());
+    report("Expect ')' after 'if' condition", "", get_current_offset());
     return nullptr;
   }
-  std::shared_ptr<Stmt> thenBranch = parse_statement();
+  Stmt *thenBranch = parse_statement();
   if (thenBranch == nullptr) {
     return thenBranch;
   }
-  std::shared_ptr<Stmt> elseBranch = nullptr;
+  Stmt *elseBranch = nullptr;
   if (match({ELSE})) {
     elseBranch = parse_statement();
     if (elseBranch == nullptr) {
       return elseBranch;
     }
   }
-  auto i = std::make_shared<If>();
+  auto i = arena_->make<If>();
   i->condition = e;
   i->thenBranch = thenBranch;
   i->elseBranch = elseBranch;
   return i;
 }
 
-std::shared_ptr<Stmt> Parser::parse_while() {
+Stmt *Parser::parse_while() {
   Token t;
   advance(t);
   if (!match({LEFT_PAREN})) {
-    report("Expect '(' after 'while'.", "", get_current_line());
+    report("Expect '(' after 'while'.", "", get_current_offset());
     return nullptr;
   }
-  std::shared_ptr<Expr> e = expression();
+  Expr *e = expression();
   if (e == nullptr) {
     report("Expression inside while did not get evaluated", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
   if (!match({RIGHT_PAREN})) {
-    report("Expect ')' after 'while' condition", "", get_current_line());
+    report("Expect ')' after 'while' condition", "", get_current_offset());
     return nullptr;
   }
-  std::shared_ptr<Stmt> whileBranch = parse_statement();
+  Stmt *whileBranch = parse_statement();
   if (whileBranch == nullptr) {
     return whileBranch;
   }
-  auto w = std::make_shared<While>();
+  auto w = arena_->make<While>();
   w->condition = e;
   w->body = whileBranch;
   return w;
 }
 
-std::shared_ptr<Stmt> Parser::parse_for() {
+Stmt *Parser::parse_for() {
   Token t;
   advance(t);
   if (!match({LEFT_PAREN})) {
-    report("Expect '(' after 'for'.", "", get_current_line());
+    report("Expect '(' after 'for'.", "", get_current_offset());
     return nullptr;
   }
-  std::shared_ptr<Stmt> initializer = nullptr;
+  Stmt *initializer = nullptr;
   if (match({SEMICOLON})) {
     initializer = nullptr;
   } else if (match({VAR})) {
@@ -771,98 +848,100 @@ std::shared_ptr<Stmt> Parser::parse_for() {
     initializer = parse_expression_statement();
   }
   if (initializer == nullptr) {
-    report("Could not parse initializer for for loop", "", get_current_line());
+    report("Could not parse initializer for for loop", "", get_current_offset());
     return nullptr;
   }
-  std::shared_ptr<Expr> condition = nullptr;
+  Expr *condition = nullptr;
   if (!match({SEMICOLON})) {
     condition = expression();
     if (condition == nullptr) {
-      report("Could not parse condition for for loop", "", get_current_line());
+      report("Could not parse condition for for loop", "", get_current_offset());
       return nullptr;
     }
     if (!match({SEMICOLON})) {
-      report("Expect ';' after loop condition.", "", get_current_line());
+      report("Expect ';' after loop condition.", "", get_current_offset());
       return nullptr;
     }
   }
-  std::shared_ptr<Expr> increment = nullptr;
+  Expr *increment = nullptr;
   if (!match({RIGHT_PAREN})) {
     increment = expression();
     if (increment == nullptr) {
-      report("Could not parse increment for for loop", "", get_current_line());
+      report("Could not parse increment for for loop", "", get_current_offset());
       return nullptr;
     }
     if (!match({RIGHT_PAREN})) {
-      report("Expect ')' after for clauses.", "", get_current_line());
+      report("Expect ')' after for clauses.", "", get_current_offset());
       return nullptr;
     }
   }
-  std::shared_ptr<Stmt> body = parse_statement();
+  Stmt *body = parse_statement();
   if (body == nullptr) {
     return body;
   }
   if (increment != nullptr) {
-    std::vector<std::shared_ptr<Stmt>> body_stmts;
+    std::vector<Stmt *> body_stmts;
     body_stmts.push_back(body);
-    auto ex = std::make_shared<Expression>();
+    auto ex = arena_->make<Expression>();
     ex->expression = increment;
     body_stmts.push_back(ex);
-    auto b = std::make_shared<Block>();
-    b->statements = body_stmts;
+    auto b = arena_->make<Block>();
+    b->statements = arena_->copy(body_stmts);
     body = b;
   }
   if (condition == nullptr) {
-    condition = std::make_shared<Literal>();
-    dynamic_pointer_cast<Literal>(condition)->value =
-        std::make_shared<Token>(Token{FALSE, "false", 0, 0});
+    auto l = arena_->make<Literal>();
+    l->value = false_token();
+    condition = l;
   }
-  auto w = std::make_shared<While>();
+  auto w = arena_->make<While>();
   w->condition = condition;
   w->body = body;
   if (initializer != nullptr) {
-    std::vector<std::shared_ptr<Stmt>> body_stmts;
+    std::vector<Stmt *> body_stmts;
     body_stmts.push_back(initializer);
     body_stmts.push_back(w);
-    auto b = std::make_shared<Block>();
-    b->statements = body_stmts;
+    auto b = arena_->make<Block>();
+    b->statements = arena_->copy(body_stmts);
     return b;
   }
   return w;
 }
 
-std::shared_ptr<Stmt> Parser::parse_expression_statement() {
+Stmt *Parser::parse_expression_statement() {
   // evaluate as an expression
-  std::shared_ptr<Expr> expr = expression();
+  Expr *expr = expression();
   if (!expr) {
     return nullptr;
   }
-  auto ex = std::make_shared<Expression>();
+  auto ex = arena_->make<Expression>();
   if (!match({SEMICOLON})) {
     report("Missing semicolon at the end of the statement", "",
-           get_current_line());
+           get_current_offset());
     return nullptr;
   }
   ex->expression = expr;
   return ex;
 }
 
-std::shared_ptr<Stmt> Parser::parse_return() {
+Stmt *Parser::parse_return() {
   Token ret;
   previous(ret);
-  std::shared_ptr<Expr> expr = nullptr;
+  Expr *expr = nullptr;
   if (!match({SEMICOLON})) {
     expr = expression();
-    PrettyPrinter p;
-    CLog::FLog(LogLevel::DEBUG, LogCategory::PARSER, "%s",
-               p.paranthesize(expr.get()).c_str());
+    if (CLog::Enabled(LogLevel::DEBUG, LogCategory::PARSER)) {
+      PrettyPrinter p;
+      CLog::FLog(LogLevel::DEBUG, LogCategory::PARSER, "%s",
+                 p.paranthesize(expr).c_str());
+    }
   }
   if (!match({SEMICOLON})) {
-    report("Expect ';' after return value.", "", get_current_line());
+    report("Expect ';' after return value.", "", get_current_offset());
     return nullptr;
   }
-  auto r = std::make_shared<Return>();
-  r->keyword = std::make_shared<Token>(ret);
+  auto r = arena_->make<Return>();
+  r->keyword = ret;
   r->value = expr;
   return r;
 }
@@ -0,0 +1,15 @@
+#include "pool.h"
+
+void *Pool::allocate_slow(size_t size_class) {
+  // the rest of a slab that is too small for the block is left unused
+  size_t size = (size_class + 1) * kGrain;
+  if (cur_ == nullptr || cur_ + size > end_) {
+    slabs_.push_back(std::unique_ptr<char[]>(new char[kSlabSize]));
+    stats_.slabs++;
+    cur_ = slabs_.back().get();
+    end_ = cur_ + kSlabSize;
+  }
+  void *p = cur_;
+  cur_ += size;
+  return p;
+}
@@ -8,38 +8,30 @@ std::string PrettyPrinter::paranthesize(const Expr *e) {
 
 std::string PrettyPrinter::visit(const Expr *e) {
   std::stringstream ss;
-  const Binary *b = nullptr;
-  b = dynamic_cast<const Binary *>(e);
-  if (b != nullptr) {
+  switch (e->kind) {
+  case Expr::Kind::Binary: {
+    auto b = static_cast<const Binary *>(e);
     ss << "(";
-    ss << " " << b->op->literal_string;
+    ss << " " << b->op.lexeme();
     ss << " " << b->left->accept<std::string, PrettyPrinter *>(this);
     ss << " " << b->right->accept<std::string, PrettyPrinter *>(this);
     ss << ")";
     return ss.str();
   }
-  const Unary *u = nullptr;
-  u = dynamic_cast<const Unary *>(e);
-  if (u != nullptr) {
+  case Expr::Kind::Unary: {
+    auto u = static_cast<const Unary *>(e);
     ss << "(";
-    ss << " " << u->op->literal_string;
+    ss << " " << u->op.lexeme();
     ss << " " << u->right->accept<std::string, PrettyPrinter *>(this);
     ss << ")";
     return ss.str();
   }
-  const Literal *l = nullptr;
-  l = dynamic_cast<const Literal *>(e);
-  if (l != nullptr) {
-    return l->value->literal_string;
-  }
-  const Variable *v = nullptr;
-  v = dynamic_cast<const Variable *>(e);
-  if (v != nullptr) {
-    return v->name->literal_string;
-  }
-  const Call *c = nullptr;
-  c = dynamic_cast<const Call *>(e);
-  if (c != nullptr) {
+  case Expr::Kind::Literal:
+    return std::string(static_cast<const Literal *>(e)->value.lexeme());
+  case Expr::Kind::Variable:
+    return std::string(static_cast<const Variable *>(e)->name.lexeme());
+  case Expr::Kind::Call: {
+    auto c = static_cast<const Call *>(e);
     ss << "(";
     ss << " " << c->callee->accept<std::string, PrettyPrinter *>(this);
     for (auto &arg : c->arguments) {
@@ -48,24 +40,25 @@ std::string PrettyPrinter::visit(const Expr *e) {
     ss << ")";
     return ss.str();
   }
-  const Logical *l2 = nullptr;
-  l2 = dynamic_cast<const Logical *>(e);
-  if (l2 != nullptr) {
+  case Expr::Kind::Logical: {
+    auto l = static_cast<const Logical *>(e);
     ss << "(";
-    ss << " " << l2->op->literal_string;
-    ss << " " << l2->left->accept<std::string, PrettyPrinter *>(this);
-    ss << " " << l2->right->accept<std::string, PrettyPrinter *>(this);
+    ss << " " << l->op.lexeme();
+    ss << " " << l->left->accept<std::string, PrettyPrinter *>(this);
+    ss << " " << l->right->accept<std::string, PrettyPrinter *>(this);
     ss << ")";
     return ss.str();
   }
-  const Assign *a = nullptr;
-  a = dynamic_cast<const Assign *>(e);
-  if (a != nullptr) {
+  case Expr::Kind::Assign: {
+    auto a = static_cast<const Assign *>(e);
     ss << "( assign ";
-    ss << " " << a->name->literal_string;
+    ss << " " << a->name.lexeme();
     ss << " " << a->value->accept<std::string, PrettyPrinter *>(this);
     ss << ")";
     return ss.str();
   }
+  case Expr::Kind::Grouping:
+    break;
+  }
   return "";
 }
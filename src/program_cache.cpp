@@ -0,0 +1,250 @@
+#include "program_cache.h"
+#include "flat_ast.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "source.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'L', 'O', 'X', 'C'};
+// bumped when the file layout below changes, changes of the nodes are
+// covered by kFlatAstVersion
+constexpr uint32_t kFormat = 3;
+// Tokens whose text is not part of the script, e.g. the ones synthesized by
+// the parser, have this bit set and the index of their text in the file.
+constexpr uint32_t kExternToken = 1u << 31;
+
+struct Header {
+  char magic[4];
+  uint32_t format;
+  uint32_t layout;
+  // number of arrays that follow
+  uint32_t arrays;
+  uint64_t source_hash;
+  uint64_t source_size;
+};
+
+// Turns the tokens of the script into offsets from its start.
+struct SaveContext : FlatContext {
+  uint32_t base;
+  uint32_t size;
+  // the text of the extern tokens
+  std::vector<FlatRange> externs;
+  std::vector<char> text;
+
+  SaveContext(uint32_t base, uint32_t size) : base(base), size(size) {}
+
+  Token token(const Token &t) {
+    Token saved = t;
+    if (t.offset >= base && t.offset - base <= size) {
+      saved.offset = t.offset - base;
+      return saved;
+    }
+    std::string_view lexeme = t.length == 0 ? "" : t.lexeme();
+    externs.push_back({static_cast<uint32_t>(text.size()),
+                       static_cast<uint32_t>(lexeme.size())});
+    text.insert(text.end(), lexeme.begin(), lexeme.end());
+    saved.offset = kExternToken | static_cast<uint32_t>(externs.size() - 1);
+    return saved;
+  }
+};
+
+// The reverse of SaveContext. The file may be damaged, so a token that
+// reaches outside the script or the extern text clears ok.
+struct LoadContext : FlatContext {
+  uint32_t base;
+  uint32_t size;
+  std::span<const FlatRange> externs;
+  std::span<const char> text;
+
+  Token token(const Token &t) {
+    Token loaded = t;
+    if (t.token_type_ > END_OF_FILE) {
+      ok = false;
+      return Token();
+    }
+    if (!(t.offset & kExternToken)) {
+      if (t.offset > size || t.length > size - t.offset) {
+        ok = false;
+        return Token();
+      }
+      loaded.offset = base + t.offset;
+    } else {
+      uint32_t i = t.offset & ~kExternToken;
+      if (i >= externs.size() || t.length != externs[i].count) {
+        ok = false;
+        return Token();
+      }
+      loaded.offset = SourceManager::get().intern(
+          {text.data() + externs[i].first, externs[i].count});
+    }
+    // symbols are numbered anew by every process
+    if (loaded.token_type_ == IDENTIFIER) {
+      loaded.symbol = SymbolTable::get().intern(loaded.lexeme());
+    }
+    return loaded;
+  }
+};
+
+// Every array is its element count followed by the elements, padded to 8
+// bytes so the next one is aligned for any of the node types.
+template <typename T>
+void write_array(std::ofstream &out, std::span<const T> items) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static const char padding[8] = {};
+  uint64_t count = items.size();
+  out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  out.write(reinterpret_cast<const char *>(items.data()), items.size_bytes());
+  out.write(padding, (8 - items.size_bytes() % 8) % 8);
+}
+
+// Reads the arrays written by write_array in place.
+struct ArrayReader {
+  const char *next;
+  const char *end;
+  uint32_t arrays = 0;
+  bool ok = true;
+
+  template <typename T> void read(std::span<const T> &items) {
+    uint64_t count = 0;
+    if (!ok || end - next < static_cast<ptrdiff_t>(sizeof(count))) {
+      ok = false;
+      return;
+    }
+    std::memcpy(&count, next, sizeof(count));
+    next += sizeof(count);
+    size_t available = end - next;
+    if (count > available / sizeof(T)) {
+      ok = false;
+      return;
+    }
+    size_t bytes = count * sizeof(T);
+    size_t padded = bytes + (8 - bytes % 8) % 8;
+    if (padded > available) {
+      ok = false;
+      return;
+    }
+    items = {reinterpret_cast<const T *>(next), count};
+    next += padded;
+    arrays++;
+  }
+};
+
+} // namespace
+
+uint64_t hash_source(std::string_view source) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : source) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string cache_path(const std::string &script, uint64_t hash) {
+  const char *dir = std::getenv("LOX_CACHE_DIR");
+  if (dir == nullptr || *dir == '\0') {
+    return script + "c";
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.loxc",
+           static_cast<unsigned long long>(hash));
+  return (std::filesystem::path(dir) / name).string();
+}
+
+bool save_program(const std::string &path, uint64_t hash, uint32_t base,
+                  const std::vector<Stmt *> &stmts) {
+  std::string_view source = SourceManager::get().buffer(base);
+  SaveContext context(base, source.size());
+  FlatAst ast;
+  for (auto stmt : stmts) {
+    ast.program.push_back(flatten(ast, stmt, context));
+  }
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.format = kFormat;
+  header.layout = kFlatAstVersion;
+  ast.for_each_array([&](const auto &) { header.arrays++; });
+  header.arrays += 2;
+  header.source_hash = hash;
+  header.source_size = source.size();
+
+  std::error_code error;
+  auto dir = std::filesystem::path(path).parent_path();
+  if (!dir.empty()) {
+    std::filesystem::create_directories(dir, error);
+  }
+  std::string temp = path + "." + std::to_string(::getpid()) + ".tmp";
+  std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ast.for_each_array([&](const auto &items) {
+    write_array(out, std::span(items));
+  });
+  write_array(out, std::span<const FlatRange>(context.externs));
+  write_array(out, std::span<const char>(context.text));
+  out.close();
+  if (!out.fail()) {
+    std::filesystem::rename(temp, path, error);
+  }
+  if (out.fail() || error) {
+    std::filesystem::remove(temp, error);
+    return false;
+  }
+  CLog::FLog(LogLevel::DEBUG, LogCategory::ALL,
+             "Cached %zu bytes of nodes in %s", ast.bytes(), path.c_str());
+  return true;
+}
+
+bool load_program(const std::string &path, uint64_t hash, uint32_t base,
+                  Arena &arena, std::vector<Stmt *> &stmts) {
+  MappedFile file;
+  Header header;
+  if (!file.open(path) || file.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  FlatAstView view;
+  uint32_t arrays = 2;
+  view.for_each_array([&](auto &) { arrays++; });
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.format != kFormat || header.layout != kFlatAstVersion ||
+      header.arrays != arrays || header.source_hash != hash ||
+      header.source_size != SourceManager::get().buffer(base).size()) {
+    return false;
+  }
+
+  ArrayReader reader{file.data() + sizeof(header), file.data() + file.size()};
+  view.for_each_array([&](auto &items) { reader.read(items); });
+  LoadContext context;
+  reader.read(context.externs);
+  reader.read(context.text);
+  if (!reader.ok || reader.arrays != arrays) {
+    return false;
+  }
+  for (auto range : context.externs) {
+    if (range.first > context.text.size() ||
+        range.count > context.text.size() - range.first) {
+      return false;
+    }
+  }
+  context.base = base;
+  context.size = header.source_size;
+  // every node is inflated once, and there are no more nodes than items
+  context.nodes_left = 0;
+  view.for_each_array(
+      [&](auto &items) { context.nodes_left += items.size(); });
+  auto program = inflate(view, arena, context);
+  if (!context.ok) {
+    return false;
+  }
+  stmts = std::move(program);
+  return true;
+}
@@ -1,78 +1,49 @@
 #include "resolver.h"
 #include "ast.h"
 #include "logger.h"
+#include <algorithm>
 
-void Resolver::visit(const Stmt *stmt) {
-  // try to cast this to block
-  if (auto block = dynamic_cast<const Block *>(stmt)) {
-    visit_block(block);
-  }
-  if (auto var = dynamic_cast<const Var *>(stmt)) {
-    visit_var_stmt(var);
-  }
-  if (auto assign = dynamic_cast<const Assign *>(stmt)) {
-    visit_assign(assign);
-  }
-  if (auto f = dynamic_cast<const Function *>(stmt)) {
-    visit_function(f);
-  }
-  if (auto c = dynamic_cast<const Class *>(stmt)) {
-    visit_class(c);
-  }
-  if (auto expr = dynamic_cast<const Expression *>(stmt)) {
-    visit_expr_stmt(expr);
-  }
-  if (auto if_st = dynamic_cast<const If *>(stmt)) {
-    visit_if(if_st);
-  }
-  if (auto prt_st = dynamic_cast<const Print *>(stmt)) {
-    visit_print(prt_st);
-  }
-  if (auto ret_st = dynamic_cast<const Return *>(stmt)) {
-    visit_return(ret_st);
-  }
-  if (auto wh_st = dynamic_cast<const While *>(stmt)) {
-    visit_while(wh_st);
+Resolver::~Resolver() {
+  if (own_arena_) {
+    eval->keep_alive(std::move(own_arena_));
   }
 }
 
-void Resolver::visit(const Expr *expr) {
-  if (auto var_expr = dynamic_cast<const Variable *>(expr)) {
-    visit_var_expr(var_expr);
-  }
-  if (auto assign = dynamic_cast<const Assign *>(expr)) {
-    visit_assign(assign);
+template <typename T>
+std::span<T> Resolver::keep(const std::vector<T> &items) {
+  if (items.empty()) {
+    return {};
   }
-  if (auto binary = dynamic_cast<const Binary *>(expr)) {
-    visit_binary(binary);
-  }
-  if (auto call = dynamic_cast<const Call *>(expr)) {
-    visit_call(call);
-  }
-  if (auto grouping = dynamic_cast<const Grouping *>(expr)) {
-    visit_grouping(grouping);
-  }
-  if (auto literal = dynamic_cast<const Literal *>(expr)) {
-    visit_literal(literal);
-  }
-  if (auto logical = dynamic_cast<const Logical *>(expr)) {
-    visit_logical(logical);
-  }
-  if (auto unary = dynamic_cast<const Unary *>(expr)) {
-    visit_unary(unary);
+  if (arena_ == nullptr) {
+    own_arena_ = std::make_unique<Arena>();
+    arena_ = own_arena_.get();
   }
+  return arena_->copy(items);
 }
 
+void Resolver::visit(const Stmt *stmt) { dispatch<void>(this, stmt); }
+
+void Resolver::visit(const Expr *expr) { dispatch<void>(this, expr); }
+
 void Resolver::visit_block(const Block *block) {
+  // the frame slots of the block are free again after it, the block needs
+  // as many as were in use at once while in it
+  int frame_top = functions_.back().frame_top;
+  int frame_size = functions_.back().frame_size;
+  functions_.back().frame_size = frame_top;
   begin_scope();
   resolve(block->statements);
   end_scope();
+  auto &function = functions_.back();
+  block->frame_size = function.frame_size;
+  function.frame_top = frame_top;
+  function.frame_size = std::max(frame_size, function.frame_size);
 }
 
-bool Resolver::resolve(std::vector<std::shared_ptr<Stmt>> stmts) {
+bool Resolver::resolve(std::span<Stmt *const> stmts) {
   had_error_ = false;
   for (auto stmt : stmts) {
-    resolve(stmt.get());
+    resolve(stmt);
     if (had_error_) {
       return false;
     }
@@ -90,70 +61,129 @@ void Resolver::resolve(const Expr *expr) {
 
 void Resolver::begin_scope() { scopes.emplace_back(); }
 
-void Resolver::end_scope() { scopes.pop_back(); }
+void Resolver::end_scope() {
+  for (auto &[symbol, local] : scopes.back().names) {
+    if (local.captured) {
+      for (int *storage : local.storage) {
+        *storage = kCell;
+      }
+    }
+  }
+  scopes.pop_back();
+}
 
-void Resolver::visit_var_stmt(const Var *var) {
-  declare(var->name.get());
+void Resolver::visit_var(const Var *var) {
+  declare(&var->name, &var->storage, &var->slot);
   if (var->initializer != nullptr) {
-    resolve(var->initializer.get());
+    resolve(var->initializer);
   }
-  define(var->name.get());
+  define(&var->name);
   return;
 }
 
-void Resolver::declare(const Token *name) {
-  if (scopes.empty())
+void Resolver::declare(const Token *name, int *storage, int *slot) {
+  if (scopes.empty()) {
+    if (storage != nullptr) {
+      *storage = kGlobal;
+    }
     return;
-  auto &scope = scopes.back();
-  if (scope.find(name->literal_string) != scope.end()) {
+  }
+  // slots are handed out in the order the names are declared. A name declared
+  // twice still takes one, so the parameters line up with the arguments.
+  auto &function = functions_.back();
+  Local local;
+  local.slot = function.frame_top++;
+  function.frame_size = std::max(function.frame_size, function.frame_top);
+  if (storage != nullptr) {
+    *storage = kStack;
+    *slot = local.slot;
+    local.storage.push_back(storage);
+  }
+  if (!scopes.back().names.emplace(name->symbol, std::move(local)).second) {
     report("Variable with this name already declared in this scope.", "",
-           name->line_no);
+           name->line());
     had_error_ = true;
-    return;
   }
-  scope[name->literal_string] = false;
 }
 
 void Resolver::define(const Token *name) {
   if (scopes.empty())
     return;
-  auto &scope = scopes.back();
-  scope[name->literal_string] = true;
+  auto &names = scopes.back().names;
+  auto it = names.find(name->symbol);
+  if (it != names.end())
+    it->second.defined = true;
 }
 
-void Resolver::visit_var_expr(const Variable *var_expr) {
-  if (!scopes.empty() &&
-      scopes.back().find(var_expr->name->literal_string) !=
-          scopes.back().end() &&
-      scopes.back().at(var_expr->name->literal_string) == false) {
-    report("Cannot read local variable in its own initializer.", "",
-           var_expr->line_no);
-    had_error_ = true;
-    return;
+void Resolver::visit_variable(const Variable *var_expr) {
+  if (!scopes.empty()) {
+    auto &names = scopes.back().names;
+    auto it = names.find(var_expr->name.symbol);
+    if (it != names.end() && !it->second.defined) {
+      report("Cannot read local variable in its own initializer.", "",
+             var_expr->line_no());
+      had_error_ = true;
+      return;
+    }
   }
-  resolve_local(var_expr, var_expr->name->literal_string);
+  resolve_local(var_expr->name, &var_expr->storage, &var_expr->slot);
 }
 
-void Resolver::resolve_local(const Expr *e, const std::string &name) {
+void Resolver::resolve_local(const Token &name, int *storage, int *slot) {
+  *storage = kGlobal;
   for (int i = scopes.size() - 1; i >= 0; i--) {
-    if (scopes[i].find(name) != scopes[i].end()) {
-      eval->resolve(e, scopes.size() - 1 - i);
-      CLog::FLog(LogLevel::DEBUG, LogCategory::RESOLVER,
-                 "Resolved local variable %s at depth %zu at %zu", name.c_str(),
-                 scopes.size() - 1 - i, (size_t)e);
-      return;
+    auto it = scopes[i].names.find(name.symbol);
+    if (it == scopes[i].names.end()) {
+      continue;
+    }
+    Local &local = it->second;
+    size_t current = functions_.size() - 1;
+    size_t owner = current;
+    while (functions_[owner].first_scope > size_t(i)) {
+      owner--;
+    }
+    if (owner == current) {
+      *storage = kStack;
+      *slot = local.slot;
+      local.storage.push_back(storage);
+    } else {
+      local.captured = true;
+      *storage = kUpvalue;
+      *slot = add_upvalue(current, owner, local.slot);
+    }
+    CLog::FLog(LogLevel::DEBUG, LogCategory::RESOLVER,
+               "Resolved local variable %.*s as %d slot %d",
+               (int)name.length, name.lexeme().data(), *storage, *slot);
+    return;
+  }
+}
+
+int Resolver::add_upvalue(size_t function, size_t owner, int slot) {
+  // the function right inside the owner captures the cell from its frame,
+  // the ones further in from the function around them
+  Upvalue upvalue{true, slot};
+  if (function - 1 != owner) {
+    upvalue = {false, add_upvalue(function - 1, owner, slot)};
+  }
+  auto &upvalues = functions_[function].upvalues;
+  for (size_t i = 0; i < upvalues.size(); i++) {
+    if (upvalues[i].local == upvalue.local &&
+        upvalues[i].index == upvalue.index) {
+      return i;
     }
   }
+  upvalues.push_back(upvalue);
+  return upvalues.size() - 1;
 }
 
 void Resolver::visit_assign(const Assign *assign) {
-  resolve(assign->value.get());
-  resolve_local(assign, assign->name->literal_string);
+  resolve(assign->value);
+  resolve_local(assign->name, &assign->storage, &assign->slot);
 }
 
 void Resolver::visit_function(const Function *f) {
-  declare(f->name.get());
-  define(f->name.get());
+  declare(&f->name, &f->storage, &f->slot);
+  define(&f->name);
   resolve_function(f, FunctionType::FUNCTION);
   return;
 }
@@ -161,86 +191,101 @@ void Resolver::visit_function(const Function *f) {
 void Resolver::resolve_function(const Function *f, FunctionType type) {
   FunctionType enclosing_function_type = current_function_type;
   current_function_type = type;
+  // every call gets a frame of its own
+  functions_.push_back(FunctionScope{scopes.size(), 0, 0, {}});
   begin_scope();
-  for (auto param : f->params) {
-    declare(param.get());
-    define(param.get());
+  for (const auto &param : f->params) {
+    declare(&param);
+    define(&param);
   }
   resolve(f->body);
+  // the parameters take the first slots, the captured ones are passed in a
+  // cell
+  std::vector<int> cell_params;
+  for (const auto &[symbol, local] : scopes.back().names) {
+    if (local.captured && local.slot < int(f->params.size())) {
+      cell_params.push_back(local.slot);
+    }
+  }
+  std::sort(cell_params.begin(), cell_params.end());
   end_scope();
+  f->frame_size = functions_.back().frame_size;
+  f->upvalues = keep(functions_.back().upvalues);
+  f->cell_params = keep(cell_params);
+  functions_.pop_back();
 }
 
-void Resolver::visit_expr_stmt(const Expression *expr_stmt) {
-  resolve(expr_stmt->expression.get());
+void Resolver::visit_expression(const Expression *expr_stmt) {
+  resolve(expr_stmt->expression);
   return;
 }
 
 void Resolver::visit_if(const If *if_st) {
-  resolve(if_st->condition.get());
-  resolve(if_st->thenBranch.get());
+  resolve(if_st->condition);
+  resolve(if_st->thenBranch);
   if (if_st->elseBranch != nullptr) {
-    resolve(if_st->elseBranch.get());
+    resolve(if_st->elseBranch);
   }
   return;
 }
 
 void Resolver::visit_print(const Print *prt) {
   for (auto expr : prt->expressions) {
-    resolve(expr.get());
+    resolve(expr);
   }
   return;
 }
 
 void Resolver::visit_return(const Return *ret) {
   if (current_function_type == FunctionType::NONE) {
-    report("Cannot return from top-level code.", "", ret->line_no);
+    report("Cannot return from top-level code.", "", ret->line_no());
     had_error_ = true;
     return;
   }
   if (ret->value != nullptr) {
-    resolve(ret->value.get());
+    resolve(ret->value);
   }
 }
 
 void Resolver::visit_while(const While *wh) {
-  resolve(wh->condition.get());
-  resolve(wh->body.get());
+  resolve(wh->condition);
+  resolve(wh->body);
 }
 
 void Resolver::visit_binary(const Binary *b) {
-  resolve(b->left.get());
-  resolve(b->right.get());
+  resolve(b->left);
+  resolve(b->right);
   return;
 }
 
 void Resolver::visit_call(const Call *c) {
-  resolve(c->callee.get());
+  resolve(c->callee);
   for (auto arg : c->arguments) {
-    resolve(arg.get());
+    resolve(arg);
   }
   return;
 }
 
 void Resolver::visit_grouping(const Grouping *g) {
-  resolve(g->expression.get());
+  resolve(g->expression);
   return;
 }
 
 void Resolver::visit_literal(const Literal *l) { return; }
 
 void Resolver::visit_logical(const Logical *l) {
-  resolve(l->left.get());
-  resolve(l->right.get());
+  resolve(l->left);
+  resolve(l->right);
   return;
 }
 
 void Resolver::visit_unary(const Unary *u) {
-  resolve(u->right.get());
+  resolve(u->right);
   return;
 }
 
 void Resolver::visit_class(const Class *c) {
   // Adds the class to the scope
-  declare(c->name.get());
-  define(c->name.get());
+  declare(&c->name, &c->storage, &c->slot);
+  define(&c->name);
 }
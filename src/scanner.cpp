@@ -1,7 +1,13 @@
 #include "scanner.h"
 #include "logger.h"
+#include "simd_scan.h"
+#include "source.h"
 #include "utils.h"
+#include <array>
+#include <algorithm>
 #include <regex>
+#include <string_view>
+#include <thread>
 
 const static std::vector<std::pair<TokenType, std::regex>> token_to_regex = {
     {LEFT_PAREN, std::regex("\\(")},
@@ -52,36 +58,29 @@ const static std::vector<std::pair<TokenType, std::regex>> token_to_regex = {
 
 };
 
-void static set_value(Token &token) {
-  // sets the literal void pointer to the value of the literal
-  // it is a number or string
-  if (token.token_type_ == NUMBER) {
-    token.literal = new float(atof(token.literal_string.c_str()));
-  } else if (token.token_type_ == STRING) {
-    // strip the quotes
-    token.literal_string =
-        token.literal_string.substr(1, token.literal_string.size() - 2);
-    token.literal = (void *)token.literal_string.c_str();
-  } else if (token.token_type_ == FALSE) {
-    token.literal = new bool(false);
-  } else if (token.token_type_ == TRUE) {
-    token.literal = new bool(true);
-  }
-  return;
+void Scanner::chew_through_whitespace(size_t &idx) {
+  idx += skip_whitespace(source_ + idx, size_ - idx);
 }
 
-void Scanner::chew_through_whitespace(size_t &idx) {
-  while (idx < source_.size() && std::isspace(source_[idx])) {
-    if (source_[idx] == '\n') {
-      current_line_++;
-    }
-    idx++;
+void Scanner::make_token(TokenType type, size_t idx, size_t len, Token &t) {
+  CLog::Log(LogLevel::DEBUG, LogCategory::SCANNER, "Token Found ",
+            token_type_to_str(type), " : ",
+            std::string_view(source_ + idx, len));
+  if (type == STRING) {
+    // strip the quotes
+    t = Token(type, base_ + idx + 1, len - 2);
+    return;
+  }
+  t = Token(type, base_ + idx, len);
+  if (type == NUMBER) {
+    t.number = parse_number(std::string_view(source_ + idx, len));
+  } else if (type == IDENTIFIER && intern_symbols_) {
+    t.symbol = SymbolTable::get().intern(std::string_view(source_ + idx, len));
   }
-  return;
 }
 
-bool Scanner::parse_token(size_t &idx) {
-  char *str_ptr = source_.data() + idx;
+bool Scanner::parse_token(size_t &idx, Token &t) {
+  const char *str_ptr = source_ + idx;
   int max_len = 0;
   std::pair<TokenType, int> longest_match;
   bool found = false;
@@ -97,26 +96,127 @@ bool Scanner::parse_token(size_t &idx) {
     }
   }
   if (found) {
-    CLog::Log(LogLevel::DEBUG, LogCategory::SCANNER, "Token Found ",
-              token_type_to_str(longest_match.first), " : ",
-              std::string(source_, idx, longest_match.second).c_str());
-    // add only non-comment tokens
-    if (longest_match.first != TokenType::SLASH_SLASH) {
-      auto &token = tokens_.emplace_back();
-      token.token_type_ = longest_match.first;
-      token.literal_string = std::string(source_, idx, longest_match.second);
-      set_value(token);
-      token.line_no = current_line_;
-      idx += longest_match.second;
-    } else {
-      // commend line go to end
-      idx += longest_match.second;
-    }
+    make_token(longest_match.first, idx, longest_match.second, t);
+    idx += longest_match.second;
     return true;
   }
   return false;
 }
 
+namespace {
+// Character classes used by the DFA. Every byte of the source is looked up
+// exactly once in this table.
+enum CharClass : uint8_t { OTHER, DIGIT, ALPHA, PUNCT };
+
+constexpr std::array<CharClass, 256> make_char_classes() {
+  std::array<CharClass, 256> classes{};
+  for (int c = '0'; c <= '9'; c++)
+    classes[c] = DIGIT;
+  for (int c = 'a'; c <= 'z'; c++)
+    classes[c] = ALPHA;
+  for (int c = 'A'; c <= 'Z'; c++)
+    classes[c] = ALPHA;
+  classes['_'] = ALPHA;
+  for (unsigned char c : std::string_view("(){},.-+;/*!=<>\""))
+    classes[c] = PUNCT;
+  return classes;
+}
+
+constexpr std::array<CharClass, 256> char_classes = make_char_classes();
+
+// The token a PUNCT character starts. Two character operators and comments
+// are handled by looking at the next character in parse_token_dfa.
+constexpr std::array<TokenType, 256> make_single_char_tokens() {
+  std::array<TokenType, 256> tokens{};
+  tokens['('] = LEFT_PAREN;
+  tokens[')'] = RIGHT_PAREN;
+  tokens['{'] = LEFT_BRACE;
+  tokens['}'] = RIGHT_BRACE;
+  tokens[','] = COMMA;
+  tokens['.'] = DOT;
+  tokens['-'] = MINUS;
+  tokens['+'] = PLUS;
+  tokens[';'] = SEMICOLON;
+  tokens['/'] = SLASH;
+  tokens['*'] = STAR;
+  tokens['!'] = BANG;
+  tokens['='] = EQUAL;
+  tokens['>'] = GREATER;
+  tokens['<'] = LESS;
+  tokens['"'] = STRING;
+  return tokens;
+}
+
+constexpr std::array<TokenType, 256> single_char_tokens =
+    make_single_char_tokens();
+
+inline CharClass classify(char c) { return char_classes[(unsigned char)c]; }
+
+inline bool is_ident_char(char c) {
+  CharClass cls = classify(c);
+  return cls == ALPHA || cls == DIGIT;
+}
+} // namespace
+
+bool Scanner::parse_token_dfa(size_t &idx, Token &t) {
+  // The accepted language mirrors token_to_regex exactly, quirks included:
+  // comments stop at '(' and ')' as well as at a newline, and strings may
+  // not contain parentheses. The '\0' checks mirror regex_search stopping
+  // at the terminator of the c string.
+  const char *src = source_;
+  const size_t n = size_;
+  size_t end = idx;
+  TokenType type;
+  char c = src[idx];
+  switch (classify(c)) {
+  case DIGIT: {
+    while (classify(src[end]) == DIGIT)
+      end++;
+    // a fraction is only consumed if a digit follows the dot
+    while (src[end] == '.' && classify(src[end + 1]) == DIGIT) {
+      end++;
+      while (classify(src[end]) == DIGIT)
+        end++;
+    }
+    type = NUMBER;
+    break;
+  }
+  case ALPHA: {
+    while (is_ident_char(src[end]))
+      end++;
+    type = keyword_type(std::string_view(src + idx, end - idx));
+    break;
+  }
+  case PUNCT: {
+    end++;
+    type = single_char_tokens[(unsigned char)c];
+    if (c == '!' || c == '=' || c == '<' || c == '>') {
+      // the one character operator is followed by the two character form
+      // in TokenType, e.g. BANG and BANG_EQUAL
+      if (src[end] == '=') {
+        type = TokenType(type + 1);
+        end++;
+      }
+    } else if (c == '/' && src[end] == '/') {
+      end++;
+      end += find_comment_end(src + end, n - end);
+      type = SLASH_SLASH;
+    } else if (c == '"') {
+      end += find_string_end(src + end, n - end);
+      if (end >= n || src[end] != '"')
+        return false;
+      end++;
+    }
+    break;
+  }
+  default:
+    return false;
+  }
+  make_token(type, idx, end - idx, t);
+  idx = end;
+  return true;
+}
+
 bool Scanner::scan() {
   // while the tape is not fully consumed
   //  1. chew through all the white space
@@ -125,26 +225,227 @@ bool Scanner::scan() {
   //  4. the last matched token is the value for the latest token
   //  5. If this is end of string then EOF
   //  6. go to step 1
-  //  7. Also keep track of the line number by counting the number of new lines
-  size_t idx = 0;
+  Token t;
+  while (next_token(t)) {
+    tokens_.push_back(t);
+    if (t.token_type_ == END_OF_FILE)
+      return true;
+  }
+  return false;
+}
+
+namespace {
+// Chunks smaller than this are not worth a thread of their own.
+constexpr size_t kMinChunkSize = 64 * 1024;
+} // namespace
+
+size_t Scanner::find_split(size_t from) const {
+  // Whether a newline is inside a STRING literal depends on everything before
+  // it, but parentheses can appear in neither strings nor comments, so every
+  // parenthesis is a token of its own and the lexer state right after it is
+  // known. Walk forward from the next parenthesis to a newline that is not
+  // inside a string. If the source does not lex, the guess may be wrong, but
+  // then some chunk fails to lex and scan() redoes the work serially.
+  const char *p = source_;
+  while (from < size_ && p[from] != '(' && p[from] != ')')
+    from++;
+  enum { CODE, STRING, COMMENT } state = CODE;
+  for (size_t i = from + 1; i < size_; i++) {
+    char c = p[i];
+    if (state == STRING) {
+      if (c == '"')
+        state = CODE;
+    } else if (c == '\n') {
+      return i + 1;
+    } else if (state == COMMENT) {
+      if (c == '(' || c == ')')
+        state = CODE;
+    } else if (c == '"') {
+      state = STRING;
+    } else if (c == '/' && p[i + 1] == '/') {
+      state = COMMENT;
+    }
+  }
+  return size_;
+}
+
+bool Scanner::scan(unsigned threads) {
+  threads = std::min<size_t>(threads, size_ / kMinChunkSize);
+  if (threads <= 1 || mode_ != Mode::DFA)
+    return scan();
+
+  std::vector<size_t> splits = {idx_};
+  for (unsigned i = 1; i < threads; i++) {
+    size_t target = std::max(splits.back(), idx_ + size_ * i / threads);
+    splits.push_back(find_split(target));
+  }
+  splits.push_back(size_);
+
+  // Each chunk is lexed by its own scanner over the same buffer, so the
+  // tokens come out exactly as a serial scan makes them.
+  std::vector<Scanner> chunks(splits.size() - 1);
+  // one byte per chunk, a vector<bool> would pack them into shared words
+  std::vector<char> ok(chunks.size());
+  auto lex_chunk = [&](size_t i) {
+    Scanner &chunk = chunks[i];
+    chunk.source_ = source_;
+    chunk.base_ = base_;
+    chunk.mode_ = mode_;
+    chunk.idx_ = splits[i];
+    chunk.size_ = splits[i + 1];
+    chunk.report_errors_ = false;
+    chunk.intern_symbols_ = false;
+    ok[i] = chunk.scan();
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks.size(); i++)
+    workers.emplace_back(lex_chunk, i);
+  lex_chunk(0);
+  for (auto &worker : workers)
+    worker.join();
+
+  size_t total = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (!ok[i])
+      return scan();
+    total += chunks[i].tokens_.size() - 1;
+  }
+  tokens_.reserve(tokens_.size() + total + 1);
+  for (auto &chunk : chunks) {
+    // drop the END_OF_FILE each chunk ends with
+    chunk.tokens_.pop_back();
+    for (auto &t : chunk.tokens_) {
+      if (t.token_type_ == IDENTIFIER)
+        t.symbol = SymbolTable::get().intern(
+            std::string_view(source_ + t.offset - base_, t.length));
+    }
+    tokens_.insert(tokens_.end(), chunk.tokens_.begin(), chunk.tokens_.end());
+  }
+  idx_ = size_;
+  tokens_.push_back(Token(END_OF_FILE, base_ + size_, 0));
+  return true;
+}
+
+namespace {
+// the source range a token was lexed from, quotes of STRINGs included
+uint32_t token_start(const Token &t) {
+  return t.token_type_ == STRING ? t.offset - 1 : t.offset;
+}
+
+uint32_t token_end(const Token &t) {
+  return t.token_type_ == STRING ? t.offset + t.length + 1
+                                 : t.offset + t.length;
+}
+} // namespace
+
+bool Scanner::relex(const Edit &edit) {
+  if (edit.offset > size_ || edit.removed > size_ - edit.offset) {
+    return false;
+  }
+  std::string_view old_source(source_, size_);
+  std::string source;
+  source.reserve(size_ - edit.removed + edit.inserted.size());
+  source.append(old_source.substr(0, edit.offset));
+  source.append(edit.inserted);
+  source.append(old_source.substr(edit.offset + edit.removed));
+  // Releasing first lets the edited source take over the old offsets when
+  // the old buffer was the last one added, which is the common case.
+  const uint32_t old_base = base_;
+  std::vector<Token> old_tokens = std::move(tokens_);
+  SourceManager::get().release(old_base);
+  init(SourceManager::get().add(std::move(source)), mode_);
+
+  // The lexer looks at most two bytes past the end of a token, for the
+  // fraction of a NUMBER, so tokens ending before that are left untouched.
+  auto first_damaged = std::partition_point(
+      old_tokens.begin(), old_tokens.end(), [&](const Token &t) {
+        return t.token_type_ != END_OF_FILE &&
+               token_end(t) - old_base + 2 <= edit.offset;
+      });
+  size_t kept = first_damaged - old_tokens.begin();
+  tokens_.reserve(old_tokens.size() + edit.inserted.size());
+  for (size_t i = 0; i < kept; i++) {
+    Token t = old_tokens[i];
+    t.offset = t.offset - old_base + base_;
+    tokens_.push_back(t);
+  }
+  if (kept > 0)
+    idx_ = token_end(tokens_.back()) - base_;
+
+  // Past the edit the old and the new source are the same text, so once a
+  // token starts where an old token started, the lexer would reproduce the
+  // old tokens from there on.
+  const size_t edit_end = edit.offset + edit.inserted.size();
+  const uint32_t shift = base_ - old_base + edit.inserted.size() - edit.removed;
+  size_t old = kept;
+  relexed_ = 0;
+  Token t;
+  while (next_token(t)) {
+    uint32_t start = token_start(t) - base_;
+    if (start >= edit_end) {
+      while (old < old_tokens.size() &&
+             token_start(old_tokens[old]) + shift < token_start(t))
+        old++;
+      if (old < old_tokens.size() &&
+          token_start(old_tokens[old]) + shift == token_start(t)) {
+        for (; old < old_tokens.size(); old++) {
+          Token moved = old_tokens[old];
+          moved.offset += shift;
+          tokens_.push_back(moved);
+        }
+        idx_ = size_;
+        return true;
+      }
+    }
+    tokens_.push_back(t);
+    relexed_++;
+    if (t.token_type_ == END_OF_FILE)
+      return true;
+  }
+  return false;
+}
+
+bool Scanner::next_token(Token &t) {
+  if (had_error_) {
+    return false;
+  }
   while (true) {
-    chew_through_whitespace(idx);
-    if (idx >= source_.size())
-      break;
-    bool ret = parse_token(idx);
+    chew_through_whitespace(idx_);
+    if (idx_ >= size_) {
+      t = Token(END_OF_FILE, base_ + size_, 0);
+      return true;
+    }
+    bool ret = mode_ == Mode::DFA ? parse_token_dfa(idx_, t)
+                                  : parse_token(idx_, t);
     if (!ret) {
       // TODO report error
-      report("Code could not be parsed at " + std::to_string(idx), "", 0);
+      if (report_errors_)
+        report("Code could not be parsed at " + std::to_string(idx_), "", 0);
+      had_error_ = true;
       return false;
     }
-    if (idx >= source_.size())
-      break;
+    // comments are not handed out
+    if (t.token_type_ != SLASH_SLASH)
+      return true;
   }
-  tokens_.push_back(Token(END_OF_FILE, "", nullptr, 0));
-  return true;
 }
 
-void Scanner::init(const std::string &source) {
-  source_ = source;
+void Scanner::seek(uint32_t offset) {
+  idx_ = offset - base_;
+  had_error_ = false;
+}
+
+void Scanner::init(const std::string &source, Mode mode) {
+  init(SourceManager::get().add(source), mode);
+}
+
+void Scanner::init(uint32_t base, Mode mode) {
+  std::string_view source = SourceManager::get().buffer(base);
+  base_ = base;
+  source_ = source.data();
+  size_ = source.size();
+  mode_ = mode;
+  idx_ = 0;
+  had_error_ = false;
   tokens_.clear();
 }
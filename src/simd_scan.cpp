@@ -0,0 +1,229 @@
+#include "simd_scan.h"
+#include <cstdint>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOX_SIMD_X86 1
+#endif
+
+namespace {
+
+inline bool is_space(char c) {
+  return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// Matches the terminators of a comment (t0 = '\n') or a string (t0 = '"').
+inline bool is_terminator(char c, char t0) {
+  return c == t0 || c == '(' || c == ')' || c == '\0';
+}
+
+size_t skip_whitespace_scalar(const char *p, size_t n) {
+  size_t i = 0;
+  while (i < n && is_space(p[i]))
+    i++;
+  return i;
+}
+
+size_t find_terminator_scalar(const char *p, size_t n, char t0) {
+  size_t i = 0;
+  while (i < n && !is_terminator(p[i], t0))
+    i++;
+  return i;
+}
+
+void find_newlines_scalar(const char *p, size_t n, uint32_t base,
+                          std::vector<uint32_t> &newlines) {
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] == '\n')
+      newlines.push_back(base + i);
+  }
+}
+
+#ifdef LOX_SIMD_X86
+
+// The whitespace characters are ' ' and the contiguous range '\t'..'\r', so a
+// byte is whitespace iff it equals ' ' or (c - '\t') <= 4 as an unsigned byte.
+size_t skip_whitespace_sse2(const char *p, size_t n) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i range = _mm_set1_epi8('\r' - '\t');
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i t = _mm_sub_epi8(x, tab);
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(x, space),
+                              _mm_cmpeq_epi8(_mm_min_epu8(t, range), t));
+    uint32_t ws_mask = _mm_movemask_epi8(ws);
+    if (ws_mask != 0xFFFF) {
+      return i + __builtin_ctz(~ws_mask);
+    }
+  }
+  return i + skip_whitespace_scalar(p + i, n - i);
+}
+
+size_t find_terminator_sse2(const char *p, size_t n, char t0) {
+  const __m128i c0 = _mm_set1_epi8(t0);
+  const __m128i c1 = _mm_set1_epi8('(');
+  const __m128i c2 = _mm_set1_epi8(')');
+  const __m128i c3 = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, c0), _mm_cmpeq_epi8(x, c1)),
+        _mm_or_si128(_mm_cmpeq_epi8(x, c2), _mm_cmpeq_epi8(x, c3)));
+    uint32_t mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + find_terminator_scalar(p + i, n - i, t0);
+}
+
+void find_newlines_sse2(const char *p, size_t n, uint32_t base,
+                        std::vector<uint32_t> &newlines) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, nl));
+    for (; mask != 0; mask &= mask - 1)
+      newlines.push_back(base + i + __builtin_ctz(mask));
+  }
+  find_newlines_scalar(p + i, n - i, base + i, newlines);
+}
+
+__attribute__((target("avx2"))) size_t
+skip_whitespace_avx2(const char *p, size_t n) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i range = _mm256_set1_epi8('\r' - '\t');
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i t = _mm256_sub_epi8(x, tab);
+    __m256i ws =
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, space),
+                        _mm256_cmpeq_epi8(_mm256_min_epu8(t, range), t));
+    uint32_t ws_mask = _mm256_movemask_epi8(ws);
+    if (ws_mask != 0xFFFFFFFF) {
+      return i + __builtin_ctz(~ws_mask);
+    }
+  }
+  return i + skip_whitespace_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) size_t
+find_terminator_avx2(const char *p, size_t n, char t0) {
+  const __m256i c0 = _mm256_set1_epi8(t0);
+  const __m256i c1 = _mm256_set1_epi8('(');
+  const __m256i c2 = _mm256_set1_epi8(')');
+  const __m256i c3 = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i hit = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, c0), _mm256_cmpeq_epi8(x, c1)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, c2), _mm256_cmpeq_epi8(x, c3)));
+    uint32_t mask = _mm256_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + find_terminator_sse2(p + i, n - i, t0);
+}
+
+__attribute__((target("avx2"))) void
+find_newlines_avx2(const char *p, size_t n, uint32_t base,
+                   std::vector<uint32_t> &newlines) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, nl));
+    for (; mask != 0; mask &= mask - 1)
+      newlines.push_back(base + i + __builtin_ctz(mask));
+  }
+  find_newlines_sse2(p + i, n - i, base + i, newlines);
+}
+
+#endif
+
+struct ScanImpl {
+  size_t (*skip_whitespace)(const char *, size_t);
+  size_t (*find_terminator)(const char *, size_t, char);
+  void (*find_newlines)(const char *, size_t, uint32_t,
+                        std::vector<uint32_t> &);
+  const char *name;
+};
+
+// Every implementation in this build, widest first.
+const ScanImpl kImpls[] = {
+#ifdef LOX_SIMD_X86
+    {skip_whitespace_avx2, find_terminator_avx2, find_newlines_avx2, "avx2"},
+    {skip_whitespace_sse2, find_terminator_sse2, find_newlines_sse2, "sse2"},
+#endif
+    {skip_whitespace_scalar, find_terminator_scalar, find_newlines_scalar,
+     "scalar"},
+};
+
+bool cpu_supports(const ScanImpl &impl) {
+#ifdef LOX_SIMD_X86
+  __builtin_cpu_init();
+  if (impl.skip_whitespace == skip_whitespace_avx2) {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (impl.skip_whitespace == skip_whitespace_sse2) {
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return true;
+}
+
+const ScanImpl *pick_impl() {
+  for (const ScanImpl &impl : kImpls) {
+    if (cpu_supports(impl)) {
+      return &impl;
+    }
+  }
+  return nullptr;
+}
+
+const ScanImpl *&current() {
+  static const ScanImpl *impl = pick_impl();
+  return impl;
+}
+
+const ScanImpl &impl() { return *current(); }
+
+} // namespace
+
+size_t skip_whitespace(const char *p, size_t n) {
+  return impl().skip_whitespace(p, n);
+}
+
+size_t find_comment_end(const char *p, size_t n) {
+  return impl().find_terminator(p, n, '\n');
+}
+
+size_t find_string_end(const char *p, size_t n) {
+  return impl().find_terminator(p, n, '"');
+}
+
+const char *simd_scan_impl() { return impl().name; }
+
+bool set_simd_scan_impl(std::string_view name) {
+  for (const ScanImpl &impl : kImpls) {
+    if (impl.name == name && cpu_supports(impl)) {
+      current() = &impl;
+      return true;
+    }
+  }
+  return false;
+}
+
+void find_newlines(const char *p, size_t n, uint32_t base,
+                   std::vector<uint32_t> &newlines) {
+  impl().find_newlines(p, n, base, newlines);
+}
@@ -0,0 +1,124 @@
+#include "source.h"
+#include "logger.h"
+#include "simd_scan.h"
+#include <algorithm>
+#include <limits>
+
+SourceManager &SourceManager::get() {
+  static SourceManager instance;
+  return instance;
+}
+
+uint32_t SourceManager::reserve(size_t size) {
+  // leave one offset free after every buffer so that the end of a buffer
+  // (where END_OF_FILE points) never aliases the start of the next one
+  if (size + 1 > std::numeric_limits<uint32_t>::max() - next_base_) {
+    CLog::FLog(LogLevel::ERROR, LogCategory::ALL,
+               "Source offset space exhausted while adding %zu bytes", size);
+    exit(-1);
+  }
+  uint32_t base = next_base_;
+  next_base_ += size + 1;
+  return base;
+}
+
+uint32_t SourceManager::add(std::string contents) {
+  auto owned = std::make_shared<const std::string>(std::move(contents));
+  return add_view(owned->c_str(), owned->size(), owned);
+}
+
+uint32_t SourceManager::add_view(const char *data, size_t size,
+                                 std::shared_ptr<const void> owner) {
+  uint32_t base = reserve(size);
+  buffers_.push_back(
+      Buffer{base, (uint32_t)size, data, std::move(owner), {}, false});
+  return base;
+}
+
+uint32_t SourceManager::intern(std::string_view text) {
+  auto it = interned_.find(std::string(text));
+  if (it != interned_.end()) {
+    return it->second;
+  }
+  uint32_t base = add(std::string(text));
+  interned_.emplace(std::string(text), base);
+  return base;
+}
+
+void SourceManager::release(uint32_t base) {
+  auto it = std::lower_bound(
+      buffers_.begin(), buffers_.end(), base,
+      [](const Buffer &b, uint32_t offset) { return b.base < offset; });
+  if (it == buffers_.end() || it->base != base) {
+    return;
+  }
+  buffers_.erase(it);
+  // give the offsets after the last buffer back, so that repeatedly adding
+  // and releasing a source does not exhaust the offset space
+  next_base_ =
+      buffers_.empty() ? 0 : buffers_.back().base + buffers_.back().size + 1;
+}
+
+const SourceManager::Buffer *SourceManager::find(uint32_t offset) const {
+  // the most recently added buffer is by far the most likely one
+  const Buffer *b = nullptr;
+  if (!buffers_.empty() && buffers_.back().base <= offset) {
+    b = &buffers_.back();
+  } else {
+    auto it = std::upper_bound(
+        buffers_.begin(), buffers_.end(), offset,
+        [](uint32_t offset, const Buffer &b) { return offset < b.base; });
+    if (it == buffers_.begin()) {
+      return nullptr;
+    }
+    b = &*(it - 1);
+  }
+  // offsets between buffers belonged to ones that were released, the '\0'
+  // after a buffer still counts
+  return offset - b->base <= b->size ? b : nullptr;
+}
+
+const char *SourceManager::data(uint32_t offset) const {
+  const Buffer *b = find(offset);
+  if (b == nullptr || b->data == nullptr) {
+    return nullptr;
+  }
+  return b->data + (offset - b->base);
+}
+
+std::string_view SourceManager::buffer(uint32_t base) const {
+  const Buffer *b = find(base);
+  if (b == nullptr || b->data == nullptr || b->base != base) {
+    return {};
+  }
+  return std::string_view(b->data, b->size);
+}
+
+uint32_t SourceManager::base_of(uint32_t offset) const {
+  const Buffer *b = find(offset);
+  return b == nullptr ? 0 : b->base;
+}
+
+std::string_view SourceManager::text(uint32_t offset, uint32_t length) const {
+  const char *p = data(offset);
+  if (p == nullptr) {
+    return {};
+  }
+  return std::string_view(p, length);
+}
+
+SourceManager::Position SourceManager::position(uint32_t offset) const {
+  const Buffer *b = find(offset);
+  if (b == nullptr || b->data == nullptr) {
+    return {0, 0};
+  }
+  if (!b->indexed) {
+    find_newlines(b->data, b->size, b->base, b->newlines);
+    b->indexed = true;
+  }
+  // a newline belongs to the line it ends
+  auto it = std::lower_bound(b->newlines.begin(), b->newlines.end(), offset);
+  int line = it - b->newlines.begin();
+  uint32_t line_start = line == 0 ? b->base : b->newlines[line - 1] + 1;
+  return {line, (int)(offset - line_start)};
+}
@@ -0,0 +1,22 @@
+#include "symbol.h"
+
+SymbolTable &SymbolTable::get() {
+  static SymbolTable instance;
+  return instance;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  Symbol id = names_.size();
+  it = ids_.emplace(std::string(name), id).first;
+  names_.push_back(&it->first);
+  return id;
+}
+
+Symbol SymbolTable::find(std::string_view name) const {
+  auto it = ids_.find(name);
+  return it == ids_.end() ? kNone : it->second;
+}
@@ -1,4 +1,30 @@
 #include "token.h"
+#include "source.h"
+#include <array>
+#include <charconv>
+#include <cstring>
+
+Token::Token(TokenType t, std::string_view text)
+    : offset(SourceManager::get().intern(text)), length(text.size()),
+      token_type_(t) {
+  if (t == NUMBER) {
+    number = parse_number(text);
+  } else if (t == IDENTIFIER) {
+    symbol = SymbolTable::get().intern(text);
+  }
+}
+
+std::string_view Token::lexeme() const {
+  return SourceManager::get().text(offset, length);
+}
+
+int Token::line() const { return SourceManager::get().position(offset).line; }
+
+float parse_number(std::string_view text) {
+  double value = 0;
+  std::from_chars(text.data(), text.data() + text.size(), value);
+  return value;
+}
 
 #define CASE_FN(x)                                                             \
   case x:                                                                      \
@@ -56,3 +82,60 @@ std::string token_type_to_str(TokenType t) {
   }
   return "";
 }
+
+namespace {
+struct Keyword {
+  std::string_view spelling;
+  TokenType type;
+};
+
+constexpr Keyword keywords[] = {
+    {"and", AND},   {"class", CLASS}, {"else", ELSE},     {"false", FALSE},
+    {"fun", FUN},   {"for", FOR},     {"if", IF},         {"nil", NIL},
+    {"or", OR},     {"print", PRINT}, {"return", RETURN}, {"super", SUPER},
+    {"this", THIS}, {"true", TRUE},   {"var", VAR},       {"while", WHILE},
+};
+
+// (first + 5 * last + length) mod 32 happens to be collision free over the
+// reserved words, so a keyword is identified by one table load, a length
+// compare and a memcmp. The static_assert below re-checks this whenever the
+// keyword list changes.
+constexpr size_t kKeywordTableSize = 32;
+
+constexpr size_t keyword_hash(std::string_view word) {
+  return ((unsigned char)word.front() + 5 * (unsigned char)word.back() +
+          word.size()) %
+         kKeywordTableSize;
+}
+
+constexpr std::array<Keyword, kKeywordTableSize> make_keyword_table() {
+  std::array<Keyword, kKeywordTableSize> table{};
+  for (const auto &kw : keywords) {
+    table[keyword_hash(kw.spelling)] = kw;
+  }
+  return table;
+}
+
+constexpr std::array<Keyword, kKeywordTableSize> keyword_table =
+    make_keyword_table();
+
+constexpr bool keyword_table_is_perfect() {
+  for (const auto &kw : keywords) {
+    if (keyword_table[keyword_hash(kw.spelling)].spelling != kw.spelling)
+      return false;
+  }
+  return true;
+}
+static_assert(keyword_table_is_perfect(),
+              "keyword_hash has collisions, pick new multipliers");
+} // namespace
+
+TokenType keyword_type(std::string_view word) {
+  if (word.size() < 2 || word.size() > 6)
+    return IDENTIFIER;
+  const Keyword &kw = keyword_table[keyword_hash(word)];
+  if (kw.spelling.size() == word.size() &&
+      std::memcmp(kw.spelling.data(), word.data(), word.size()) == 0)
+    return kw.type;
+  return IDENTIFIER;
+}
@@ -2,31 +2,82 @@
 #include "stringbuffer.h"
 #include "utils.h"
 #include <cassert>
+#include <cctype>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
 
 namespace fs = std::filesystem;
 
-void generate_base_ast(std::string &ast_code, const std::string &class_name) {
+// Name of the class a rule like "Binary => Expr* left, ..." declares.
+std::string rule_class_name(const std::string &rule) {
+  auto rule_split = split(rule, "=>");
+  assert(rule_split.size() == 2);
+  trim(rule_split[0]);
+  return rule_split[0];
+}
+
+// Binary -> binary, used to name the visit_ method a node dispatches to.
+std::string to_snake_case(const std::string &name) {
+  std::string result;
+  for (size_t i = 0; i < name.size(); i++) {
+    if (isupper(name[i])) {
+      if (i != 0) {
+        result += '_';
+      }
+      result += static_cast<char>(tolower(name[i]));
+    } else {
+      result += name[i];
+    }
+  }
+  return result;
+}
+
+void generate_base_ast(std::string &ast_code, const std::string &class_name,
+                       const std::vector<std::string> &kinds) {
   StringBuffer buffer;
   buffer.write_line("class %s{", class_name.c_str());
   buffer.increase_indent();
   buffer.write_line("public:");
   buffer.increase_indent();
-  buffer.write_line("size_t line_no = 0;");
+  // the tag replaces RTTI, nodes are told apart with a switch over it
+  buffer.write_line("enum class Kind : uint8_t {");
+  buffer.increase_indent();
+  for (const auto &kind : kinds) {
+    buffer.write_line("%s,", kind.c_str());
+  }
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("const Kind kind;");
+  buffer.write_line("// position in the SourceManager, the line is looked up "
+                    "on demand");
+  buffer.write_line("uint32_t offset = 0;");
+  buffer.write_line("explicit %s(Kind kind) : kind(kind) {}",
+                    class_name.c_str());
+  buffer.write_line("int line_no() const {");
+  buffer.increase_indent();
+  buffer.write_line("return SourceManager::get().position(offset).line;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
   buffer.write_line("template <typename T, typename V>");
   buffer.write_line("T accept(V v) const {");
   buffer.increase_indent();
   buffer.write_line("return v->visit(this);");
   buffer.decrease_indent();
   buffer.write_line("}");
-  buffer.write_line("virtual std::string print_type() {");
+  buffer.write_line("std::string print_type() const {");
   buffer.increase_indent();
-  buffer.write_line("return \"Expr\";");
+  buffer.write_line("switch (kind) {");
+  for (const auto &kind : kinds) {
+    buffer.write_line("case Kind::%s:", kind.c_str());
+    buffer.increase_indent();
+    buffer.write_line("return \"%s\";", kind.c_str());
+    buffer.decrease_indent();
+  }
+  buffer.write_line("}");
+  buffer.write_line("return \"%s\";", class_name.c_str());
   buffer.decrease_indent();
   buffer.write_line("}");
-  buffer.write_line("virtual ~%s() {} ", class_name.c_str());
   buffer.decrease_indent();
   buffer.decrease_indent();
   buffer.decrease_indent();
@@ -35,21 +86,50 @@ void generate_base_ast(std::string &ast_code, const std::string &class_name) {
   buffer.get_contents(ast_code);
 }
 
-void generate_ast(const std::string &rule, const std::string &base_name,
-                  std::string &ast_code) {
-  // get the class name
+// Emits dispatch(visitor, node), which calls visitor->visit_<kind>(node) with
+// node cast to its concrete type.
+void generate_dispatch(std::string &ast_code, const std::string &base_name,
+                       const std::vector<std::string> &kinds) {
+  StringBuffer buffer;
+  buffer.write_line("template <typename R, typename V>");
+  buffer.write_line("R dispatch(V *visitor, const %s *node) {",
+                    base_name.c_str());
+  buffer.increase_indent();
+  buffer.write_line("switch (node->kind) {");
+  for (const auto &kind : kinds) {
+    buffer.write_line("case %s::Kind::%s:", base_name.c_str(), kind.c_str());
+    buffer.increase_indent();
+    buffer.write_line("return visitor->visit_%s("
+                      "static_cast<const %s *>(node));",
+                      to_snake_case(kind).c_str(), kind.c_str());
+    buffer.decrease_indent();
+  }
+  buffer.write_line("}");
+  buffer.write_line("return R();");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+  buffer.get_contents(ast_code);
+}
+
+using Components = std::vector<std::pair<std::string, std::string>>;
+
+// The typed fields of a rule, e.g. {"Expr*", "left"}. Fields that passes
+// after the parser fill in, like the slots the resolver hands out, are
+// declared `mutable` so they can be set on a const node.
+Components rule_components(const std::string &rule) {
   auto rule_split = split(rule, "=>");
   assert(rule_split.size() == 2);
-  for (auto &item : rule_split) {
-    trim(item);
-  }
-  std::string class_name = rule_split[0];
   rule_split = split(rule_split[1], ",");
   assert(!rule_split.empty());
-  std::vector<std::pair<std::string, std::string>> components;
+  Components components;
   for (auto &item : rule_split) {
     trim(item);
     auto item_split = split(item, " ");
+    if (item_split.size() == 3 && item_split[0] == "mutable") {
+      item_split.erase(item_split.begin());
+      item_split[0] = "mutable " + item_split[0];
+    }
     assert(item_split.size() == 2);
     auto &type = item_split[0];
     trim(type);
@@ -59,6 +139,13 @@ void generate_ast(const std::string &rule, const std::string &base_name,
     assert(!name.empty());
     components.push_back({type, name});
   }
+  return components;
+}
+
+void generate_ast(const std::string &rule, const std::string &base_name,
+                  std::string &ast_code) {
+  std::string class_name = rule_class_name(rule);
+  Components components = rule_components(rule);
 
   StringBuffer buffer;
   buffer.write_line("class %s : public %s {", class_name.c_str(),
@@ -66,28 +153,24 @@ void generate_ast(const std::string &rule, const std::string &base_name,
   buffer.increase_indent();
   buffer.write_line("public:");
   buffer.increase_indent();
+  // nodes live in an arena, children are not owned and are never deleted
   for (const auto &item : components) {
-    buffer.write_line("%s %s;", item.first.c_str(), item.second.c_str());
+    buffer.write_line("%s %s{};", item.first.c_str(), item.second.c_str());
   }
-  buffer.write_line("virtual std::string print_type() {");
-  buffer.increase_indent();
-  buffer.write_line("return \"%s\";", class_name.c_str());
-  buffer.decrease_indent();
-  buffer.write_line("}");
-  buffer.write_line("");
-  buffer.write_line("~%s() {", class_name.c_str());
+  buffer.write_line("%s() : %s(Kind::%s) {}", class_name.c_str(),
+                    base_name.c_str(), class_name.c_str());
+  buffer.write_line("static bool classof(const %s *node) {",
+                    base_name.c_str());
   buffer.increase_indent();
-  for (const auto &item : components) {
-    if (*(item.first.rbegin()) == '*') {
-      buffer.write_line("delete %s;", item.second.c_str());
-    }
-  }
+  buffer.write_line("return node->kind == Kind::%s;", class_name.c_str());
   buffer.decrease_indent();
   buffer.write_line("}");
   buffer.decrease_indent();
   buffer.decrease_indent();
   buffer.decrease_indent();
   buffer.write_line("};");
+  buffer.write_line("static_assert(std::is_trivially_destructible_v<%s>);",
+                    class_name.c_str());
   buffer.write_line("%s", "");
   buffer.get_contents(ast_code);
 }
@@ -96,8 +179,29 @@ void generate_preamble(std::string &code) {
   StringBuffer buffer;
   buffer.write_line("#pragma once");
   buffer.write_line("#include \"utils.h\"");
+  buffer.write_line("#include \"source.h\"");
+  buffer.write_line("#include \"storage.h\"");
   buffer.write_line("#include \"token.h\"");
+  buffer.write_line("#include <span>");
+  buffer.write_line("#include <type_traits>");
+  buffer.write_line("#include <vector>");
   buffer.write_line("%s", "");
+  // checked downcasts on the kind tag, the project builds without RTTI
+  buffer.write_line("template <typename T, typename B>");
+  buffer.write_line("bool isa(const B *node) {");
+  buffer.increase_indent();
+  buffer.write_line("return node != nullptr && T::classof(node);");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+  buffer.write_line("template <typename T, typename B>");
+  buffer.write_line("auto dyn_cast(B *node) {");
+  buffer.increase_indent();
+  buffer.write_line("using R = std::conditional_t<std::is_const_v<B>, const T, "
+                    "T>;");
+  buffer.write_line("return isa<T>(node) ? static_cast<R *>(node) : nullptr;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
   buffer.write_line("%s", "");
   buffer.get_contents(code);
   return;
@@ -108,7 +212,513 @@ bool write_code(std::ofstream &ofs, const std::string &ast_code) {
   return true;
 }
 
-bool generate_code(std::ofstream &ofs, const std::string file_contents) {
+// A grammar section, e.g. the Expr base class and its rules.
+struct Section {
+  std::string basename;
+  std::vector<std::string> rules;
+  std::vector<std::string> kinds;
+};
+
+// How a field of a node is stored in the flat AST: children become 32 bit
+// references, lists become a range of a list vector, the rest is copied.
+struct FlatField {
+  enum class Shape { NODE, LIST, VALUE } shape;
+  // type the field has in the flat node
+  std::string type;
+  // for a LIST, the vector its items are stored in and the item types in the
+  // flat and in the pointer AST
+  std::string list;
+  std::string flat_item;
+  std::string item;
+};
+
+FlatField flat_field(std::string type) {
+  FlatField field;
+  const std::string qualifier = "mutable ";
+  if (type.compare(0, qualifier.size(), qualifier) == 0) {
+    type.erase(0, qualifier.size());
+  }
+  const std::string span = "std::span<";
+  if (type.back() == '*') {
+    field.shape = FlatField::Shape::NODE;
+    field.type = type.substr(0, type.size() - 1) + "Ref";
+  } else if (type.compare(0, span.size(), span) == 0) {
+    field.shape = FlatField::Shape::LIST;
+    field.type = "FlatRange";
+    field.item = type.substr(span.size(), type.size() - span.size() - 1);
+    std::string name = field.item;
+    field.flat_item = field.item;
+    if (name.back() == '*') {
+      name.pop_back();
+      field.flat_item = name + "Ref";
+    }
+    field.list = to_snake_case(name) + "_lists";
+  } else {
+    field.shape = FlatField::Shape::VALUE;
+    field.type = type;
+  }
+  return field;
+}
+
+void generate_flat_preamble(StringBuffer &buffer) {
+  buffer.write_line("#pragma once");
+  buffer.write_line("#include \"arena.h\"");
+  buffer.write_line("#include \"ast.h\"");
+  buffer.write_line("#include <cstdint>");
+  buffer.write_line("#include <span>");
+  buffer.write_line("#include <vector>");
+  buffer.write_line("%s", "");
+  buffer.write_line("// A child in the flat AST, the kind of the child in the "
+                    "top bits and its");
+  buffer.write_line("// index in the vector of nodes of that kind below them.");
+  buffer.write_line("template <typename Base> struct FlatRef {");
+  buffer.increase_indent();
+  buffer.write_line("static constexpr uint32_t kIndexBits = 27;");
+  buffer.write_line("static constexpr uint32_t kNull = UINT32_MAX;");
+  buffer.write_line("uint32_t value = kNull;");
+  buffer.write_line("FlatRef() = default;");
+  buffer.write_line("FlatRef(typename Base::Kind kind, size_t index)");
+  buffer.increase_indent();
+  buffer.write_line(": value(static_cast<uint32_t>(kind) << kIndexBits |");
+  buffer.write_line("        static_cast<uint32_t>(index)) {}");
+  buffer.decrease_indent();
+  buffer.write_line("bool is_null() const { return value == kNull; }");
+  buffer.write_line("typename Base::Kind kind() const {");
+  buffer.increase_indent();
+  buffer.write_line("return static_cast<typename Base::Kind>(value >> "
+                    "kIndexBits);");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("uint32_t index() const { return value & ((1u << "
+                    "kIndexBits) - 1); }");
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("%s", "");
+  buffer.write_line("// A run of items in one of the list vectors, e.g. the "
+                    "arguments of a call.");
+  buffer.write_line("struct FlatRange {");
+  buffer.increase_indent();
+  buffer.write_line("uint32_t first = 0;");
+  buffer.write_line("uint32_t count = 0;");
+  buffer.write_line("// whether the range lies in a list of `size` items");
+  buffer.write_line("bool within(size_t size) const {");
+  buffer.increase_indent();
+  buffer.write_line("return first <= size && count <= size - first;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("%s", "");
+  buffer.write_line("template <typename T>");
+  buffer.write_line("FlatRange flat_append(std::vector<T> &list, const "
+                    "std::vector<T> &items) {");
+  buffer.increase_indent();
+  buffer.write_line("FlatRange range{static_cast<uint32_t>(list.size()),");
+  buffer.write_line("                static_cast<uint32_t>(items.size())};");
+  buffer.write_line("list.insert(list.end(), items.begin(), items.end());");
+  buffer.write_line("return range;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+}
+
+void generate_flat_nodes(StringBuffer &buffer, const Section &section) {
+  buffer.write_line("using %sRef = FlatRef<%s>;", section.basename.c_str(),
+                    section.basename.c_str());
+  buffer.write_line("%s", "");
+  for (const auto &rule : section.rules) {
+    buffer.write_line("struct Flat%s {", rule_class_name(rule).c_str());
+    buffer.increase_indent();
+    buffer.write_line("uint32_t offset = 0;");
+    for (const auto &item : rule_components(rule)) {
+      buffer.write_line("%s %s{};", flat_field(item.first).type.c_str(),
+                        item.second.c_str());
+    }
+    buffer.decrease_indent();
+    buffer.write_line("};");
+    buffer.write_line("%s", "");
+  }
+}
+
+// Every vector of the flat AST as {type, name}, in declaration order: the
+// nodes of each kind, the lists and the top level statements.
+std::vector<std::pair<std::string, std::string>>
+flat_arrays(const std::vector<Section> &sections) {
+  std::vector<std::pair<std::string, std::string>> arrays;
+  for (const auto &section : sections) {
+    for (const auto &kind : section.kinds) {
+      arrays.push_back({"Flat" + kind, to_snake_case(kind) + "_nodes"});
+    }
+  }
+  // every list vector once, in the order they are first used
+  for (const auto &section : sections) {
+    for (const auto &rule : section.rules) {
+      for (const auto &item : rule_components(rule)) {
+        FlatField field = flat_field(item.first);
+        if (field.shape != FlatField::Shape::LIST) {
+          continue;
+        }
+        bool seen = false;
+        for (const auto &array : arrays) {
+          seen = seen || array.second == field.list;
+        }
+        if (!seen) {
+          arrays.push_back({field.flat_item, field.list});
+        }
+      }
+    }
+  }
+  arrays.push_back({"StmtRef", "program"});
+  return arrays;
+}
+
+void generate_for_each_array(StringBuffer &buffer, const char *qualifier,
+                             const std::vector<Section> &sections) {
+  buffer.write_line("// Calls f with every array above, in declaration order.");
+  buffer.write_line("template <typename F> void for_each_array(F &&f)%s {",
+                    qualifier);
+  buffer.increase_indent();
+  for (const auto &array : flat_arrays(sections)) {
+    buffer.write_line("f(%s);", array.second.c_str());
+  }
+  buffer.decrease_indent();
+  buffer.write_line("}");
+}
+
+void generate_flat_ast(StringBuffer &buffer,
+                       const std::vector<Section> &sections,
+                       const std::string &grammar) {
+  // FNV-1a of the grammar
+  uint32_t version = 2166136261u;
+  for (char c : grammar) {
+    version = (version ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  buffer.write_line("// Changes with grammar.txt, so flat ASTs stored with an "
+                    "older layout are");
+  buffer.write_line("// not read.");
+  buffer.write_line("constexpr uint32_t kFlatAstVersion = 0x%08x;", version);
+  buffer.write_line("%s", "");
+  auto arrays = flat_arrays(sections);
+  buffer.write_line("// A flat AST stored elsewhere, e.g. in a mapped file.");
+  buffer.write_line("struct FlatAstView {");
+  buffer.increase_indent();
+  for (const auto &array : arrays) {
+    buffer.write_line("std::span<const %s> %s;", array.first.c_str(),
+                      array.second.c_str());
+  }
+  generate_for_each_array(buffer, "", sections);
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("%s", "");
+  buffer.write_line("// The nodes of a program in one contiguous vector per "
+                    "kind.");
+  buffer.write_line("struct FlatAst {");
+  buffer.increase_indent();
+  for (const auto &array : arrays) {
+    if (array.second == "program") {
+      buffer.write_line("// the top level statements in source order");
+    }
+    buffer.write_line("std::vector<%s> %s;", array.first.c_str(),
+                      array.second.c_str());
+  }
+  generate_for_each_array(buffer, " const", sections);
+  buffer.write_line("size_t bytes() const {");
+  buffer.increase_indent();
+  buffer.write_line("size_t bytes = 0;");
+  buffer.write_line("for_each_array([&](const auto &items) {");
+  buffer.increase_indent();
+  buffer.write_line("bytes += items.size() * sizeof(items[0]);");
+  buffer.decrease_indent();
+  buffer.write_line("});");
+  buffer.write_line("return bytes;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("FlatAstView view() const {");
+  buffer.increase_indent();
+  buffer.write_line("FlatAstView view;");
+  for (const auto &array : arrays) {
+    buffer.write_line("view.%s = %s;", array.second.c_str(),
+                      array.second.c_str());
+  }
+  buffer.write_line("return view;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("%s", "");
+  buffer.write_line("// Sees every node flatten() and inflate() convert and "
+                    "translates the tokens");
+  buffer.write_line("// on the way, e.g. to store a flat AST in a file. This "
+                    "one changes nothing.");
+  buffer.write_line("struct FlatContext {");
+  buffer.increase_indent();
+  buffer.write_line("// cleared by inflate() when a ref or range points "
+                    "outside the arrays,");
+  buffer.write_line("// which only a damaged file does");
+  buffer.write_line("bool ok = true;");
+  buffer.write_line("// inflate() gives up after this many nodes, so refs "
+                    "that form a loop end");
+  buffer.write_line("size_t nodes_left = SIZE_MAX;");
+  buffer.write_line("Token token(const Token &t) { return t; }");
+  for (const auto &section : sections) {
+    const char *base = section.basename.c_str();
+    buffer.write_line("void flattened(const %s *, %sRef) {}", base, base);
+    buffer.write_line("void inflated(%sRef, const %s *) {}", base, base);
+  }
+  buffer.decrease_indent();
+  buffer.write_line("};");
+  buffer.write_line("%s", "");
+}
+
+// The expression that copies a field of type `type` from `from`, translating
+// tokens through the context.
+std::string flat_copy(const std::string &type, const std::string &from) {
+  if (type == "Token") {
+    return "context.token(" + from + ")";
+  }
+  return from;
+}
+
+void generate_flatten(StringBuffer &buffer, const Section &section) {
+  const char *base = section.basename.c_str();
+  buffer.write_line("template <typename C>");
+  buffer.write_line("%sRef flatten(FlatAst &ast, const %s *node, C &context) {",
+                    base, base);
+  buffer.increase_indent();
+  buffer.write_line("if (node == nullptr) {");
+  buffer.increase_indent();
+  buffer.write_line("return {};");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("switch (node->kind) {");
+  for (const auto &rule : section.rules) {
+    std::string kind = rule_class_name(rule);
+    std::string nodes = to_snake_case(kind) + "_nodes";
+    buffer.write_line("case %s::Kind::%s: {", base, kind.c_str());
+    buffer.increase_indent();
+    buffer.write_line("auto n = static_cast<const %s *>(node);", kind.c_str());
+    buffer.write_line("Flat%s flat;", kind.c_str());
+    buffer.write_line("flat.offset = n->offset;");
+    for (const auto &item : rule_components(rule)) {
+      const char *name = item.second.c_str();
+      FlatField field = flat_field(item.first);
+      switch (field.shape) {
+      case FlatField::Shape::NODE:
+        buffer.write_line("flat.%s = flatten(ast, n->%s, context);", name,
+                          name);
+        break;
+      case FlatField::Shape::VALUE:
+        buffer.write_line(
+            "flat.%s = %s;", name,
+            flat_copy(item.first, "n->" + item.second).c_str());
+        break;
+      case FlatField::Shape::LIST:
+        // children are flattened before the list is appended, so the list
+        // stays contiguous
+        buffer.write_line("std::vector<%s> %s;", field.flat_item.c_str(),
+                          name);
+        buffer.write_line("for (auto item : n->%s) {", name);
+        buffer.increase_indent();
+        if (field.flat_item != field.item) {
+          buffer.write_line("%s.push_back(flatten(ast, item, context));",
+                            name);
+        } else {
+          buffer.write_line("%s.push_back(%s);", name,
+                            flat_copy(field.item, "item").c_str());
+        }
+        buffer.decrease_indent();
+        buffer.write_line("}");
+        buffer.write_line("flat.%s = flat_append(ast.%s, %s);", name,
+                          field.list.c_str(), name);
+        break;
+      }
+    }
+    buffer.write_line("ast.%s.push_back(flat);", nodes.c_str());
+    buffer.write_line("%sRef ref(%s::Kind::%s, ast.%s.size() - 1);", base,
+                      base, kind.c_str(), nodes.c_str());
+    buffer.write_line("context.flattened(n, ref);");
+    buffer.write_line("return ref;");
+    buffer.decrease_indent();
+    buffer.write_line("}");
+  }
+  buffer.write_line("}");
+  buffer.write_line("return {};");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+  buffer.write_line("inline %sRef flatten(FlatAst &ast, const %s *node) {",
+                    base, base);
+  buffer.increase_indent();
+  buffer.write_line("FlatContext context;");
+  buffer.write_line("return flatten(ast, node, context);");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+}
+
+void generate_inflate(StringBuffer &buffer, const Section &section) {
+  const char *base = section.basename.c_str();
+  buffer.write_line("template <typename C>");
+  buffer.write_line("%s *inflate(const FlatAstView &ast, %sRef ref, Arena "
+                    "&arena, C &context) {",
+                    base, base);
+  buffer.increase_indent();
+  buffer.write_line("if (ref.is_null() || !context.ok) {");
+  buffer.increase_indent();
+  buffer.write_line("return nullptr;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("if (context.nodes_left == 0) {");
+  buffer.increase_indent();
+  buffer.write_line("context.ok = false;");
+  buffer.write_line("return nullptr;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("context.nodes_left--;");
+  buffer.write_line("switch (ref.kind()) {");
+  for (const auto &rule : section.rules) {
+    std::string kind = rule_class_name(rule);
+    std::string nodes = to_snake_case(kind) + "_nodes";
+    buffer.write_line("case %s::Kind::%s: {", base, kind.c_str());
+    buffer.increase_indent();
+    // the refs and ranges are checked before anything is read through them
+    buffer.write_line("if (ref.index() >= ast.%s.size()) {", nodes.c_str());
+    buffer.increase_indent();
+    buffer.write_line("context.ok = false;");
+    buffer.write_line("return nullptr;");
+    buffer.decrease_indent();
+    buffer.write_line("}");
+    buffer.write_line("const Flat%s &flat = ast.%s[ref.index()];",
+                      kind.c_str(), nodes.c_str());
+    for (const auto &item : rule_components(rule)) {
+      FlatField field = flat_field(item.first);
+      if (field.shape == FlatField::Shape::LIST) {
+        buffer.write_line("if (!flat.%s.within(ast.%s.size())) {",
+                          item.second.c_str(), field.list.c_str());
+        buffer.increase_indent();
+        buffer.write_line("context.ok = false;");
+        buffer.write_line("return nullptr;");
+        buffer.decrease_indent();
+        buffer.write_line("}");
+      }
+    }
+    buffer.write_line("auto n = arena.make<%s>();", kind.c_str());
+    buffer.write_line("n->offset = flat.offset;");
+    for (const auto &item : rule_components(rule)) {
+      const char *name = item.second.c_str();
+      FlatField field = flat_field(item.first);
+      switch (field.shape) {
+      case FlatField::Shape::NODE:
+        buffer.write_line("n->%s = inflate(ast, flat.%s, arena, context);",
+                          name, name);
+        break;
+      case FlatField::Shape::VALUE:
+        buffer.write_line(
+            "n->%s = %s;", name,
+            flat_copy(item.first, "flat." + item.second).c_str());
+        break;
+      case FlatField::Shape::LIST:
+        buffer.write_line("std::vector<%s> %s;", field.item.c_str(), name);
+        buffer.write_line("for (uint32_t i = 0; i < flat.%s.count; i++) {",
+                          name);
+        buffer.increase_indent();
+        buffer.write_line("auto item = ast.%s[flat.%s.first + i];",
+                          field.list.c_str(), name);
+        if (field.flat_item != field.item) {
+          buffer.write_line("%s.push_back(inflate(ast, item, arena, "
+                            "context));",
+                            name);
+        } else {
+          buffer.write_line("%s.push_back(%s);", name,
+                            flat_copy(field.item, "item").c_str());
+        }
+        buffer.decrease_indent();
+        buffer.write_line("}");
+        buffer.write_line("n->%s = arena.copy(%s);", name, name);
+        break;
+      }
+    }
+    buffer.write_line("context.inflated(ref, n);");
+    buffer.write_line("return n;");
+    buffer.decrease_indent();
+    buffer.write_line("}");
+  }
+  buffer.write_line("}");
+  buffer.write_line("// a kind no node has");
+  buffer.write_line("context.ok = false;");
+  buffer.write_line("return nullptr;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+  buffer.write_line("inline %s *inflate(const FlatAst &ast, %sRef ref, Arena "
+                    "&arena) {",
+                    base, base);
+  buffer.increase_indent();
+  buffer.write_line("FlatContext context;");
+  buffer.write_line("return inflate(ast.view(), ref, arena, context);");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+}
+
+// Emits the flat AST: a struct per node with its children as 32 bit
+// references, a FlatAst holding a vector per kind, and flatten()/inflate()
+// to convert from and to the pointer nodes of ast.h.
+void generate_flat_code(std::ofstream &ofs,
+                        const std::vector<Section> &sections,
+                        const std::string &grammar) {
+  StringBuffer buffer;
+  generate_flat_preamble(buffer);
+  for (const auto &section : sections) {
+    generate_flat_nodes(buffer, section);
+  }
+  generate_flat_ast(buffer, sections, grammar);
+  // the hierarchies may refer to each other
+  for (const auto &section : sections) {
+    const char *base = section.basename.c_str();
+    buffer.write_line("template <typename C>");
+    buffer.write_line("%sRef flatten(FlatAst &ast, const %s *node, C "
+                      "&context);",
+                      base, base);
+    buffer.write_line("template <typename C>");
+    buffer.write_line("%s *inflate(const FlatAstView &ast, %sRef ref, Arena "
+                      "&arena, C &context);",
+                      base, base);
+  }
+  buffer.write_line("%s", "");
+  for (const auto &section : sections) {
+    generate_flatten(buffer, section);
+    generate_inflate(buffer, section);
+  }
+  buffer.write_line("template <typename C>");
+  buffer.write_line("std::vector<Stmt *> inflate(const FlatAstView &ast, Arena "
+                    "&arena,");
+  buffer.write_line("                            C &context) {");
+  buffer.increase_indent();
+  buffer.write_line("std::vector<Stmt *> stmts;");
+  buffer.write_line("for (auto ref : ast.program) {");
+  buffer.increase_indent();
+  buffer.write_line("stmts.push_back(inflate(ast, ref, arena, context));");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("return stmts;");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  buffer.write_line("%s", "");
+  buffer.write_line("inline std::vector<Stmt *> inflate(const FlatAst &ast, "
+                    "Arena &arena) {");
+  buffer.increase_indent();
+  buffer.write_line("FlatContext context;");
+  buffer.write_line("return inflate(ast.view(), arena, context);");
+  buffer.decrease_indent();
+  buffer.write_line("}");
+  std::string code;
+  buffer.get_contents(code);
+  write_code(ofs, code);
+}
+
+bool generate_code(std::ofstream &ofs, const std::string file_contents,
+                   std::vector<Section> &sections) {
   std::stringstream input_stringstream(file_contents);
   std::string rule;
   std::string code;
@@ -131,32 +741,48 @@ bool generate_code(std::ofstream &ofs, const std::string file_contents) {
     assert(basename_split.size() == 2);
     std::string basename = basename_split[1];
     trim(basename);
-    generate_base_ast(code, basename);
+    // the base class lists every kind, so read the whole section first
+    Section section;
+    section.basename = basename;
+    while (getline(input_stringstream, rule)) {
+      if (rule == "---") {
+        break;
+      }
+      section.rules.push_back(rule);
+      section.kinds.push_back(rule_class_name(rule));
+    }
+    sections.push_back(section);
+    const auto &rules = section.rules;
+    const auto &kinds = section.kinds;
+    generate_base_ast(code, basename, kinds);
     if (!write_code(ofs, code)) {
       CLog::FLog(LogLevel::ERROR, LogCategory::ALL,
                  "Could not write contents to output file");
       return false;
     }
-    while (getline(input_stringstream, rule)) {
-      if (rule == "---") {
-        break;
-      }
-      generate_ast(rule, basename, code);
+    for (const auto &r : rules) {
+      generate_ast(r, basename, code);
       if (!write_code(ofs, code)) {
         CLog::FLog(LogLevel::ERROR, LogCategory::ALL,
                    "Could not write contents to output file");
         return false;
       }
     }
+    generate_dispatch(code, basename, kinds);
+    if (!write_code(ofs, code)) {
+      CLog::FLog(LogLevel::ERROR, LogCategory::ALL,
+                 "Could not write contents to output file");
+      return false;
+    }
   }
   return true;
 }
 
 int main(int argc, char **argv) {
-  if (argc != 3) {
+  if (argc != 3 && argc != 4) {
     CLog::FLog(LogLevel::INFO, LogCategory::ALL,
                "The correct usage is ast_generator grammer_file_path "
-               "output_file_path");
+               "output_file_path [flat_output_file_path]");
     return -1;
   }
   std::string file_path = std::string(argv[1]);
@@ -174,8 +800,18 @@ int main(int argc, char **argv) {
     return -1;
   }
   std::string file_contents = read_file_into_string(std::string(argv[1]));
-  if (!generate_code(ofs, file_contents))
+  std::vector<Section> sections;
+  if (!generate_code(ofs, file_contents, sections))
     return -1;
   ofs.close();
+  if (argc == 4) {
+    std::ofstream flat_ofs(argv[3], std::ofstream::out);
+    if (!flat_ofs.is_open()) {
+      CLog::FLog(LogLevel::ERROR, LogCategory::ALL,
+                 "Output file could not be created or opened: %s", argv[3]);
+      return -1;
+    }
+    generate_flat_code(flat_ofs, sections, file_contents);
+  }
   return 0;
 }
@@ -11,12 +11,10 @@ std::string read_file_into_string(const std::string &file_path) {
   if (!fs::exists(file_path)) {
     return "";
   }
-  std::ifstream ifs(file_path, std::ifstream::in);
-  std::string line;
-  std::string contents;
-  while (std::getline(ifs, line)) {
-    contents = contents + line + "\n";
-  }
+  std::ifstream ifs(file_path, std::ifstream::in | std::ifstream::binary);
+  std::string contents(fs::file_size(file_path), '\0');
+  ifs.read(contents.data(), contents.size());
+  contents.resize(ifs.gcount());
   return contents;
 }
 
@@ -5,7 +5,7 @@
 TEST(TestEnv, test_env_1) {
   Environment env;
   env.define("foo", Object(STR, strdup("foobar")));
-  Object *o = env.get(Token(IDENTIFIER, "foo", nullptr, 0));
+  Object *o = env.get(Token(IDENTIFIER, "foo"));
   EXPECT_TRUE(o != nullptr);
 }
 
@@ -13,7 +13,7 @@ TEST(TestEnv, test_env_2) {
   Environment env;
   env.define("foo", Object(STR, strdup("foobar")));
   Environment env1(&env);
-  Object *o = env1.get(Token(IDENTIFIER, "foo", nullptr, 0));
+  Object *o = env1.get(Token(IDENTIFIER, "foo"));
   EXPECT_TRUE(o != nullptr);
 }
 
@@ -23,7 +23,7 @@ TEST(TestEnv, test_env_3) {
   Environment env1(&env);
   bool ret = env1.assign("foo", Object(STR, strdup("foobar1")));
   EXPECT_TRUE(ret);
-  Object *o = env1.get(Token(IDENTIFIER, "foo", nullptr, 0));
+  Object *o = env1.get(Token(IDENTIFIER, "foo"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "foobar1");
 }
@@ -33,12 +33,12 @@ TEST(TestEnv, test_env_4) {
   env.define("foo", Object(STR, strdup("foobar")));
   Environment env1(&env);
   env1.define("foo", Object(STR, strdup("foobar1")));
-  Object *o = env1.get(Token(IDENTIFIER, "foo", nullptr, 0));
+  Object *o = env1.get(Token(IDENTIFIER, "foo"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "foobar1");
 
   // old environment should still retain the old value if we used define
-  Object *o_ = env.get(Token(IDENTIFIER, "foo", nullptr, 0));
+  Object *o_ = env.get(Token(IDENTIFIER, "foo"));
   EXPECT_TRUE(o_ != nullptr);
   EXPECT_EQ(Object::object_to_str(*o_), "foobar");
 }
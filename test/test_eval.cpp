@@ -1,14 +1,24 @@
 #include "ast.h"
 #include "eval.h"
+#include "folder.h"
 #include "lox.h"
+#include "mapped_file.h"
+#include "program_cache.h"
+#include "resolver.h"
+#include "source.h"
 #include "gtest/gtest.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
 
 TEST(EvalTest, unary_expr_test_1) {
   // Construct an expression tree
-  auto l = std::make_shared<Literal>();
-  l->value = std::make_shared<Token>(FALSE, "false", new bool(false), 0);
+  Arena arena;
+  auto l = arena.make<Literal>();
+  l->value = Token(FALSE, "false");
   Unary expr;
-  expr.op = std::make_shared<Token>(BANG, "!", nullptr, 0);
+  expr.op = Token(BANG, "!");
   expr.right = l;
   // evaluate the tree
   Evaluator eval;
@@ -19,10 +29,11 @@ TEST(EvalTest, unary_expr_test_1) {
 
 TEST(EvalTest, unary_expr_test_2) {
   // Construct an expression tree
-  auto l = std::make_shared<Literal>();
-  l->value = std::make_shared<Token>(TRUE, "true", new bool(true), 0);
+  Arena arena;
+  auto l = arena.make<Literal>();
+  l->value = Token(TRUE, "true");
   Unary expr;
-  expr.op = std::make_shared<Token>(BANG, "!", nullptr, 0);
+  expr.op = Token(BANG, "!");
   expr.right = l;
   // evaluate the tree
   Evaluator eval;
@@ -33,11 +44,11 @@ TEST(EvalTest, unary_expr_test_2) {
 
 TEST(EvalTest, unary_expr_test_3) {
   // Construct an expression tree
-  auto l = std::make_shared<Literal>();
-  l->value =
-      std::make_shared<Token>(NUMBER, "12234.456", new float(12234.456), 0);
+  Arena arena;
+  auto l = arena.make<Literal>();
+  l->value = Token(NUMBER, "12234.456");
   Unary expr;
-  expr.op = std::make_shared<Token>(MINUS, "-", nullptr, 0);
+  expr.op = Token(MINUS, "-");
   expr.right = l;
   // evaluate the tree
   Evaluator eval;
@@ -48,11 +59,11 @@ TEST(EvalTest, unary_expr_test_3) {
 
 TEST(EvalTest, unary_expr_test_4) {
   // Construct an expression tree
-  auto l = std::make_shared<Literal>();
-  l->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
+  Arena arena;
+  auto l = arena.make<Literal>();
+  l->value = Token(NUMBER, "-12234.456");
   Unary expr;
-  expr.op = std::make_shared<Token>(MINUS, "-", nullptr, 0);
+  expr.op = Token(MINUS, "-");
   expr.right = l;
   // evaluate the tree
   Evaluator eval;
@@ -63,15 +74,14 @@ TEST(EvalTest, unary_expr_test_4) {
 
 TEST(EvalTest, binary_expr_test_5) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value =
-      std::make_shared<Token>(NUMBER, "-12233.456", new float(-12233.456), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "-12234.456");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "-12233.456");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(MINUS, "-", nullptr, 0);
+  expr.op = Token(MINUS, "-");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -83,15 +93,14 @@ TEST(EvalTest, binary_expr_test_5) {
 
 TEST(EvalTest, binary_expr_test_6) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value =
-      std::make_shared<Token>(NUMBER, "12235.456", new float(12235.456), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "-12234.456");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "12235.456");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(PLUS, "+", nullptr, 0);
+  expr.op = Token(PLUS, "+");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -103,15 +112,14 @@ TEST(EvalTest, binary_expr_test_6) {
 
 TEST(EvalTest, binary_expr_test_7) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(STRING, "Lovely Dress",
-                                      strdup("Lovely Dress"), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "-12234.456");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(STRING, "Lovely Dress");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(MINUS, "-", nullptr, 0);
+  expr.op = Token(MINUS, "-");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -122,15 +130,14 @@ TEST(EvalTest, binary_expr_test_7) {
 
 TEST(EvalTest, binary_expr_test_8) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value =
-      std::make_shared<Token>(NUMBER, "-12234.456", new float(-12234.456), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "-12234.456");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "-12234.456");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(SLASH, "/", nullptr, 0);
+  expr.op = Token(SLASH, "/");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -142,13 +149,14 @@ TEST(EvalTest, binary_expr_test_8) {
 
 TEST(EvalTest, binary_expr_test_9) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "7", new float(7), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "12");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "7");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(STAR, "*", nullptr, 0);
+  expr.op = Token(STAR, "*");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -160,13 +168,14 @@ TEST(EvalTest, binary_expr_test_9) {
 
 TEST(EvalTest, binary_expr_test_10) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "7", new float(7), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "12");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "7");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(GREATER, ">", nullptr, 0);
+  expr.op = Token(GREATER, ">");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -178,13 +187,14 @@ TEST(EvalTest, binary_expr_test_10) {
 
 TEST(EvalTest, binary_expr_test_11) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "7", new float(7), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "12");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "7");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(LESS, "<", nullptr, 0);
+  expr.op = Token(LESS, "<");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -196,13 +206,14 @@ TEST(EvalTest, binary_expr_test_11) {
 
 TEST(EvalTest, binary_expr_test_12) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "12");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "12");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(EQUAL_EQUAL, "==", nullptr, 0);
+  expr.op = Token(EQUAL_EQUAL, "==");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -214,13 +225,14 @@ TEST(EvalTest, binary_expr_test_12) {
 
 TEST(EvalTest, binary_expr_test_13) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "13", new float(13), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "14", new float(14), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "13");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "14");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(GREATER_EQUAL, ">=", nullptr, 0);
+  expr.op = Token(GREATER_EQUAL, ">=");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -232,13 +244,14 @@ TEST(EvalTest, binary_expr_test_13) {
 
 TEST(EvalTest, binary_expr_test_14) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "13", new float(13), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "14", new float(14), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "13");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(NUMBER, "14");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(BANG_EQUAL, "==", nullptr, 0);
+  expr.op = Token(BANG_EQUAL, "==");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -249,13 +262,15 @@ TEST(EvalTest, binary_expr_test_14) {
 
 TEST(EvalTest, binary_expr_test_15) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(NUMBER, "12", new float(12), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(NUMBER, "13", new float(12), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(NUMBER, "12");
+  auto l2 = arena.make<Literal>();
+  // the value of a NUMBER token is parsed from its text
+  l2->value = Token(NUMBER, "12");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(EQUAL_EQUAL, "==", nullptr, 0);
+  expr.op = Token(EQUAL_EQUAL, "==");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -267,15 +282,14 @@ TEST(EvalTest, binary_expr_test_15) {
 
 TEST(EvalTest, binary_expr_test_16) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(STRING, "My Fair Lady",
-                                      strdup("My Fair Lady"), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(STRING, "My Fair Lady",
-                                      strdup("My Fair Lady"), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(STRING, "My Fair Lady");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(STRING, "My Fair Lady");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(EQUAL_EQUAL, "==", nullptr, 0);
+  expr.op = Token(EQUAL_EQUAL, "==");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -287,15 +301,14 @@ TEST(EvalTest, binary_expr_test_16) {
 
 TEST(EvalTest, binary_expr_test_17) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(STRING, "My Fair Lady",
-                                      strdup("My Fair Lady"), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(STRING, "My Fair Ladies",
-                                      strdup("My Fair Ladies"), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(STRING, "My Fair Lady");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(STRING, "My Fair Ladies");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(EQUAL_EQUAL, "==", nullptr, 0);
+  expr.op = Token(EQUAL_EQUAL, "==");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -307,15 +320,14 @@ TEST(EvalTest, binary_expr_test_17) {
 
 TEST(EvalTest, binary_expr_test_18) {
   // Construct an expression tree
-  auto l1 = std::make_shared<Literal>();
-  l1->value = std::make_shared<Token>(STRING, "My Fair Lady",
-                                      strdup("My Fair Lady"), 0);
-  auto l2 = std::make_shared<Literal>();
-  l2->value = std::make_shared<Token>(STRING, "My Fair Ladies",
-                                      strdup("My Fair Ladies"), 0);
+  Arena arena;
+  auto l1 = arena.make<Literal>();
+  l1->value = Token(STRING, "My Fair Lady");
+  auto l2 = arena.make<Literal>();
+  l2->value = Token(STRING, "My Fair Ladies");
 
   Binary expr;
-  expr.op = std::make_shared<Token>(GREATER_EQUAL, ">=", nullptr, 0);
+  expr.op = Token(GREATER_EQUAL, ">=");
   expr.right = l1;
   expr.left = l2;
   // evaluate the tree
@@ -325,54 +337,53 @@ TEST(EvalTest, binary_expr_test_18) {
 }
 
 TEST(EvalTest, stmt_eval_test_19) {
-  auto e1 = std::make_shared<Expression>();
+  Arena arena;
+  auto e1 = arena.make<Expression>();
   {
-    auto l1 = std::make_shared<Literal>();
-    l1->value = std::make_shared<Token>(STRING, "My Fair Lady",
-                                        strdup("My Fair Lady"), 0);
-    auto l2 = std::make_shared<Literal>();
-    l2->value = std::make_shared<Token>(STRING, "My Fair Ladies",
-                                        strdup("My Fair Ladies"), 0);
-
-    auto expr = std::make_shared<Binary>();
-    expr->op = std::make_shared<Token>(GREATER_EQUAL, ">=", nullptr, 0);
+    auto l1 = arena.make<Literal>();
+    l1->value = Token(STRING, "My Fair Lady");
+    auto l2 = arena.make<Literal>();
+    l2->value = Token(STRING, "My Fair Ladies");
+
+    auto expr = arena.make<Binary>();
+    expr->op = Token(GREATER_EQUAL, ">=");
     expr->right = l1;
     expr->left = l2;
     e1->expression = expr;
   }
 
-  auto e2 = std::make_shared<Expression>();
+  auto e2 = arena.make<Expression>();
   {
     // Construct an expression tree
-    auto l1 = std::make_shared<Literal>();
-    l1->value = std::make_shared<Token>(NUMBER, "13", new float(13), 0);
-    auto l2 = std::make_shared<Literal>();
-    l2->value = std::make_shared<Token>(NUMBER, "14", new float(14), 0);
+    auto l1 = arena.make<Literal>();
+    l1->value = Token(NUMBER, "13");
+    auto l2 = arena.make<Literal>();
+    l2->value = Token(NUMBER, "14");
 
-    auto expr = std::make_shared<Binary>();
-    expr->op = std::make_shared<Token>(GREATER_EQUAL, ">=", nullptr, 0);
+    auto expr = arena.make<Binary>();
+    expr->op = Token(GREATER_EQUAL, ">=");
     expr->right = l1;
     expr->left = l2;
     e2->expression = expr;
   }
 
-  auto p = std::make_shared<Print>();
+  auto p = arena.make<Print>();
   {
     // Construct an expression tree
-    auto l1 = std::make_shared<Literal>();
-    l1->value = std::make_shared<Token>(NUMBER, "13", new float(13), 0);
-    auto l2 = std::make_shared<Literal>();
-    l2->value = std::make_shared<Token>(NUMBER, "14", new float(14), 0);
+    auto l1 = arena.make<Literal>();
+    l1->value = Token(NUMBER, "13");
+    auto l2 = arena.make<Literal>();
+    l2->value = Token(NUMBER, "14");
 
-    auto expr = std::make_shared<Binary>();
-    expr->op = std::make_shared<Token>(GREATER_EQUAL, ">=", nullptr, 0);
+    auto expr = arena.make<Binary>();
+    expr->op = Token(GREATER_EQUAL, ">=");
     expr->right = l1;
     expr->left = l2;
-    p->expressions = {expr};
+    p->expressions = arena.copy(std::vector<Expr *>{expr});
   }
-  std::vector<std::shared_ptr<Stmt>> stmts = {e1, e2, p};
+  std::vector<Stmt *> stmts = {e1, e2, p};
   Evaluator eval;
-  eval.eval(std::move(stmts));
+  eval.eval(stmts);
 }
 
 TEST(EvalTest, stmt_eval_test_20) {
@@ -384,7 +395,7 @@ TEST(EvalTest, stmt_eval_test_20) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
 
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "false");
@@ -399,7 +410,7 @@ TEST(EvalTest, stmt_eval_test_21) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "true");
 }
@@ -413,7 +424,7 @@ TEST(EvalTest, stmt_eval_test_22) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "true");
 }
@@ -427,7 +438,7 @@ TEST(EvalTest, stmt_eval_test_23) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(Object::object_to_str(*o), "false");
 }
@@ -440,7 +451,7 @@ TEST(EvalTest, stmt_eval_test_24) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(*(float *)o->val, 10.0);
 }
@@ -453,7 +464,7 @@ TEST(EvalTest, stmt_eval_test_25) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(*(float *)o->val, 0.0);
 }
@@ -466,11 +477,408 @@ TEST(EvalTest, stmt_eval_test_26) {
                             })";
   Lox lox;
   lox.run(test_code);
-  Object *o = lox.eval_.env->get(Token(STRING, "a", nullptr, 0));
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
   EXPECT_TRUE(o != nullptr);
   EXPECT_EQ(*(float *)o->val, 11.0);
 }
 
+// A program parsed into the flat layout runs the same as the pointer nodes
+TEST(EvalTest, run_flat_ast) {
+  std::string test_code = R"(fun fib(n) {
+                               if (n < 2) { return n; }
+                               return fib(n - 1) + fib(n - 2);
+                             }
+                             var a = fib(10);)";
+  Scanner scanner;
+  scanner.init(test_code);
+  Parser parser;
+  parser.init(scanner);
+  FlatAst ast;
+  ASSERT_TRUE(parser.parse_flat(ast));
+  Lox lox;
+  lox.run(ast);
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 55.0);
+}
+
+// Locals get a slot in the frame of their function in the order they are
+// declared. The ones a closure captures are kept in a cell, and the closure
+// gets the cells of just the variables it uses.
+TEST(EvalTest, resolver_slots) {
+  std::string test_code = R"(fun f(x, y) {
+                               var a = x;
+                               { var b = a; var c = y; c = b; }
+                               return a;
+                             }
+                             fun g(n) {
+                               var m = n;
+                               { var k = m; }
+                               fun h() { return n + m; }
+                               return h;
+                             }
+                             fun o() {
+                               var u = 1;
+                               var v = 2;
+                               fun mid() {
+                                 fun inner() { return v; }
+                                 return inner;
+                               }
+                               return mid;
+                             }
+                             var r = f(3, 4) + g(5)() + o()()();)";
+  Scanner scanner;
+  scanner.init(test_code);
+  ASSERT_TRUE(scanner.scan());
+  Parser parser;
+  parser.init(scanner.get_tokens());
+  std::vector<Stmt *> stmts = parser.parse_stmts();
+  Evaluator eval;
+  {
+    Resolver resolver(&eval);
+    ASSERT_TRUE(resolver.resolve(stmts));
+  }
+  // nothing captures the locals of f, x and y come first in its frame
+  auto f = dyn_cast<Function>(stmts[0]);
+  ASSERT_TRUE(f != nullptr);
+  EXPECT_EQ(f->frame_size, 5);
+  EXPECT_TRUE(f->upvalues.empty());
+  EXPECT_TRUE(f->cell_params.empty());
+  EXPECT_EQ(dyn_cast<Var>(f->body[0])->storage, kStack);
+  EXPECT_EQ(dyn_cast<Var>(f->body[0])->slot, 2);
+  auto block = dyn_cast<Block>(f->body[1]);
+  ASSERT_TRUE(block != nullptr);
+  EXPECT_EQ(block->frame_size, 5);
+  auto b = dyn_cast<Var>(block->statements[0]);
+  auto c = dyn_cast<Var>(block->statements[1]);
+  EXPECT_EQ(c->slot, 4);
+  // the resolver records where it found a name on the node
+  auto a_use = dyn_cast<Variable>(b->initializer);
+  EXPECT_EQ(a_use->storage, kStack);
+  EXPECT_EQ(a_use->slot, 2);
+  auto y_use = dyn_cast<Variable>(c->initializer);
+  EXPECT_EQ(y_use->slot, 1);
+  auto assign = dyn_cast<Assign>(
+      dyn_cast<Expression>(block->statements[2])->expression);
+  EXPECT_EQ(assign->storage, kStack);
+  EXPECT_EQ(assign->slot, 4);
+  // h captures n and m, so g keeps them in cells. n is passed in one.
+  auto g = dyn_cast<Function>(stmts[1]);
+  ASSERT_TRUE(g != nullptr);
+  EXPECT_EQ(g->frame_size, 3);
+  ASSERT_EQ(g->cell_params.size(), 1);
+  EXPECT_EQ(g->cell_params[0], 0);
+  auto m = dyn_cast<Var>(g->body[0]);
+  EXPECT_EQ(m->storage, kCell);
+  EXPECT_EQ(m->slot, 1);
+  auto k = dyn_cast<Var>(dyn_cast<Block>(g->body[1])->statements[0]);
+  EXPECT_EQ(k->storage, kStack);
+  EXPECT_EQ(k->slot, 2);
+  EXPECT_EQ(dyn_cast<Variable>(k->initializer)->storage, kCell);
+  EXPECT_EQ(dyn_cast<Variable>(k->initializer)->slot, 1);
+  auto h = dyn_cast<Function>(g->body[2]);
+  EXPECT_EQ(h->storage, kStack);
+  EXPECT_EQ(h->slot, 2);
+  ASSERT_EQ(h->upvalues.size(), 2);
+  EXPECT_TRUE(h->upvalues[0].local);
+  EXPECT_EQ(h->upvalues[0].index, 0);
+  EXPECT_EQ(h->upvalues[1].index, 1);
+  auto sum = dyn_cast<Binary>(dyn_cast<Return>(h->body[0])->value);
+  EXPECT_EQ(dyn_cast<Variable>(sum->left)->storage, kUpvalue);
+  EXPECT_EQ(dyn_cast<Variable>(sum->left)->slot, 0);
+  EXPECT_EQ(dyn_cast<Variable>(sum->right)->slot, 1);
+  // inner gets v through mid, which does not use it itself. u stays on the
+  // stack.
+  auto o = dyn_cast<Function>(stmts[2]);
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(dyn_cast<Var>(o->body[0])->storage, kStack);
+  EXPECT_EQ(dyn_cast<Var>(o->body[1])->storage, kCell);
+  auto mid = dyn_cast<Function>(o->body[2]);
+  ASSERT_EQ(mid->upvalues.size(), 1);
+  EXPECT_TRUE(mid->upvalues[0].local);
+  EXPECT_EQ(mid->upvalues[0].index, 1);
+  auto inner = dyn_cast<Function>(mid->body[0]);
+  ASSERT_EQ(inner->upvalues.size(), 1);
+  EXPECT_FALSE(inner->upvalues[0].local);
+  EXPECT_EQ(inner->upvalues[0].index, 0);
+  // f is a global
+  auto call = dyn_cast<Call>(dyn_cast<Binary>(dyn_cast<Binary>(
+      dyn_cast<Var>(stmts[3])->initializer)->left)->left);
+  EXPECT_EQ(dyn_cast<Variable>(call->callee)->storage, kGlobal);
+  eval.eval(stmts);
+  Object *r = eval.globals->get("r");
+  ASSERT_TRUE(r != nullptr);
+  EXPECT_EQ(*(float *)r->val, 15.0);
+  EXPECT_TRUE(eval.stack_.empty());
+  EXPECT_TRUE(eval.cells_.empty());
+}
+
+// A name declared twice is an error, but it still takes a slot so the
+// parameters after it get their arguments
+TEST(EvalTest, resolver_duplicate_names) {
+  std::string test_code = R"(fun f(a, a, b) { return b; }
+                             fun g() {
+                               var c = 1;
+                               var c = 2;
+                             }
+                             var r = f(1, 2, 3);)";
+  Scanner scanner;
+  scanner.init(test_code);
+  ASSERT_TRUE(scanner.scan());
+  Parser parser;
+  parser.init(scanner.get_tokens());
+  std::vector<Stmt *> stmts = parser.parse_stmts();
+  Evaluator eval;
+  {
+    Resolver resolver(&eval);
+    EXPECT_FALSE(resolver.resolve(stmts));
+  }
+  auto f = dyn_cast<Function>(stmts[0]);
+  ASSERT_TRUE(f != nullptr);
+  EXPECT_EQ(f->frame_size, 3);
+  auto b_use = dyn_cast<Variable>(dyn_cast<Return>(f->body[0])->value);
+  EXPECT_EQ(b_use->storage, kStack);
+  EXPECT_EQ(b_use->slot, 2);
+  // the second c is a local too, not a global
+  auto g = dyn_cast<Function>(stmts[1]);
+  ASSERT_TRUE(g != nullptr);
+  EXPECT_EQ(dyn_cast<Var>(g->body[1])->storage, kStack);
+  EXPECT_EQ(dyn_cast<Var>(g->body[1])->slot, 1);
+  eval.eval(stmts);
+  Object *r = eval.globals->get("r");
+  ASSERT_TRUE(r != nullptr);
+  EXPECT_EQ(*(float *)r->val, 3.0);
+  EXPECT_EQ(eval.globals->get("c"), nullptr);
+}
+
+// Constant expressions become literals and dead branches are dropped
+TEST(EvalTest, constant_folding) {
+  std::string test_code = R"(var a = 2 * (3 + 1) - -1;
+                             var s = "con" + "cat";
+                             var b = !(1 < 2);
+                             var c = 1 + "x";
+                             if (1 > 2) { a = 0; } else { a = a + 1; }
+                             while (false) { a = 0; }
+                             fun f(x) { return x * (4 / 2); })";
+  Scanner scanner;
+  scanner.init(test_code);
+  ASSERT_TRUE(scanner.scan());
+  Parser parser;
+  parser.init(scanner.get_tokens());
+  std::vector<Stmt *> stmts = parser.parse_stmts();
+  auto arena = parser.take_arena();
+  Evaluator eval;
+  Resolver resolver(&eval);
+  ASSERT_TRUE(resolver.resolve(stmts));
+  int line = dyn_cast<Var>(stmts[0])->initializer->line_no();
+  ConstantFolder folder(*arena);
+  folder.fold(stmts);
+  ASSERT_EQ(stmts.size(), 6);
+  auto a = dyn_cast<Literal>(dyn_cast<Var>(stmts[0])->initializer);
+  ASSERT_TRUE(a != nullptr);
+  EXPECT_FLOAT_EQ(a->value.number, 9);
+  // a folded literal reports the line of the expression it replaced
+  EXPECT_EQ(a->line_no(), line);
+  auto s = dyn_cast<Literal>(dyn_cast<Var>(stmts[1])->initializer);
+  ASSERT_TRUE(s != nullptr);
+  EXPECT_EQ(s->value.lexeme(), "concat");
+  auto b = dyn_cast<Literal>(dyn_cast<Var>(stmts[2])->initializer);
+  ASSERT_TRUE(b != nullptr);
+  EXPECT_EQ(b->value.token_type_, FALSE);
+  // a type error is left for the evaluator to report
+  EXPECT_TRUE(dyn_cast<Binary>(dyn_cast<Var>(stmts[3])->initializer));
+  // the if is replaced by its else branch, the while is gone
+  EXPECT_EQ(stmts[4]->kind, Stmt::Kind::Block);
+  auto f = dyn_cast<Function>(stmts[5]);
+  ASSERT_TRUE(f != nullptr);
+  auto r = dyn_cast<Return>(f->body[0]);
+  EXPECT_TRUE(dyn_cast<Literal>(dyn_cast<Binary>(r->value)->right));
+  EXPECT_EQ(folder.folded(), 11);
+
+  eval.eval(stmts);
+  Object *o = eval.env->get("a");
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 10.0);
+  o = eval.env->get("s");
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_STREQ((char *)o->val, "concat");
+}
+
+// A script run from a file is lexed straight out of the mapping
+TEST(EvalTest, run_file_test) {
+  std::string path = testing::TempDir() + "run_file_test.lox";
+  std::ofstream(path) << "var a = 1;\nvar b = \"two\";\na = a + 2;\n";
+  Lox lox;
+  lox.run_file(path);
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
+  EXPECT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 3.0);
+  std::remove(path.c_str());
+}
+
+// A file that fills its last page exactly is still followed by a '\0'
+TEST(EvalTest, mapped_file_page_sized) {
+  std::string path = testing::TempDir() + "mapped_file_test.lox";
+  size_t size = sysconf(_SC_PAGESIZE);
+  std::ofstream(path) << std::string(size, ' ');
+  MappedFile file;
+  EXPECT_TRUE(file.open(path));
+  EXPECT_TRUE(file.is_mapped());
+  EXPECT_EQ(file.size(), size);
+  EXPECT_EQ(file.data()[size], '\0');
+  std::remove(path.c_str());
+  MappedFile missing;
+  EXPECT_FALSE(missing.open(path));
+}
+
+// The second run of a script reads the resolved program from its .loxc file
+TEST(EvalTest, program_cache) {
+  std::string path = testing::TempDir() + "program_cache_test.lox";
+  std::string code = R"(var a = 0;
+                        fun counter() {
+                          var n = 0;
+                          fun inc() { n = n + 1; return n; }
+                          return inc;
+                        }
+                        var c = counter();
+                        for (var i = 0; i < 3; i = i + 1) { a = a + c(); })";
+  std::ofstream(path) << code;
+  unsetenv("LOX_CACHE_DIR");
+  uint64_t hash = hash_source(code);
+  std::string cached = cache_path(path, hash);
+  EXPECT_EQ(cached, path + "c");
+  Lox first;
+  first.cache_programs_ = true;
+  first.run_file(path);
+  Object *o = first.eval_.env->get(Token(STRING, "a"));
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 6.0);
+
+  uint32_t base = SourceManager::get().add(code);
+  Lox second;
+  Arena arena;
+  std::vector<Stmt *> stmts;
+  EXPECT_FALSE(load_program(cached, hash + 1, base, arena, stmts));
+  ASSERT_TRUE(load_program(cached, hash, base, arena, stmts));
+  EXPECT_EQ(stmts.size(), 4);
+  // where the resolver put the variables comes back with the nodes
+  auto counter = dyn_cast<Function>(stmts[1]);
+  ASSERT_TRUE(counter != nullptr);
+  EXPECT_EQ(counter->frame_size, 2);
+  EXPECT_EQ(dyn_cast<Var>(counter->body[0])->storage, kCell);
+  auto inc = dyn_cast<Function>(counter->body[1]);
+  ASSERT_EQ(inc->upvalues.size(), 1);
+  EXPECT_TRUE(inc->upvalues[0].local);
+  EXPECT_EQ(inc->upvalues[0].index, 0);
+  auto ret = dyn_cast<Return>(counter->body[2]);
+  ASSERT_TRUE(ret != nullptr);
+  EXPECT_EQ(dyn_cast<Variable>(ret->value)->storage, kStack);
+  EXPECT_EQ(dyn_cast<Variable>(ret->value)->slot, 1);
+  second.eval_.eval(stmts);
+  o = second.eval_.env->get(Token(STRING, "a"));
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 6.0);
+  std::remove(path.c_str());
+  std::remove(cached.c_str());
+}
+
+// A damaged cache file is turned down instead of read past its end
+TEST(EvalTest, program_cache_damaged) {
+  std::string path = testing::TempDir() + "program_cache_damaged.lox";
+  std::string code = R"(fun add(a, b) { return a + b; }
+                        var s = "text";
+                        for (var i = 0; i < 3; i = i + 1) { print(add(i, 1)); })";
+  std::ofstream(path) << code;
+  unsetenv("LOX_CACHE_DIR");
+  uint64_t hash = hash_source(code);
+  std::string cached = cache_path(path, hash);
+  Lox first;
+  first.cache_programs_ = true;
+  first.run_file(path);
+  std::string saved;
+  {
+    std::ifstream in(cached, std::ios::binary);
+    saved.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  ASSERT_GT(saved.size(), 64);
+
+  uint32_t base = SourceManager::get().add(code);
+  auto load = [&](const std::string &contents) {
+    std::ofstream(cached, std::ios::binary | std::ios::trunc) << contents;
+    Arena arena;
+    std::vector<Stmt *> stmts;
+    return load_program(cached, hash, base, arena, stmts);
+  };
+  EXPECT_TRUE(load(saved));
+  EXPECT_FALSE(load(saved.substr(0, saved.size() / 2)));
+  // every word after the header in turn becomes an index, offset or count
+  // far out of range
+  for (uint32_t bad : {0x0000fff0u, 0x7ffffff0u}) {
+    for (size_t i = 32; i + 4 <= saved.size(); i += 4) {
+      std::string damaged = saved;
+      std::memcpy(damaged.data() + i, &bad, sizeof(bad));
+      load(damaged);
+    }
+  }
+  std::remove(path.c_str());
+  std::remove(cached.c_str());
+}
+
+TEST(EvalTest, collect_repl_lines) {
+  Lox lox;
+  lox.run("fun make() { var n = 0; fun inc() { n = n + 1; return n; } "
+          "return inc; } var c = make();");
+  for (int i = 0; i < 200; i++) {
+    lox.run("fun f(a) { return a + 1; }");
+    lox.run("{ var y = f(1); y = y + 1; }");
+  }
+  EXPECT_EQ(lox.eval_.arenas_.size(), 401);
+  EXPECT_EQ(lox.eval_.collect(), 399);
+  // the first line still has a function reachable through c, the last one
+  // that defines f is the global f
+  EXPECT_EQ(lox.eval_.arenas_.size(), 2);
+  lox.run("var a = c() + c() + f(1);");
+  Object *o = lox.eval_.env->get(Token(STRING, "a"));
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 5.0);
+}
+
+// Freed blocks are handed out again for requests of the same size class
+TEST(EvalTest, pool_free_lists) {
+  Pool pool;
+  void *a = pool.allocate(24);
+  void *b = pool.allocate(40);
+  EXPECT_NE(a, b);
+  pool.deallocate(a, 24);
+  EXPECT_EQ(pool.allocate(32), a);
+  void *large = pool.allocate(Pool::kMaxSize + 1);
+  pool.deallocate(large, Pool::kMaxSize + 1);
+  const Pool::Stats &stats = pool.stats();
+  EXPECT_EQ(stats.allocations, 4);
+  EXPECT_EQ(stats.reused, 1);
+  EXPECT_EQ(stats.frees, 2);
+  EXPECT_EQ(stats.slabs, 1);
+  EXPECT_EQ(stats.large, 1);
+}
+
+// Closures made and dropped in a loop reuse the cells and upvalues of the
+// ones before them
+TEST(EvalTest, pool_closures) {
+  Lox lox;
+  lox.run("fun make() { var n = 0; fun inc() { n = n + 1; return n; } "
+          "return inc; } var t = 0; for (var i = 0; i < 100; i = i + 1) { "
+          "var c = make(); t = t + c() + c(); }");
+  Object *o = lox.eval_.env->get(Token(STRING, "t"));
+  ASSERT_TRUE(o != nullptr);
+  EXPECT_EQ(*(float *)o->val, 300.0);
+  // a cell and its closure's upvalues per make(), and a copy of the
+  // upvalues every time c is looked up
+  const Pool::Stats &stats = lox.eval_.pool_.stats();
+  EXPECT_GE(stats.allocations, 500);
+  EXPECT_GE(stats.reused, stats.allocations - 10);
+  EXPECT_EQ(stats.slabs, 1);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
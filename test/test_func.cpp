@@ -21,17 +21,17 @@ TEST(FunctionTest, ParseSimpleFunction) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   // assert that we have two statements
   // and that the first one is a function
   ASSERT_EQ(stmts.size(), 2);
   // check that statment is castable to a Function pointer
-  ASSERT_TRUE(dynamic_cast<Function *>(stmts[0].get()));
+  ASSERT_TRUE(dyn_cast<Function>(stmts[0]));
   // assert that the num of args is 2
   // and that the body is a block
   // with one statement
-  ASSERT_EQ(((Function *)stmts[0].get())->params.size(), 2);
-  ASSERT_EQ(((Function *)stmts[0].get())->body.size(), 1);
+  ASSERT_EQ(((Function *)stmts[0])->params.size(), 2);
+  ASSERT_EQ(((Function *)stmts[0])->body.size(), 1);
 }
 
 // A test to parse and check if a function enters the environment
@@ -48,12 +48,12 @@ TEST(FunctionTest, EvalFunctionDeclaration) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   Evaluator eval;
   Resolver resolver(&eval);
   bool ret = resolver.resolve(stmts);
   ASSERT_TRUE(ret);
-  eval.eval(std::move(stmts));
+  eval.eval(stmts);
   ASSERT_TRUE(eval.env->get("sum") != nullptr);
   ASSERT_TRUE(eval.env->get("a") != nullptr);
   // assert that the object val pointer is a LoxFunction ptr
@@ -83,13 +83,13 @@ TEST(FunctionTest, FibonacciFunction) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   Evaluator eval;
   Resolver resolver(&eval);
   bool ret = resolver.resolve(stmts);
   ASSERT_TRUE(ret);
 
-  eval.eval(std::move(stmts));
+  eval.eval(stmts);
   ASSERT_TRUE(eval.env->get("fib") != nullptr);
   ASSERT_TRUE(eval.env->get("a") != nullptr);
   // assert that the object val pointer is a LoxFunction ptr
@@ -123,13 +123,13 @@ TEST(FunctionTest, ClosureFunctionTest) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   Evaluator eval;
   Resolver resolver(&eval);
   bool ret = resolver.resolve(stmts);
   ASSERT_TRUE(ret);
 
-  eval.eval(std::move(stmts));
+  eval.eval(stmts);
   ASSERT_TRUE(eval.env->get("makeCounter") != nullptr);
   ASSERT_TRUE(eval.env->get("counter") != nullptr);
   ASSERT_TRUE(eval.env->get("a") != nullptr);
@@ -164,11 +164,11 @@ TEST(FunctionTest, FrozenClosure) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   Evaluator eval;
   Resolver resolver(&eval);
   resolver.resolve(stmts);
-  eval.eval(std::move(stmts));
+  eval.eval(stmts);
   // assert that ret1 and ret2 are equal to global
   ASSERT_TRUE(eval.env->get("ret1") != nullptr);
   ASSERT_TRUE(eval.env->get("ret2") != nullptr);
@@ -180,6 +180,44 @@ TEST(FunctionTest, FrozenClosure) {
   ASSERT_TRUE(std::string((char *)(eval.env->get("ret2")->val)) == "global");
 }
 
+// Top level functions are parsed on their first call, nested ones with the
+// body they are in
+TEST(FunctionTest, LazyFunctionBodies) {
+  std::string test_code = R"(
+                                fun makeCounter() {
+                                    var i = 0;
+                                    fun count() {
+                                        i = i + 1;
+                                        return i;
+                                    }
+                                    return count;
+                                }
+                                fun fib(n) {
+                                    if (n < 2) { return n; }
+                                    return fib(n - 1) + fib(n - 2);
+                                }
+                                fun unused() { var = ; }
+                                var counter = makeCounter();
+                                counter();
+                                var a = counter();
+                                var b = fib(10);
+                                )";
+  Lox lox;
+  lox.lazy_functions_ = true;
+  lox.run(test_code);
+  ASSERT_TRUE(lox.eval_.env->get("a") != nullptr);
+  ASSERT_TRUE(*(float *)(lox.eval_.env->get("a")->val) == 2.0);
+  ASSERT_TRUE(lox.eval_.env->get("b") != nullptr);
+  ASSERT_TRUE(*(float *)(lox.eval_.env->get("b")->val) == 55.0);
+  // the body with the syntax error was never parsed
+  auto unused = (LoxFunction *)lox.eval_.env->get("unused")->val;
+  ASSERT_TRUE(unused->f->lazy);
+  ASSERT_TRUE(unused->f->body.empty());
+  auto fib = (LoxFunction *)lox.eval_.env->get("fib")->val;
+  ASSERT_FALSE(fib->f->lazy);
+  ASSERT_EQ(fib->f->body.size(), 2);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
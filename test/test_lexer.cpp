@@ -1,15 +1,21 @@
 #include "scanner.h"
+#include "simd_scan.h"
+#include "source.h"
+#include <algorithm>
+#include <random>
 #include "gtest/gtest.h"
 
-TEST(LexerTest, token_test_1) { Token t = Token(NUMBER, "3", new float(3), 0); }
+TEST(LexerTest, token_test_1) {
+  Token t = Token(NUMBER, "3");
+  EXPECT_EQ(NUMBER, t.token_type_);
+}
 
 TEST(LexerTest, token_test_2) {
-  Token t = Token(NUMBER, "3", new float(3), 10);
+  Token t = Token(NUMBER, "3");
   Token t1 = t;
-  EXPECT_FLOAT_EQ(3, *(float *)t1.literal);
+  EXPECT_FLOAT_EQ(3, t1.number);
   EXPECT_FLOAT_EQ(NUMBER, t1.token_type_);
-  EXPECT_EQ("3", t1.literal_string);
-  EXPECT_EQ(10, t1.line_no);
+  EXPECT_EQ("3", t1.lexeme());
 }
 
 TEST(LexerTest, lexer_test_0) {
@@ -34,6 +40,37 @@ TEST(LexerTest, lexer_test_1) {
   EXPECT_EQ(tokens.size(), 10);
 }
 
+TEST(LexerTest, tokens_view_source) {
+  Scanner scanner;
+  scanner.init("var name = \"text\";\nname = 12.5;");
+  EXPECT_TRUE(scanner.scan());
+  auto tokens = scanner.get_tokens();
+  ASSERT_EQ(tokens.size(), 10);
+  EXPECT_EQ(tokens[1].lexeme(), "name");
+  EXPECT_EQ(tokens[3].token_type_, STRING);
+  EXPECT_EQ(tokens[3].lexeme(), "text");
+  EXPECT_EQ(tokens[5].lexeme(), "name");
+  EXPECT_EQ(tokens[5].line(), 1);
+  EXPECT_EQ(tokens[5].offset - tokens[1].offset, 15);
+  EXPECT_FLOAT_EQ(tokens[7].number, 12.5);
+  EXPECT_EQ(tokens[1].offset, scanner.get_source_base() + 4);
+}
+
+TEST(LexerTest, token_positions) {
+  Scanner scanner;
+  scanner.init("var s = \"two\nlines\";\n\n  print s;");
+  EXPECT_TRUE(scanner.scan());
+  auto tokens = scanner.get_tokens();
+  ASSERT_EQ(tokens.size(), 9);
+  auto &sources = SourceManager::get();
+  EXPECT_EQ(sources.position(tokens[0].offset).line, 0);
+  // newlines inside a string count as well
+  EXPECT_EQ(sources.position(tokens[5].offset).line, 3);
+  EXPECT_EQ(sources.position(tokens[5].offset).column, 2);
+  EXPECT_EQ(sources.position(tokens[6].offset).column, 8);
+  EXPECT_EQ(tokens[7].line(), 3);
+}
+
 TEST(LexerTest, lexer_test_2) {
   Scanner scanner;
   scanner.init("1+2=abs");
@@ -41,6 +78,236 @@ TEST(LexerTest, lexer_test_2) {
   EXPECT_EQ(scanner.get_tokens().size(), 6);
 }
 
+static void expect_same_tokens(const std::string &code) {
+  Scanner regex_scanner, dfa_scanner;
+  regex_scanner.init(code, Scanner::Mode::REGEX);
+  dfa_scanner.init(code, Scanner::Mode::DFA);
+  EXPECT_EQ(regex_scanner.scan(), dfa_scanner.scan()) << code;
+  auto expected = regex_scanner.get_tokens();
+  auto actual = dfa_scanner.get_tokens();
+  ASSERT_EQ(expected.size(), actual.size()) << code;
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i].token_type_, actual[i].token_type_) << code;
+    EXPECT_EQ(expected[i].lexeme(), actual[i].lexeme()) << code;
+    EXPECT_EQ(expected[i].line(), actual[i].line()) << code;
+  }
+}
+
+TEST(LexerTest, dfa_matches_regex) {
+  expect_same_tokens(R"(
+    // a comment
+    fun fib(n) {
+      if (n <= 1) { return 1; }
+      return fib(n - 1) + fib(n - 2);
+    }
+    var classy = "a string"; var _x1 = 12.5 * 3 / 4;
+    print(!true != false, 1 == 2, a >= b, a > b, a < b, a <= b, x = y);
+    while (orchid and android or nil) { this.super; }
+  )");
+}
+
+TEST(LexerTest, dfa_matches_regex_edge_cases) {
+  // numbers with several fractions, trailing dots, keyword prefixes
+  expect_same_tokens("1.2.3 4. .5 forx for fun_ _and and1 x//y(z)\n//");
+  // strings may not contain parentheses in the regex grammar
+  expect_same_tokens("\"unterminated");
+  expect_same_tokens("\"has (paren)\"");
+  expect_same_tokens("var s = \"multi\nline\";\n@");
+  expect_same_tokens("");
+}
+
+TEST(LexerTest, simd_scan_matches_scalar) {
+  // random buffers drawn mostly from whitespace and terminator bytes so that
+  // every lane position and the scalar tails get exercised
+  const std::string alphabet = " \t\n\r\v\f \n  ab\"()";
+  const std::string picked = simd_scan_impl();
+  // every implementation the CPU can run, not just the one it picks
+  for (const char *name : {"avx2", "sse2", "scalar"}) {
+    if (!set_simd_scan_impl(name)) {
+      continue;
+    }
+    SCOPED_TRACE(name);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    for (int round = 0; round < 2000; round++) {
+      // each length from 0 to 99, so tails shorter than 16 and 32 bytes
+      // follow every number of whole vectors
+      std::string buf(round % 100, ' ');
+      for (auto &c : buf)
+        c = alphabet[pick(rng)];
+      if (round % 5 == 0 && !buf.empty())
+        buf[rng() % buf.size()] = '\0';
+      // a run of whitespace long enough to cross a vector or two
+      if (round % 3 == 0)
+        std::fill_n(buf.begin(), std::min<size_t>(buf.size(), rng() % 70), ' ');
+
+      size_t expected = 0;
+      while (expected < buf.size() && std::isspace(buf[expected]))
+        expected++;
+      EXPECT_EQ(skip_whitespace(buf.data(), buf.size()), expected);
+
+      std::vector<uint32_t> expected_newlines, newlines;
+      for (size_t i = 0; i < buf.size(); i++) {
+        if (buf[i] == '\n')
+          expected_newlines.push_back(100 + i);
+      }
+      find_newlines(buf.data(), buf.size(), 100, newlines);
+      EXPECT_EQ(newlines, expected_newlines);
+
+      auto first_of = [&](const std::string &set) {
+        size_t i = 0;
+        while (i < buf.size() && set.find(buf[i]) == std::string::npos)
+          i++;
+        return i;
+      };
+      EXPECT_EQ(find_comment_end(buf.data(), buf.size()),
+                first_of(std::string("\n()\0", 4)));
+      EXPECT_EQ(find_string_end(buf.data(), buf.size()),
+                first_of(std::string("\"()\0", 4)));
+    }
+  }
+  EXPECT_TRUE(set_simd_scan_impl("scalar"));
+  EXPECT_FALSE(set_simd_scan_impl("neon"));
+  ASSERT_TRUE(set_simd_scan_impl(picked));
+}
+
+TEST(LexerTest, parallel_scan_matches_serial) {
+  // strings spanning lines and comments holding quotes are what make picking
+  // the chunk boundaries tricky
+  std::string code;
+  for (int i = 0; i < 20000; i++) {
+    code += "var s" + std::to_string(i) + " = \"line\n\nbreak\";\n";
+    code += "// \"quoted\" comment\nprint(s" + std::to_string(i) + ");\n";
+    code += "fun f(a) { return a * 1.5; } // a ) b\n\n";
+  }
+  Scanner serial, parallel;
+  serial.init(code);
+  parallel.init(code);
+  ASSERT_TRUE(serial.scan());
+  ASSERT_TRUE(parallel.scan(4));
+  auto expected = serial.get_tokens();
+  auto actual = parallel.get_tokens();
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[i].token_type_, actual[i].token_type_) << i;
+    ASSERT_EQ(expected[i].lexeme(), actual[i].lexeme()) << i;
+    ASSERT_EQ(expected[i].offset - serial.get_source_base(),
+              actual[i].offset - parallel.get_source_base())
+        << i;
+    if (expected[i].token_type_ == IDENTIFIER) {
+      ASSERT_EQ(expected[i].symbol, actual[i].symbol) << i;
+    }
+  }
+
+  // an error in a later chunk fails the whole scan, like the serial one
+  code += "var broken = \"(\";\n" + code;
+  parallel.init(code);
+  EXPECT_FALSE(parallel.scan(4));
+  EXPECT_TRUE(parallel.had_error());
+}
+
+TEST(LexerTest, identifier_symbols) {
+  Scanner scanner;
+  scanner.init("var count = 1; count = count + other;");
+  ASSERT_TRUE(scanner.scan());
+  auto tokens = scanner.get_tokens();
+  ASSERT_EQ(tokens[1].token_type_, IDENTIFIER);
+  Symbol count = tokens[1].symbol;
+  EXPECT_EQ(tokens[5].symbol, count);
+  EXPECT_EQ(tokens[7].symbol, count);
+  EXPECT_NE(tokens[9].symbol, count);
+  EXPECT_EQ(SymbolTable::get().name(count), "count");
+  EXPECT_EQ(SymbolTable::get().find("count"), count);
+  EXPECT_EQ(SymbolTable::get().find("never_lexed"), SymbolTable::kNone);
+  // tokens made from text share the symbols of lexed ones
+  EXPECT_EQ(Token(IDENTIFIER, "count").symbol, count);
+}
+
+static void expect_relex_matches_scan(const std::string &code,
+                                      const Scanner::Edit &edit) {
+  Scanner incremental;
+  incremental.init(code);
+  ASSERT_TRUE(incremental.scan());
+  std::string edited = code;
+  edited.replace(edit.offset, edit.removed, edit.inserted);
+  Scanner full;
+  full.init(edited);
+  bool ok = full.scan();
+  ASSERT_EQ(incremental.relex(edit), ok) << edited;
+  if (!ok)
+    return;
+  auto expected = full.get_tokens();
+  auto actual = incremental.get_tokens();
+  ASSERT_EQ(expected.size(), actual.size()) << edited;
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i].token_type_, actual[i].token_type_) << edited;
+    EXPECT_EQ(expected[i].lexeme(), actual[i].lexeme()) << edited;
+    EXPECT_EQ(expected[i].offset - full.get_source_base(),
+              actual[i].offset - incremental.get_source_base())
+        << edited;
+    EXPECT_FLOAT_EQ(expected[i].number, actual[i].number) << edited;
+  }
+}
+
+TEST(LexerTest, relex_matches_scan) {
+  const std::string code = R"(var a = 1.5; // note (x)
+fun f(n) { return n != a and "s t r" == "q"; }
+print f(12) + 3;)";
+  // edits that merge, split and extend tokens, including ones that change
+  // tokens before the edit position
+  expect_relex_matches_scan(code, {4, 1, "abc"});
+  expect_relex_matches_scan(code, {9, 0, "2"});
+  expect_relex_matches_scan(code, {10, 0, "."});
+  expect_relex_matches_scan(code, {11, 1, "7"});
+  expect_relex_matches_scan(code, {18, 0, "!"});
+  expect_relex_matches_scan(code, {20, 1, ""});
+  expect_relex_matches_scan(code, {47, 1, "="});
+  expect_relex_matches_scan(code, {56, 0, "\""});
+  expect_relex_matches_scan(code, {0, code.size(), ""});
+  expect_relex_matches_scan(code, {code.size(), 0, " x"});
+
+  std::mt19937 rng(3);
+  const std::string alphabet = " \n1.a=/\"(!";
+  for (int round = 0; round < 500; round++) {
+    size_t offset = rng() % code.size();
+    size_t removed = rng() % std::min<size_t>(3, code.size() - offset + 1);
+    std::string inserted(rng() % 3, ' ');
+    for (auto &c : inserted)
+      c = alphabet[rng() % alphabet.size()];
+    expect_relex_matches_scan(code, {offset, removed, inserted});
+  }
+}
+
+TEST(LexerTest, relex_is_local) {
+  std::string code;
+  for (int i = 0; i < 1000; i++)
+    code += "var v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+  Scanner scanner;
+  scanner.init(code);
+  ASSERT_TRUE(scanner.scan());
+  size_t offset = code.find("v500");
+  ASSERT_TRUE(scanner.relex({offset + 1, 3, "x"}));
+  EXPECT_LE(scanner.relexed_tokens(), 2);
+  EXPECT_EQ(scanner.get_tokens().size(), 5001);
+  EXPECT_EQ(scanner.get_tokens()[2501].lexeme(), "vx");
+  EXPECT_EQ(scanner.get_tokens()[2502].lexeme(), "=");
+}
+
+TEST(LexerTest, relex_outside_source) {
+  const std::string code = "var a = 1;";
+  Scanner scanner;
+  scanner.init(code);
+  ASSERT_TRUE(scanner.scan());
+  EXPECT_FALSE(scanner.relex({code.size() + 1, 0, "x"}));
+  EXPECT_FALSE(scanner.relex({4, code.size(), ""}));
+  EXPECT_FALSE(scanner.relex({4, SIZE_MAX, ""}));
+  // the source and its tokens are left as they were
+  ASSERT_EQ(scanner.get_tokens().size(), 6);
+  EXPECT_EQ(scanner.get_tokens()[1].lexeme(), "a");
+  EXPECT_TRUE(scanner.relex({code.size(), 0, " b"}));
+  EXPECT_EQ(scanner.get_tokens()[5].lexeme(), "b");
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
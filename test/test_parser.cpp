@@ -1,10 +1,11 @@
 #include "parser.h"
+#include "printer.h"
 #include "scanner.h"
 #include "gtest/gtest.h"
 
 TEST(ParserTest, test_parser_1) {
   std::vector<Token> tokens = {
-      Token(STRING, "My Fair Lady", strdup("My Fair Lady"), 0)};
+      Token(STRING, "My Fair Lady")};
   Parser p;
   p.init(tokens);
   auto expr = p.parse();
@@ -14,14 +15,14 @@ TEST(ParserTest, test_parser_1) {
 TEST(ParserTest, test_parser_2) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(STRING, "My Fair Lady", strdup("My Fair Lady"), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(STRING, "My Fair Lady", strdup("My Fair Lady"), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(BANG, "!", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(STRING, "My Fair Lady"),
+      Token(SEMICOLON, ";"),
+      Token(STRING, "My Fair Lady"),
+      Token(SEMICOLON, ";"),
+      Token(BANG, "!"),
+      Token(TRUE, "true"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
@@ -33,110 +34,109 @@ TEST(ParserTest, test_parser_2) {
 TEST(ParserTest, test_parser_3) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(PRINT, "", nullptr, 0),
-      Token(LEFT_PAREN, "(" , nullptr, 0),
-      Token(BANG, "!", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(RIGHT_PAREN, ")" , nullptr, 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(PRINT, ""),
+      Token(LEFT_PAREN, "("),
+      Token(BANG, "!"),
+      Token(TRUE, "true"),
+      Token(RIGHT_PAREN, ")"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<Print>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Print>(stmts[0]) != nullptr);
 }
 
 TEST(ParserTest, test_parser_4) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(PRINT, "", nullptr, 0),
-      Token(LEFT_PAREN, "(" , nullptr, 0),
-      Token(BANG, "!", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(RIGHT_PAREN, ")" , nullptr, 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(PRINT, "", nullptr, 0),
-      Token(LEFT_PAREN, "(" , nullptr, 0),
-      Token(BANG, "!", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(RIGHT_PAREN, ")" , nullptr, 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(PRINT, ""),
+      Token(LEFT_PAREN, "("),
+      Token(BANG, "!"),
+      Token(TRUE, "true"),
+      Token(RIGHT_PAREN, ")"),
+      Token(SEMICOLON, ";"),
+      Token(PRINT, ""),
+      Token(LEFT_PAREN, "("),
+      Token(BANG, "!"),
+      Token(TRUE, "true"),
+      Token(RIGHT_PAREN, ")"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 2);
-  EXPECT_TRUE(dynamic_pointer_cast<Print>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Print>(stmts[0]) != nullptr);
 }
 
 TEST(ParserTest, test_parser_5) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(VAR, "", nullptr, 0),
-      Token(IDENTIFIER, "foo", nullptr, 0),
-      Token(EQUAL, "=", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(VAR, ""),
+      Token(IDENTIFIER, "foo"),
+      Token(EQUAL, "="),
+      Token(TRUE, "true"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<Var>(stmts[0]) != nullptr);
-  EXPECT_TRUE(dynamic_pointer_cast<Var>(stmts[0])->name->literal_string ==
-              "foo");
-  EXPECT_TRUE(dynamic_pointer_cast<Literal>(
-                  dynamic_pointer_cast<Var>(stmts[0])->initializer) != nullptr);
+  EXPECT_TRUE(dyn_cast<Var>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Var>(stmts[0])->name.lexeme() == "foo");
+  EXPECT_TRUE(dyn_cast<Literal>(
+                  dyn_cast<Var>(stmts[0])->initializer) != nullptr);
 }
 
 TEST(ParserTest, test_parser_6) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(IDENTIFIER, "foo", nullptr, 0),
-      Token(EQUAL, "=", nullptr, 0),
-      Token(TRUE, "true", new bool(true), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(IDENTIFIER, "foo"),
+      Token(EQUAL, "="),
+      Token(TRUE, "true"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<Expression>(stmts[0]) != nullptr);
-  EXPECT_TRUE(dynamic_pointer_cast<Assign>(
-                  dynamic_pointer_cast<Expression>(stmts[0])->expression)
-                  ->name->literal_string == "foo");
-  EXPECT_TRUE(dynamic_pointer_cast<Literal>(
-                  dynamic_pointer_cast<Assign>(
-                      dynamic_pointer_cast<Expression>(stmts[0])->expression)
+  EXPECT_TRUE(dyn_cast<Expression>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Assign>(
+                  dyn_cast<Expression>(stmts[0])->expression)
+                  ->name.lexeme() == "foo");
+  EXPECT_TRUE(dyn_cast<Literal>(
+                  dyn_cast<Assign>(
+                      dyn_cast<Expression>(stmts[0])->expression)
                       ->value)
-                  ->value->token_type_ == TRUE);
+                  ->value.token_type_ == TRUE);
 }
 
 TEST(ParserTest, test_parser_7) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(IDENTIFIER, "foo", nullptr, 0),
-      Token(EQUAL, "=", nullptr, 0),
-      Token(LEFT_PAREN, "(", nullptr, 0),
-      Token(NUMBER, "12", new float(12), 0),
-      Token(SLASH, "/", nullptr, 0),
-      Token(LEFT_PAREN, "(", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(RIGHT_PAREN, ")", nullptr, 0),
-      Token(RIGHT_PAREN, ")", nullptr, 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(IDENTIFIER, "foo"),
+      Token(EQUAL, "="),
+      Token(LEFT_PAREN, "("),
+      Token(NUMBER, "12"),
+      Token(SLASH, "/"),
+      Token(LEFT_PAREN, "("),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(RIGHT_PAREN, ")"),
+      Token(RIGHT_PAREN, ")"),
+      Token(SEMICOLON, ";"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
@@ -144,62 +144,62 @@ TEST(ParserTest, test_parser_7) {
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
   EXPECT_TRUE(stmts[0] != nullptr);
-  EXPECT_TRUE(dynamic_pointer_cast<Expression>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Expression>(stmts[0]) != nullptr);
 }
 
 TEST(ParserTest, test_parser_8) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(IF, "if", nullptr, 0),
-      Token(LEFT_PAREN, "(", nullptr, 0),
-      Token(TRUE, "true", nullptr, 0),
-      Token(RIGHT_PAREN, ")", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(ELSE, "else", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(IF, "if"),
+      Token(LEFT_PAREN, "("),
+      Token(TRUE, "true"),
+      Token(RIGHT_PAREN, ")"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(ELSE, "else"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   Parser p;
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<If>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<If>(stmts[0]) != nullptr);
 }
 
 TEST(ParserTest, test_parser_9) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(IF, "if", nullptr, 0),
-      Token(LEFT_PAREN, "(", nullptr, 0),
-      Token(TRUE, "true", nullptr, 0),
-      Token(AND, "and", nullptr, 0),
-      Token(FALSE, "false", nullptr, 0),
-      Token(RIGHT_PAREN, ")", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(ELSE, "else", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(IF, "if"),
+      Token(LEFT_PAREN, "("),
+      Token(TRUE, "true"),
+      Token(AND, "and"),
+      Token(FALSE, "false"),
+      Token(RIGHT_PAREN, ")"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(ELSE, "else"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   // clang-format on
@@ -207,33 +207,33 @@ TEST(ParserTest, test_parser_9) {
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<If>(stmts[0]) != nullptr);
-  EXPECT_TRUE(dynamic_pointer_cast<If>(stmts[0])->condition != nullptr);
+  EXPECT_TRUE(dyn_cast<If>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<If>(stmts[0])->condition != nullptr);
 }
 
 TEST(ParserTest, test_parser_10) {
   // clang-format off
   std::vector<Token> tokens = {
-      Token(IF, "if", nullptr, 0),
-      Token(LEFT_PAREN, "(", nullptr, 0),
-      Token(TRUE, "true", nullptr, 0),
-      Token(OR, "or", nullptr, 0),
-      Token(FALSE, "false", nullptr, 0),
-      Token(RIGHT_PAREN, ")", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(ELSE, "else", nullptr, 0),
-      Token(LEFT_BRACE, "{", nullptr, 0),
-      Token(NUMBER, "24", new float(24), 0),
-      Token(STAR, "*", nullptr, 0),
-      Token(NUMBER, "2", new float(2), 0),
-      Token(SEMICOLON, ";", nullptr, 0),
-      Token(RIGHT_BRACE, "}", nullptr, 0),
-      Token(END_OF_FILE, "", nullptr, 0)
+      Token(IF, "if"),
+      Token(LEFT_PAREN, "("),
+      Token(TRUE, "true"),
+      Token(OR, "or"),
+      Token(FALSE, "false"),
+      Token(RIGHT_PAREN, ")"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(ELSE, "else"),
+      Token(LEFT_BRACE, "{"),
+      Token(NUMBER, "24"),
+      Token(STAR, "*"),
+      Token(NUMBER, "2"),
+      Token(SEMICOLON, ";"),
+      Token(RIGHT_BRACE, "}"),
+      Token(END_OF_FILE, "")
   };
   // clang-format on
   // clang-format on
@@ -241,8 +241,8 @@ TEST(ParserTest, test_parser_10) {
   p.init(tokens);
   auto stmts = p.parse_stmts();
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<If>(stmts[0]) != nullptr);
-  EXPECT_TRUE(dynamic_pointer_cast<If>(stmts[0])->condition != nullptr);
+  EXPECT_TRUE(dyn_cast<If>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<If>(stmts[0])->condition != nullptr);
 }
 
 // A test to parse a class
@@ -262,12 +262,210 @@ TEST(ParserTest, test_parser_11) {
   scanner.scan();
   Parser parser;
   parser.init(scanner.get_tokens());
-  std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_stmts();
+  std::vector<Stmt *> stmts = parser.parse_stmts();
   std::cout << "stmts size: " << stmts.size() << std::endl;
   EXPECT_TRUE(stmts.size() == 1);
-  EXPECT_TRUE(dynamic_pointer_cast<Class>(stmts[0]) != nullptr);
+  EXPECT_TRUE(dyn_cast<Class>(stmts[0]) != nullptr);
   // check there are two methods
-  EXPECT_TRUE(dynamic_pointer_cast<Class>(stmts[0])->methods.size() == 2);
+  EXPECT_TRUE(dyn_cast<Class>(stmts[0])->methods.size() == 2);
+}
+
+// Parsing from a scanner on demand must give the same statements as parsing
+// the materialized token vector
+TEST(ParserTest, test_parser_streaming) {
+  std::string test_code = R"(
+        // a comment before the first statement
+        fun add(a, b) { return a + b; }
+        var x = add(1, 2) * (3 - 4);
+        for (var i = 0; i < 10; i = i + 1) { print(i, x); }
+        if (x >= 3 and !false) { x = x / 2; } else { print("no"); }
+        class Foo { bar() { return nil; } }
+    )";
+  Scanner materialized;
+  materialized.init(test_code);
+  ASSERT_TRUE(materialized.scan());
+  Parser parser;
+  parser.init(materialized.get_tokens());
+  auto expected = parser.parse_stmts();
+
+  Scanner streaming;
+  streaming.init(test_code);
+  Parser streaming_parser;
+  streaming_parser.init(streaming);
+  auto actual = streaming_parser.parse_stmts();
+
+  ASSERT_EQ(expected.size(), 5);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i]->print_type(), actual[i]->print_type());
+    EXPECT_EQ(expected[i]->line_no(), actual[i]->line_no());
+  }
+  // the streaming scanner does not keep the tokens it handed out
+  EXPECT_TRUE(streaming.get_tokens().empty());
+}
+
+TEST(ParserTest, test_parser_streaming_lex_error) {
+  Scanner scanner;
+  scanner.init("var a = 1; var b = @;");
+  Parser parser;
+  parser.init(scanner);
+  parser.parse_stmts();
+  EXPECT_TRUE(scanner.had_error());
+}
+
+TEST(ParserTest, test_parser_arena_outlives_parser) {
+  std::vector<Stmt *> stmts;
+  std::unique_ptr<Arena> arena;
+  {
+    Scanner scanner;
+    scanner.init("var a = 1 + 2; { print(a); }");
+    Parser parser;
+    parser.init(scanner);
+    stmts = parser.parse_stmts();
+    arena = parser.take_arena();
+    // the parser carries on with a fresh arena
+    scanner.init("var b = 3;");
+    parser.init(scanner);
+    EXPECT_EQ(parser.parse_stmts().size(), 1);
+  }
+  ASSERT_EQ(stmts.size(), 2);
+  auto var = dyn_cast<Var>(stmts[0]);
+  ASSERT_TRUE(var != nullptr);
+  EXPECT_EQ(var->name.lexeme(), "a");
+  EXPECT_TRUE(dyn_cast<Binary>(var->initializer) != nullptr);
+  auto block = dyn_cast<Block>(stmts[1]);
+  ASSERT_TRUE(block != nullptr);
+  EXPECT_EQ(block->statements.size(), 1);
+  EXPECT_GT(arena->bytes_allocated(), 0);
+}
+
+TEST(ParserTest, test_parser_node_kinds) {
+  Scanner scanner;
+  scanner.init("var a = -1; print(a);");
+  Parser parser;
+  parser.init(scanner);
+  auto stmts = parser.parse_stmts();
+  ASSERT_EQ(stmts.size(), 2);
+  EXPECT_EQ(stmts[0]->kind, Stmt::Kind::Var);
+  EXPECT_EQ(stmts[1]->kind, Stmt::Kind::Print);
+  // a checked cast to the wrong kind yields nullptr
+  EXPECT_TRUE(dyn_cast<Print>(stmts[0]) == nullptr);
+  EXPECT_TRUE(dyn_cast<Binary>(dyn_cast<Var>(stmts[0])->initializer) ==
+              nullptr);
+  const Stmt *s = stmts[1];
+  const Print *p = dyn_cast<Print>(s);
+  ASSERT_TRUE(p != nullptr);
+  EXPECT_EQ(p->expressions.size(), 1);
+  EXPECT_EQ(p->expressions[0]->print_type(), "Variable");
+}
+
+TEST(ParserTest, test_parser_flat_ast) {
+  std::string test_code = R"(
+        fun add(a, b) { return a + b; }
+        var x = add(1, 2) * -3;
+        while (x < 10) { x = x + 1; print(x, "x"); }
+    )";
+  Scanner scanner;
+  scanner.init(test_code);
+  ASSERT_TRUE(scanner.scan());
+  Parser parser;
+  parser.init(scanner.get_tokens());
+  auto expected = parser.parse_stmts();
+
+  FlatAst ast;
+  Parser flat_parser;
+  flat_parser.init(scanner.get_tokens());
+  ASSERT_TRUE(flat_parser.parse_flat(ast));
+  ASSERT_EQ(ast.program.size(), 3);
+  EXPECT_EQ(ast.function_nodes.size(), 1);
+  EXPECT_EQ(ast.token_lists.size(), 2);
+  EXPECT_EQ(ast.binary_nodes.size(), 4);
+  EXPECT_EQ(ast.call_nodes.size(), 1);
+  EXPECT_GT(ast.bytes(), 0);
+
+  Arena arena;
+  auto actual = inflate(ast, arena);
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i]->print_type(), actual[i]->print_type());
+    EXPECT_EQ(expected[i]->offset, actual[i]->offset);
+  }
+  auto var = dyn_cast<Var>(actual[1]);
+  ASSERT_TRUE(var != nullptr);
+  PrettyPrinter printer;
+  EXPECT_EQ(printer.paranthesize(var->initializer),
+            printer.paranthesize(dyn_cast<Var>(expected[1])->initializer));
+  auto function = dyn_cast<Function>(actual[0]);
+  ASSERT_TRUE(function != nullptr);
+  ASSERT_EQ(function->params.size(), 2);
+  EXPECT_EQ(function->params[1].lexeme(), "b");
+}
+
+TEST(ParserTest, test_parser_precedence) {
+  Scanner scanner;
+  scanner.init("x = -a + b * c(1)(2) < d or e and !f or g;");
+  Parser parser;
+  parser.init(scanner);
+  auto stmts = parser.parse_stmts();
+  ASSERT_EQ(stmts.size(), 1);
+  auto expr = dyn_cast<Expression>(stmts[0]);
+  ASSERT_TRUE(expr != nullptr);
+  PrettyPrinter printer;
+  EXPECT_EQ(printer.paranthesize(expr->expression),
+            "( assign  x ( or ( or ( < ( + ( - a) ( * b ( ( c 1) 2))) d) "
+            "( and e ( ! f))) g))");
+}
+
+// A parallel parse makes the same statements as a serial one
+TEST(ParserTest, test_parser_parallel) {
+  std::string test_code;
+  for (int i = 0; i < 2000; i++) {
+    std::string n = std::to_string(i);
+    test_code += "fun f" + n + "(a, b) { var c = a * " + n +
+                 "; if (c > b) { return c - b; } return -c; }\n"
+                 "var v" + n + " = f" + n + "(1, 2) + 3 * 4;\n"
+                 "for (var i = 0; i < 2; i = i + 1) { v" + n + " = i; }\n"
+                 "class C" + n + " { m() { return nil; } }\n";
+  }
+  Scanner scanner;
+  scanner.init(test_code);
+  ASSERT_TRUE(scanner.scan());
+  Parser serial;
+  serial.init(scanner.get_tokens());
+  auto expected = serial.parse_stmts();
+  Parser parallel;
+  parallel.init(scanner.get_tokens());
+  auto actual = parallel.parse_stmts(4);
+  ASSERT_EQ(actual.size(), expected.size());
+  PrettyPrinter printer;
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[i]->kind, actual[i]->kind);
+    EXPECT_EQ(expected[i]->offset, actual[i]->offset);
+    if (auto var = dyn_cast<Var>(expected[i])) {
+      EXPECT_EQ(printer.paranthesize(var->initializer),
+                printer.paranthesize(dyn_cast<Var>(actual[i])->initializer));
+    }
+  }
+  // the trees have the same shape all the way down
+  FlatAst expected_ast, actual_ast;
+  for (size_t i = 0; i < expected.size(); i++) {
+    flatten(expected_ast, expected[i]);
+    flatten(actual_ast, actual[i]);
+  }
+  std::vector<size_t> expected_sizes, actual_sizes;
+  expected_ast.for_each_array(
+      [&](const auto &items) { expected_sizes.push_back(items.size()); });
+  actual_ast.for_each_array(
+      [&](const auto &items) { actual_sizes.push_back(items.size()); });
+  EXPECT_EQ(expected_sizes, actual_sizes);
+  EXPECT_EQ(serial.take_arena()->bytes_allocated(),
+            parallel.take_arena()->bytes_allocated());
+
+  // a syntax error is found by the serial parse it falls back to
+  scanner.init(test_code + "var broken = ;\n" + test_code);
+  ASSERT_TRUE(scanner.scan());
+  parallel.init(scanner.get_tokens());
+  EXPECT_TRUE(parallel.parse_stmts(4).empty());
 }
 
 int main(int argc, char **argv) {